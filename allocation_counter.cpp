@@ -0,0 +1,26 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "allocation_counter.hpp"
+
+// operator new を置き換えて、呼んだ回数を数える。
+// (置き換えた operator new, delete が他の翻訳単位に inline 展開されないように、このファイルにまとめる。)
+static std::atomic<int64_t> num_allocations{0};
+
+void *operator new(std::size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+int64_t numAllocations(void) {
+    return num_allocations.load(std::memory_order_relaxed);
+}
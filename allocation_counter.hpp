@@ -0,0 +1,5 @@
+#pragma once
+#include <cstdint>
+
+// allocation_counter.cpp をリンクしたプログラムで、これまでに operator new を呼んだ回数 (bench で使う。)
+int64_t numAllocations(void);
@@ -1,15 +1,54 @@
 #include <vector>
+#include <array>
 #include <spdlog/spdlog.h>
 #include <fmt/ranges.h>
 #include "basewheel.hpp"
+#include "log.hpp"
+#include "parallel.hpp"
 
 using std::make_pair;
 using std::swap;
 
+// containSubgraphWithCorrespondingEdge の作業領域
+// スレッドごとに 1 つ持って呼び出しの間で使い回すので、 wheelgraph や subgraph の大きさが変わらなければメモリを確保しない。
+class MatchScratch {
+public:
+    // 辺をたどる途中の状態
+    // next_pair == -1 のときは辺 (edgeid_w, edgeid_s) をまだ訪れていない。
+    // そうでないときは diagonal vertex の組 (vs, vw) のうち next_pair 番目から対応させる。
+    // vs_matches[k] は diagonals[k] と対応させた組の数、 new_matches はそのうち新しく対応させた組の数 (next_pair より前の組の分)
+    class Frame {
+    public:
+        int edgeid_w, edgeid_s, next_pair;
+        std::array<int8_t, 2> vs_matches;
+        int8_t new_matches;
+    };
+
+    vector<int> occupied, located, occupied_tmp, located_tmp;
+    // visited_edges[e] が今の generation と等しいとき、 subgraph の辺 e を訪れている。
+    vector<uint32_t> visited_edges;
+    uint32_t generation = 0;
+    vector<Frame> stack;
+
+    // 新しい generation を返す。 (全ての辺を訪れていない状態に戻す。)
+    uint32_t nextGeneration(void) {
+        if (++generation == 0) {
+            std::fill(visited_edges.begin(), visited_edges.end(), 0);
+            generation = 1;
+        }
+        return generation;
+    }
+};
+
+static MatchScratch &matchScratch(void) {
+    thread_local MatchScratch scratch;
+    return scratch;
+}
+
 // wheelgraph (nearTriangulation) の辺番号 edgeid_wheelgraph を持つ辺 e と 
-// subgraph   (nearTriangulation) の辺番号 edgeid_subgraph   を持つ辺 f を向きまで含めて対応させる。
-// ただし、 except_vertices に入っている subgraph の頂点の対応は考えない。
-// このとき、対応させる辺について鏡映を考えると、0-2 通りの対応がある。 0-2 通りの結果を vector に入れて返す。 
+// subgraph   (plan を計算した nearTriangulation) の辺番号 edgeid_subgraph を持つ辺 f を向きまで含めて対応させる。
+// ただし、 plan の except_vertices に入っている subgraph の頂点の対応は考えない。
+// このとき、対応させる辺について鏡映を考えると、0-2 通りの対応がある。 0-2 通りの結果を res に入れる。 
 //
 // detect_possible = true のとき
 // + Yes: 全ての頂点の次数が適合している。 
@@ -20,97 +59,103 @@ using std::swap;
 // + Yes: 全ての頂点の次数が適合している。
 // + No: ある頂点の次数が適合していない。またはまだ次数が定まっていない頂点がある。(ある subgraph の頂点に対応する wheelgraph の頂点がないとき No を返す。) 
 //
-vector<ContainResult> BaseWheel::containSubgraphWithCorrespondingEdge(
-    const NearTriangulation &wheelgraph, const NearTriangulation &subgraph, 
-    int edgeid_wheelgraph, int edgeid_subgraph, 
-    const set<int> &except_vertices, bool detect_possible) {
-    // 返り値
-    vector<ContainResult> res;
+void BaseWheel::containSubgraphWithCorrespondingEdge(
+    const NearTriangulation &wheelgraph, const MatchPlan &plan, 
+    int edgeid_wheelgraph, int edgeid_subgraph, bool detect_possible, ContainResults &res) {
+    res.clear();
+    STATS_COUNT(Counter::MatchCalls, 1);
 
     // subgraph の頂点 vs と wheelgraph の頂点 vw の次数が適合しているか判定する。
-    // vs が except_vertices に入っていたら true 。
+    // vs の次数の条件 (plan.condition(vs)) が Degree() (次数が定まっていないか except_vertices に入っている) なら true 。
     // detect_possible = true のとき、
     // + vw の次数が定まっていない時: true
-    // + vs の次数が定まっていない時: true
     // + vs と vw の次数が既に定まっている時: vs の次数の範囲が vw の次数を含む <-> true
     // detect_possible = false のとき、
-    // + vs と vw の次数が定まっていない時: true
-    // + vw の次数が定まっていない かつ vs の次数が定まっている時: false
-    // + vs の次数が定まっていない時: true
+    // + vw の次数が定まっていない時: false
     // + vs と vw の次数が既に定まっている時: vs の次数の範囲が vw の次数を含む <-> true
     // 例 ) (vs, vw) = (5+, 5) -> ok, (6+, 5) -> ng
-    auto match_degree = [&wheelgraph, &subgraph, &except_vertices](int vs, int vw, bool detect_possible) {
-        if (except_vertices.count(vs)) return true;
-        optional<Degree> deg_vw = wheelgraph.degrees()[vw];
-        optional<Degree> deg_vs = subgraph.degrees()[vs];
-        if (detect_possible) {
-            if (!deg_vs.has_value()) return true;
-            if (!deg_vw.has_value()) return true;
-        }
-        else {
-            if (!deg_vs.has_value()) return true;
-            if (!deg_vw.has_value()) return false;
-        }
-        Degree degw = deg_vw.value();
-        Degree degs = deg_vs.value();
-        return degs.include(degw);
+    const auto &wheel_degrees = wheelgraph.degrees();
+    auto match_degree = [&plan, &wheel_degrees](int vs, int vw, bool detect_possible) {
+        const Degree &condition = plan.condition(vs);
+        if (condition.unset()) return true;
+        const Degree &degree = wheel_degrees[vw];
+        if (degree.unset()) return detect_possible;
+        return condition.include(degree);
     };
 
     // located[vs]: subgraph の頂点 vs に対応している wheelgraph の頂点
     // occupied[vw]: wheelgraph の頂点 vw に対応している subgraph の頂点
     // correspond 関数で対応させる。
-    vector<int> occupied(wheelgraph.vertexSize(), -1);
-    vector<int> located(subgraph.vertexSize(), -1);
+    MatchScratch &scratch = matchScratch();
+    vector<int> &occupied = scratch.occupied, &located = scratch.located;
+    vector<int> &occupied_tmp = scratch.occupied_tmp, &located_tmp = scratch.located_tmp;
+    occupied.assign(wheelgraph.vertexSize(), -1);
+    located.assign(plan.vertexSize(), -1);
+    vector<uint32_t> &visited_edges = scratch.visited_edges;
+    if ((int)visited_edges.size() < plan.numEdges()) visited_edges.resize(plan.numEdges(), 0);
+    auto &stack = scratch.stack;
     auto correspond = [&](int vs, int vw) -> void {
         occupied[vw] = vs;
         located[vs] = vw;
         return;
     };
 
-    // wheelgraph の辺 edge_w と subgraph の辺 edge_s を向きまで含めて対応させたことによって決まった
-    // それぞれの辺の diagonal_vertex (辺 e について e とある頂点 v が三角形を誘導する時 v を e の diagonal_vertex とする。) を対応させる。
-    // diagonal_vertex を対応させた結果決まる辺の対応を再帰的に決める。
-    auto set_edge_recursive = [&](auto &&set_edge_recursive, const pair<int, int> &edge_w, const pair<int, int> &edge_s, set<pair<int, int>> &visited_edges_w) -> bool {
-        if (visited_edges_w.count(edge_w)) return true;
-        visited_edges_w.insert(edge_w);
-        spdlog::trace("edge_w, edge_s : {}, {}", edge_w, edge_s);
-        const auto &diagonal_vertices_w = wheelgraph.diagonalVertices().at(edge_w);
-        const auto &diagonal_vertices_s = subgraph.diagonalVertices().at(edge_s);
-        bool match_deg = true;
-        int new_match_case = 0;
-        for (auto vs : diagonal_vertices_s) {
-            int vs_match_case = 0;
-            for (auto vw :  diagonal_vertices_w) {
-                // vs と vw のどちらかまたは両方がすでに他の頂点とマッチしているとときは、これ以上対応を考えない (continueする。)
+    // 辺の組 starts[0], starts[1], ... (wheelgraph の辺番号, subgraph の辺番号) から順に三角形をたどって対応を広げる。
+    // 辺の組 (edgeid_w, edgeid_s) を訪れたら、それぞれの辺の diagonal vertex (vs, vw) の組を順に見て、
+    // まだ対応していない (または互いに対応している) 組を対応させ、 plan の手順に従って次の 2 辺をたどる。
+    // 次の 2 辺をたどり終わったら、残りの組から続ける。 (再帰で深さ優先にたどるのと同じ順番になる。)
+    // 対応は単射なので、 wheelgraph の辺を訪れたかどうかは対応する subgraph の辺を訪れたかどうかで管理できる。
+    // 次数が適合しない組があれば、その時点で結果は No に決まるので false を返す。
+    auto extend = [&](const std::array<pair<int, int>, 4> &starts, int num_starts) -> bool {
+        uint32_t generation = scratch.nextGeneration();
+        stack.clear();
+        for (int i = num_starts - 1;i >= 0; i--) stack.push_back({starts[i].first, starts[i].second, -1, {0, 0}, 0});
+        while (!stack.empty()) {
+            auto [edgeid_w, edgeid_s, next_pair, vs_matches, new_matches] = stack.back();
+            stack.pop_back();
+            if (next_pair == -1) {
+                if (visited_edges[edgeid_s] == generation) continue;
+                visited_edges[edgeid_s] = generation;
+                next_pair = 0;
+            }
+            const auto &step = plan.step(edgeid_s);
+            LOG_TRACE("edge_w, edge_s : {}, {}", wheelgraph.edges()[edgeid_w], step.edge);
+            const auto &diagonal_vertices_w = wheelgraph.diagonalVertices(edgeid_w);
+            int num_diagonals_w = diagonal_vertices_w.size();
+            int num_pairs = step.diagonals.size() * num_diagonals_w;
+            for (int pair_idx = next_pair;pair_idx < num_pairs; pair_idx++) {
+                int k = pair_idx / num_diagonals_w;
+                int vs = step.diagonals[k], vw = diagonal_vertices_w[pair_idx % num_diagonals_w];
+                // vs と vw のどちらかまたは両方がすでに他の頂点とマッチしているとときは、これ以上対応を考えない。
                 if (!(located[vs] == -1 && occupied[vw] == -1) && !(located[vs] == vw && occupied[vw] == vs)) continue;
-                if (located[vs] == -1 && occupied[vw] == -1) new_match_case++;
-                ++vs_match_case;
-                if (!match_degree(vs, vw, detect_possible)) {
-                    match_deg = false;
-                    continue;
-                }
+                if (located[vs] == -1 && occupied[vw] == -1) new_matches++;
+                vs_matches[k]++;
+                // diagonal_vertex の対応のさせ方は 1通りしかない(minimal counterexample は 4cut を持たないから1つの辺について diagoal_vertex は 2個以下 そのうち 1個は既に前の段階で対応づけられているはずだから)ので n_case <= 1
+                assert(vs_matches[k] <= 1);
+                assert(new_matches <= 1);
+                if (!match_degree(vs, vw, detect_possible)) return false;
                 correspond(vs, vw);
-                match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_w.first, vw), make_pair(edge_s.first, vs), visited_edges_w);
-                match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_w.second, vw), make_pair(edge_s.second, vs), visited_edges_w);
+                const auto &edge_w = wheelgraph.edges()[edgeid_w];
+                stack.push_back({edgeid_w, edgeid_s, pair_idx + 1, vs_matches, new_matches});
+                stack.push_back({wheelgraph.edgeId(edge_w.second, vw), step.second_edgeids[k], -1, {0, 0}, 0});
+                stack.push_back({wheelgraph.edgeId(edge_w.first, vw), step.first_edgeids[k], -1, {0, 0}, 0});
+                break;
             }
-            // diagonal_vertex の対応のさせ方は 1通りしかない(minimal counterexample は 4cut を持たないから1つの辺について diagoal_vertex は 2個以下 そのうち 1個は既に前の段階で対応づけられているはずだから)ので n_case <= 1
-            assert(vs_match_case <= 1);
         }
-        assert(new_match_case <= 1);
-        return match_deg;
+        return true;
     };
 
     // res を 更新する。
     auto update_res = [&](bool match_deg) {
         if (!match_deg) {
             // 次数がマッチしない時 No
-            res.emplace_back(Contain::No);
+            STATS_COUNT(Counter::MatchNo, 1);
+            res.push_back(Contain::No, occupied);
             return;
         }
         bool is_possible = false;
-        for (int v = 0;v < subgraph.vertexSize(); v++) {
-            // except_vertices に入っているときは、なんでもよい。
-            if (except_vertices.count(v)) continue;
+        // except_vertices に入っている頂点は、なんでもよい。
+        for (int v : plan.requiredVertices()) {
             // 1. 対応する頂点がない ( subgraph がはみでているとき)
             // 2. 対応する頂点があるが、次数がマッチしていないとき
             if ((located[v] == -1)
@@ -120,74 +165,79 @@ vector<ContainResult> BaseWheel::containSubgraphWithCorrespondingEdge(
             }
         }
         if (is_possible) {
-            if (detect_possible) res.emplace_back(Contain::Possible, occupied);
-            else res.emplace_back(Contain::No);
+            res.push_back(detect_possible ? Contain::Possible : Contain::No, occupied);
+            STATS_COUNT(detect_possible ? Counter::MatchPossible : Counter::MatchNo, 1);
         } else {
             // Yes
-            res.emplace_back(Contain::Yes, occupied);
+            STATS_COUNT(Counter::MatchYes, 1);
+            res.push_back(Contain::Yes, occupied);
         }
         return;
     };
 
-    auto edge_wheelgraph = wheelgraph.edges()[edgeid_wheelgraph];
-    auto edge_subgraph = subgraph.edges()[edgeid_subgraph];
-    spdlog::trace("edge_cartwheel, edge_subgraph : {}, {}", edge_wheelgraph, edge_subgraph);
-    // そもそも対応させる辺で次数がマッチしていなかったら {} を返して終了
+    const auto &edge_wheelgraph = wheelgraph.edges()[edgeid_wheelgraph];
+    const auto &root_step = plan.step(edgeid_subgraph);
+    const auto &edge_subgraph = root_step.edge;
+    LOG_TRACE("edge_cartwheel, edge_subgraph : {}, {}", edge_wheelgraph, edge_subgraph);
+    // そもそも対応させる辺で次数がマッチしていなかったら何も入れずに終了
     if (!match_degree(edge_subgraph.first, edge_wheelgraph.first, detect_possible) 
      || !match_degree(edge_subgraph.second, edge_wheelgraph.second, detect_possible)) {
-        return {};
+        STATS_COUNT(Counter::MatchNo, 1);
+        return;
     }
     correspond(edge_subgraph.first, edge_wheelgraph.first);
     correspond(edge_subgraph.second, edge_wheelgraph.second);
 
-    const auto &diagonal_vertices_wheelgraph = wheelgraph.diagonalVertices().at(edge_wheelgraph);
-    const auto &diagonal_vertices_subgraph = subgraph.diagonalVertices().at(edge_subgraph);
+    const auto &diagonal_vertices_wheelgraph = wheelgraph.diagonalVertices(edgeid_wheelgraph);
+    const auto &diagonal_vertices_subgraph = root_step.diagonals;
 
     // subgraph の辺 e について diagonal な位置にある頂点が 1 点, wheelgraph は 2 点だったとき、
     // subgraph の diagonal な頂点を wheelgraph の 2 点のうちどちらを固定するかで 2 通り考える。
     // それぞれの場合で、追加で 2 本の辺を固定する。
     if (diagonal_vertices_subgraph.size() == 1 && diagonal_vertices_wheelgraph.size() == 2) {
         int vs = diagonal_vertices_subgraph[0];
-        auto located_tmp = located, occupied_tmp = occupied;
+        located_tmp.assign(located.begin(), located.end());
+        occupied_tmp.assign(occupied.begin(), occupied.end());
         for (auto vw : diagonal_vertices_wheelgraph) {
             if (!match_degree(vs, vw, detect_possible)) continue;
             correspond(vs, vw);
-            spdlog::trace("vs, vw : {}, {}", vs, vw);
-            set<pair<int, int>> edge_set;
-            bool match_deg = true;
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.first, vw), make_pair(edge_subgraph.first, vs), edge_set);
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.second, vw), make_pair(edge_subgraph.second, vs), edge_set);
-            update_res(match_deg);
+            LOG_TRACE("vs, vw : {}, {}", vs, vw);
+            update_res(extend({
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.first, vw), root_step.first_edgeids[0]),
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.second, vw), root_step.second_edgeids[0])}, 2));
             swap(occupied, occupied_tmp);
             swap(located, located_tmp);
         }
-        return res;
+        if (res.empty()) STATS_COUNT(Counter::MatchNo, 1);
+        return;
     } 
     // subgraph の辺 e について diagonal な位置にある頂点が2点, wheelgraph は 1 点だったとき、
     // wheelgraph の diagonal な頂点を subgraph の 1 点のうちどちらを固定するかで 2 通り考える。
     // それぞれの場合で、追加で 2 本の辺を固定する。
     if (diagonal_vertices_subgraph.size() == 2 && diagonal_vertices_wheelgraph.size() == 1) {
         int vw = diagonal_vertices_wheelgraph[0];
-        auto located_tmp = located, occupied_tmp = occupied;
-        for (auto vs : diagonal_vertices_subgraph) {
+        located_tmp.assign(located.begin(), located.end());
+        occupied_tmp.assign(occupied.begin(), occupied.end());
+        for (int k = 0;k < 2; k++) {
+            int vs = diagonal_vertices_subgraph[k];
             if (!match_degree(vs, vw, detect_possible)) continue;
             correspond(vs, vw);
-            spdlog::trace("vs, vw : {}, {}", vs, vw);
-            set<pair<int, int>> edge_set;
-            bool match_deg = true;
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.first, vw), make_pair(edge_subgraph.first, vs), edge_set);
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.second, vw), make_pair(edge_subgraph.second, vs), edge_set);
-            update_res(match_deg);
+            LOG_TRACE("vs, vw : {}, {}", vs, vw);
+            update_res(extend({
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.first, vw), root_step.first_edgeids[k]),
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.second, vw), root_step.second_edgeids[k])}, 2));
             swap(occupied, occupied_tmp);
             swap(located, located_tmp);
         }
-        return res;
+        if (res.empty()) STATS_COUNT(Counter::MatchNo, 1);
+        return;
     } 
     // subgraph の辺 e について diagonal な位置にある頂点が 2 点, wheelgraph は 2 点だったとき、
     // subgraph の diagonal な頂点を wheelgraph の 2 点のうちどちらを固定するかで 2 通り考える。 (片方を決めるともう一方は自動的に対応が決まる。)
     // それぞれの場合で、追加で 4 本の辺を固定する。
     if (diagonal_vertices_subgraph.size() == 2 && diagonal_vertices_wheelgraph.size() == 2) {
-        auto located_tmp = located, occupied_tmp = occupied;
+        located_tmp.assign(located.begin(), located.end());
+        occupied_tmp.assign(occupied.begin(), occupied.end());
         for (int i = 0;i < 2; i++) {
             int vs0 = diagonal_vertices_subgraph[i];
             int vs1 = diagonal_vertices_subgraph[1 - i];
@@ -196,39 +246,31 @@ vector<ContainResult> BaseWheel::containSubgraphWithCorrespondingEdge(
             if (!match_degree(vs0, vw0, detect_possible) || !match_degree(vs1, vw1, detect_possible)) continue;
             correspond(vs0, vw0);
             correspond(vs1, vw1);
-            spdlog::trace("vs0, vw0 : {}, {}", vs0, vw0);
-            spdlog::trace("vs1, vw1 : {}, {}", vs1, vw1);
-            set<pair<int, int>> edge_set;
-            bool match_deg = true;
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.first, vw0), make_pair(edge_subgraph.first, vs0), edge_set);
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.second, vw0), make_pair(edge_subgraph.second, vs0), edge_set);
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.first, vw1), make_pair(edge_subgraph.first, vs1), edge_set);
-            match_deg = match_deg && set_edge_recursive(set_edge_recursive, make_pair(edge_wheelgraph.second, vw1), make_pair(edge_subgraph.second, vs1), edge_set);
-            update_res(match_deg);
+            LOG_TRACE("vs0, vw0 : {}, {}", vs0, vw0);
+            LOG_TRACE("vs1, vw1 : {}, {}", vs1, vw1);
+            update_res(extend({
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.first, vw0), root_step.first_edgeids[i]),
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.second, vw0), root_step.second_edgeids[i]),
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.first, vw1), root_step.first_edgeids[1 - i]),
+                make_pair(wheelgraph.edgeId(edge_wheelgraph.second, vw1), root_step.second_edgeids[1 - i])}, 4));
             swap(occupied, occupied_tmp);
             swap(located, located_tmp);
         }
-        return res;
+        if (res.empty()) STATS_COUNT(Counter::MatchNo, 1);
+        return;
     }
     // それ以外のケース (0, 0), (0, 1), (0, 2), (1, 0), (1, 1), (2, 0)
     // では1つ辺の対応を決めれば あとの対応は一意に決める。
-    if (diagonal_vertices_subgraph.size() <= 2 && diagonal_vertices_wheelgraph.size() <= 2) {
-        set<pair<int, int>> edge_set;
-        bool match_deg = set_edge_recursive(set_edge_recursive, edge_wheelgraph, edge_subgraph, edge_set);
-        update_res(match_deg);
-        return res;
-    }
-    assert(false);
+    update_res(extend({make_pair(edgeid_wheelgraph, edgeid_subgraph)}, 1));
+    return;
 }
 
 
 // wheelgraph の辺 edgeid_wheelgraph と subgraph の辺 edgeid_subgraph を向きまで含めて対応させた時に wheelgraph が含む subgraph の個数(n)を返す。(0 <= n <= 2)
-// ただし、except_vertices に入っている subgraph の頂点は含まれていなくて良い。
-int BaseWheel::numOfSubgraphWithCorrespondingEdge(
-    const NearTriangulation &wheelgraph, const NearTriangulation &subgraph, 
-    int edgeid_wheelgraph, int edgeid_subgraph, 
-    const set<int> &except_vertices) {
-    auto result_list = BaseWheel::containSubgraphWithCorrespondingEdge(wheelgraph, subgraph, edgeid_wheelgraph, edgeid_subgraph, except_vertices, false);
+// ただし、plan の except_vertices に入っている subgraph の頂点は含まれていなくて良い。
+int BaseWheel::numOfSubgraphWithCorrespondingEdge(const NearTriangulation &wheelgraph, const MatchPlan &plan, int edgeid_wheelgraph, int edgeid_subgraph) {
+    thread_local ContainResults result_list;
+    BaseWheel::containSubgraphWithCorrespondingEdge(wheelgraph, plan, edgeid_wheelgraph, edgeid_subgraph, false, result_list);
     return std::count_if(result_list.begin(), result_list.end(), [](const ContainResult &res) {
         return res.contain == Contain::Yes;
     });
@@ -236,13 +278,8 @@ int BaseWheel::numOfSubgraphWithCorrespondingEdge(
 
 // ring の頂点を除いて conf が　wheelgraph に含まれているか判定する。
 bool BaseWheel::containConf(const NearTriangulation &wheelgraph, const Configuration &conf) {
-    int edgeid_conf = conf.getInsideEdgeId();
-    set<int> ring_vertices;
-    if (conf.hasCutVertex()) {
-        for (int v = 0;v < conf.ringSize(); v++) ring_vertices.insert(v);
-    }
     for (int edgeid_wheelgraph = 0;edgeid_wheelgraph < (int)wheelgraph.edges().size(); edgeid_wheelgraph++) {
-        if (BaseWheel::numOfSubgraphWithCorrespondingEdge(wheelgraph, conf.nearTriangulation(), edgeid_wheelgraph, edgeid_conf, ring_vertices) > 0) {
+        if (BaseWheel::numOfSubgraphWithCorrespondingEdge(wheelgraph, conf.matchPlan(), edgeid_wheelgraph, conf.getInsideEdgeId()) > 0) {
             return true;
         }
     }
@@ -251,66 +288,89 @@ bool BaseWheel::containConf(const NearTriangulation &wheelgraph, const Configura
 
 // wheelgraph が　confs に含まれる conf を含んでいるかどうか。
 template <class WheelLike>
-bool BaseWheel::containOneofConfs(const WheelLike &wheelgraph, const vector<Configuration> &confs) {
-    spdlog::trace("wheellike graph to check : {}", wheelgraph.toString());
-    int conf_idx = 0;
-    for (const auto &conf : confs) {
-        spdlog::trace("conf_idx : {}", conf_idx++);
-        if (BaseWheel::containConf(wheelgraph.nearTriangulation(), conf)) return true;
-    }
-    return false;
+bool BaseWheel::containOneofConfs(const WheelLike &wheelgraph, const ConfIndex &confs) {
+    LOG_TRACE("wheellike graph to check : {}", wheelgraph.toString());
+    STATS_TIMER(Timer::ContainConfs);
+    STATS_COUNT(Counter::ConfChecks, 1);
+    return confs.containedIn(wheelgraph.nearTriangulation());
 }
 
-// hub のチャージに影響を与える rule (指定された次数が送ってくる場合のケース) に基づいて頂点の次数を探索し、 
-// 1. confs を含まない
-// 2. rule による charge の授与の結果 threhold より大きい charge が hub に送られる
-// ような WheelLike (CartWheel, SubCartWheel) を返す。
-// 次数の候補として、 5, 6, 7, ..., max_degree+ を採用する。(例えば、max_degree = 8 のとき 5, 6, 7, 8+)
+// changed_vertices の頂点の次数を変える前の wheelgraph が confs のどの conf も含んでいないとき、
+// wheelgraph が confs に含まれる conf を含んでいるかどうか。 changed_vertices の周りだけを調べる。
 template <class WheelLike>
-vector<WheelLike> BaseWheel::decideDegreeBySendCases(
-    const WheelLike &wheelgraph, const vector<Rule> &rules, const vector<Configuration> &confs,
-    int max_degree, int threshold, bool charge_bound) {
-    int hub = 0;
-    int hubdegree = wheelgraph.numNeighbor();
-    vector<WheelLike> res;
+bool BaseWheel::containOneofConfsAround(const WheelLike &wheelgraph, const vector<int> &changed_vertices, const ConfIndex &confs) {
+    LOG_TRACE("wheellike graph to check : {}", wheelgraph.toString());
+    STATS_TIMER(Timer::ContainConfs);
+    STATS_COUNT(Counter::ConfChecks, 1);
+    return confs.containedInAround(wheelgraph.nearTriangulation(), changed_vertices);
+}
 
-    const auto &edges = wheelgraph.nearTriangulation().edges();
-    vector<int> edgeids;
-    edgeids.reserve(2 * hubdegree);
-    // hub のチャージに影響を与える辺番号を列挙しておく。
-    // 1. neighbor -> hub の辺が hubdegree 本
-    for (int v = 1;v <= hubdegree; v++) {
-        auto edge_receive = std::make_pair(v, hub);
-        int edge_receive_id = std::find(edges.begin(), edges.end(), edge_receive) - edges.begin();
-        assert(edge_receive_id != (int)edges.size());
-        edgeids.push_back(edge_receive_id);
+// decideDegreeBySendCases の探索木の節点を展開する。
+// 節点は次数を決めている途中の wheel と、次に rule を適用する辺の番号 edgeids[edgeids_idx] と、それまでの辺に沿って hub に送られる charge で表す。
+template <class WheelLike>
+class SendCaseExpander {
+private:
+    const RuleIndex &rules_;
+    const ConfIndex &confs_;
+    int max_degree_;
+    int threshold_;
+    bool charge_bound_;
+    int hubdegree_;
+    vector<pair<int, int>> edges_;
+    vector<int> edgeids_;
+
+public:
+    SendCaseExpander(const WheelLike &wheelgraph, const RuleIndex &rules, const ConfIndex &confs, int max_degree, int threshold, bool charge_bound) :
+        rules_(rules), confs_(confs), max_degree_(max_degree), threshold_(threshold), charge_bound_(charge_bound),
+        hubdegree_(wheelgraph.numNeighbor()), edges_(wheelgraph.nearTriangulation().edges()) {
+        int hub = 0;
+        edgeids_.reserve(2 * hubdegree_);
+        // hub のチャージに影響を与える辺番号を列挙しておく。
+        // 1. neighbor -> hub の辺が hubdegree 本
+        for (int v = 1;v <= hubdegree_; v++) {
+            int edge_receive_id = wheelgraph.nearTriangulation().edgeId(v, hub);
+            assert(edge_receive_id != -1);
+            edgeids_.push_back(edge_receive_id);
+        }
+        // 2. hub -> neighbor の辺が hubdegree 本
+        for (int v = 1;v <= hubdegree_; v++) {
+            int edge_send_id = wheelgraph.nearTriangulation().edgeId(hub, v);
+            assert(edge_send_id != -1);
+            edgeids_.push_back(edge_send_id);
+        }
     }
-    // 2. hub -> neighbor の辺が hubdegree 本
-    for (int v = 1;v <= hubdegree; v++) {
-        auto edge_send = std::make_pair(hub, v);
-        int edge_send_id = std::find(edges.begin(), edges.end(), edge_send) - edges.begin();
-        assert(edge_send_id != (int)edges.size());
-        edgeids.push_back(edge_send_id);
+
+    int hubDegree(void) const {
+        return hubdegree_;
     }
 
-    // wheel の辺番号 edgeids[edgeids_idx] に対応する辺に沿って rule を適用することを考えたとき、
+    const vector<int> &edgeIds(void) const {
+        return edgeids_;
+    }
+
+    // wheel の辺番号 edgeids_[edgeids_idx] に対応する辺に沿って rule を適用することを考えたとき、
     // 新しく次数を決めて、その候補を vector に詰めて返す。
-    auto decide_degree_by_rules = [&](const WheelLike &wheel, int edgeids_idx) -> pair<vector<WheelLike>, vector<int>> {
+    pair<vector<WheelLike>, vector<int>> decideDegreeByRules(const WheelLike &wheel, int edgeids_idx) const {
+        STATS_TIMER(Timer::DecideDegreeByRules);
         const auto &wheel_degrees = wheel.nearTriangulation().degrees();
         vector<WheelLike> next_wheels = {wheel};
         vector<int> next_charges = {0};
-        int edgeid = edgeids[edgeids_idx];
+        ContainResults result_list;
+        int edgeid = edgeids_[edgeids_idx];
         // rule に従って次数を新しく決める。
-        for (const auto &rule : rules) {
-            auto result_list = BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.nearTriangulation(), edgeid, rule.sendEdgeId(), {}, true);
+        // 端点の次数から適用しうる rule だけを試す。
+        for (int rule_idx : rules_.applicableRules(wheel.nearTriangulation(), edgeid)) {
+            const auto &rule = rules_.rules()[rule_idx];
+            STATS_COUNT(Counter::AnchorTried, 1);
+            BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.matchPlan(), edgeid, rule.sendEdgeId(), true, result_list);
             const auto &rule_degrees = rule.nearTriangulation().degrees();
             for (const auto &result : result_list) {
                 if (result.contain == Contain::No) continue;
                 // result が No ではないとき、試してみた rule に従って次数を決める。
                 vector<WheelLike> wheels = {wheel};
                 for (int v = 0;v < wheel.nearTriangulation().vertexSize(); v++) {
-                    if (result.occupied[v] != -1 && !wheel_degrees[v].has_value()) {
-                        vector<Degree> degrees = divideDegree(rule_degrees[result.occupied[v]].value(), max_degree);
+                    if (result.occupied[v] != -1 && wheel_degrees[v].unset()) {
+                        DividedDegrees degrees = divideDegree(rule_degrees[result.occupied[v]], max_degree_);
                         for (WheelLike &w : wheels) {
                             w.setDegree(v, degrees[0]);
                         }
@@ -329,56 +389,65 @@ vector<WheelLike> BaseWheel::decideDegreeBySendCases(
             }
         }
         return std::make_pair(next_wheels, next_charges);
-    };
+    }
 
     // 探索する候補の cartwheel を unique にする。
     // もし unique な 2 つの cartwheel があるときは、送るチャージが大きい方を選ぶ。
-    auto unique = [&](const vector<WheelLike> &next_wheels, const vector<int> &next_charges) -> pair<vector<WheelLike>, vector<int>> {
+    // 標準形が一致するものだけ isIsomorphic で同型か確かめる。
+    pair<vector<WheelLike>, vector<int>> unique(const vector<WheelLike> &next_wheels, const vector<int> &next_charges) const {
+        STATS_TIMER(Timer::Unique);
         vector<WheelLike> unique_wheels;
         vector<int> unique_charges;
+        std::unordered_map<vector<int>, vector<int>, CanonicalCodeHash> unique_idxes_by_code;
         for (auto i = 0u;i < next_wheels.size(); i++) {
             // unique_wheels の中に同型なものが含まれていたら unique_wheels に追加しない。
+            auto &unique_idxes = unique_idxes_by_code[BaseWheel::canonicalCode(next_wheels[i])];
             bool add_wheel = true;
-            for (auto j = 0u;j < unique_wheels.size(); j++) {
+            for (int j : unique_idxes) {
                 if (BaseWheel::isIsomorphic(next_wheels[i], unique_wheels[j])) {
+                    STATS_COUNT(Counter::Duplicates, 1);
                     unique_charges[j] = std::max(next_charges[i], unique_charges[j]);
                     add_wheel = false;
                     break;
                 }
             }
             if (add_wheel) {
+                unique_idxes.push_back(unique_wheels.size());
                 unique_wheels.push_back(next_wheels[i]);
                 unique_charges.push_back(next_charges[i]);
             }
         }
         return std::make_pair(unique_wheels, unique_charges);
-    };
+    }
 
     // 探索を速くするために 
     // 1. 既に reducible configuration を含んでいる。
     // 2. charge_bound が true であり、かつ現時点で決まっている次数の情報から送られる charge の量が threshold 以下である。
     // のどちらかの条件を満たす cartwheel を既に探索しない。
-    auto prune = [&](const vector<WheelLike> &next_wheels, const vector<int> &next_charges, int edgeids_idx, const vector<int> &decided_charges) -> pair<vector<WheelLike>, vector<int>> {
+    // next_wheels は wheel から次数を決めたもので、 wheel は conf を含まないことがわかっているので、次数を決めた頂点の周りだけを調べる。
+    pair<vector<WheelLike>, vector<int>> prune(const WheelLike &wheel, const vector<WheelLike> &next_wheels, const vector<int> &next_charges, int edgeids_idx, const vector<int> &decided_charges) const {
+        STATS_TIMER(Timer::Prune);
         vector<WheelLike> pruned_wheels;
         vector<int> pruned_charges;
         for (int i = 0;i < (int)next_wheels.size(); i++) {
             const WheelLike &w = next_wheels[i];
-            if (charge_bound) {
+            if (charge_bound_) {
                 // この先の探索でどんな次数の組み合わせであったとしても charge が閾値を超えない時に探索をやめる。
                 int send_lower = 0, receive_upper = 0;
-                vector<int> expected_charge(edgeids.size(), 0);
+                vector<int> expected_charge(edgeids_.size(), 0);
                 bool stop_search = false;
-                for (int ei = 0;ei < (int)edgeids.size(); ei++) {
+                for (int ei = 0;ei < (int)edgeids_.size(); ei++) {
                     int max_send_l = 0;
                     int max_send_u = 0;
-                    for (const auto &rule : rules) {
-                        int s = edges[edgeids[ei]].first;
-                        int t = edges[edgeids[ei]].second;
-                        auto [send_l, send_u, send_related] = BaseWheel::amountChargeToSend(w, s, t, rule);
+                    for (int rule_idx : rules_.applicableRules(w.nearTriangulation(), edgeids_[ei])) {
+                        const auto &rule = rules_.rules()[rule_idx];
+                        int s = edges_[edgeids_[ei]].first;
+                        int t = edges_[edgeids_[ei]].second;
+                        auto [send_l, send_u] = BaseWheel::amountChargeToSend(w, s, t, rule);
                         max_send_l = std::max(max_send_l, send_l > 0 ? rule.amount() : 0); // rule が2回適用されるときでも、1回の適用しか考えない。2回の適用は別の rule で見ているのと max をとっているので大丈夫。
                         max_send_u = std::max(max_send_u, send_u > 0 ? rule.amount() : 0);
                     }
-                    if (ei < hubdegree) {
+                    if (ei < hubdegree_) {
                         // 1. neighbor -> hub
                         if (ei == edgeids_idx) {
                             if (max_send_l > next_charges[i]) {
@@ -403,113 +472,326 @@ vector<WheelLike> BaseWheel::decideDegreeBySendCases(
                         send_lower += expected_charge[ei];
                     }
                 }
-                if (stop_search) continue;
-                spdlog::trace("cartwheel : {}", w.toString());
-                spdlog::trace("expected_charges : {}", fmt::join(expected_charge, ", "));
+                if (stop_search) {
+                    STATS_COUNT(Counter::PruneOtherCase, 1);
+                    continue;
+                }
+                LOG_TRACE("cartwheel : {}", w.toString());
+                LOG_TRACE("expected_charges : {}", fmt::join(expected_charge, ", "));
                 int charge = receive_upper - send_lower;
-                if (charge <= threshold) continue;
+                if (charge <= threshold_) {
+                    STATS_COUNT(Counter::PruneChargeBound, 1);
+                    continue;
+                }
+            }
+            // conf を含んでいたらその時点で探索をやめる。
+            if (BaseWheel::containOneofConfsAround(w, w.nearTriangulation().changedVertices(wheel.nearTriangulation()), confs_)) {
+                STATS_COUNT(Counter::PruneConf, 1);
+                continue;
             }
-            if (BaseWheel::containOneofConfs(w, confs)) continue; // conf を含んでいたらその時点で探索をやめる。
             pruned_wheels.push_back(next_wheels[i]);
             pruned_charges.push_back(next_charges[i]);
         }
         return std::make_pair(pruned_wheels, pruned_charges);
-    };
-    
-    // decide_degree_by_rule, unique,  prune を順に適用することで、
-    // cartwheel の次数を決めていき、すべて次数を決めたら、配列 res に詰めて返す。
-    auto decide_degree = [&](auto &&decide_degree, const WheelLike &wheel, int edgeids_idx, vector<int> &decided_charges) -> void {
-        if (edgeids_idx == (int)edgeids.size()) {
-            res.push_back(wheel);
-            return;
-        }
-        spdlog::trace("cartwheel : {}", wheel.toString());
-        spdlog::trace("decided_charges : {}", fmt::join(decided_charges, ", "));
+    }
+
+    // decideDegreeByRules, unique,  prune を順に適用することで、 cartwheel の次数を決めていく。
+    // wheel から辺番号 edgeids_[edgeids_idx] の辺についての次数を決めた子の候補を返す。
+    pair<vector<WheelLike>, vector<int>> expand(const WheelLike &wheel, int edgeids_idx, const vector<int> &decided_charges) const {
+        LOG_TRACE("cartwheel : {}", wheel.toString());
+        LOG_TRACE("decided_charges : {}", fmt::join(decided_charges, ", "));
 
         // _wheels は cartwheel
-        // _charges は辺番号 edgeids[edgeids_idx] を持つ辺に従って送られる charge の量を表す。
-        auto [next_wheels, next_charges] = decide_degree_by_rules(wheel, edgeids_idx);
+        // _charges は辺番号 edgeids_[edgeids_idx] を持つ辺に従って送られる charge の量を表す。
+        auto [next_wheels, next_charges] = decideDegreeByRules(wheel, edgeids_idx);
         auto [unique_wheels, unique_charges] = unique(next_wheels, next_charges);
-        auto [pruned_wheels, pruned_charges] = prune(unique_wheels, unique_charges, edgeids_idx, decided_charges);
+        auto [pruned_wheels, pruned_charges] = prune(wheel, unique_wheels, unique_charges, edgeids_idx, decided_charges);
        
-        spdlog::trace("next_wheels.size : {}", pruned_wheels.size());
-        spdlog::trace("next_charges : {}", fmt::join(pruned_charges, ", "));
+        LOG_TRACE("next_wheels.size : {}", pruned_wheels.size());
+        LOG_TRACE("next_charges : {}", fmt::join(pruned_charges, ", "));
         assert(pruned_wheels.size() == pruned_charges.size());
+        return std::make_pair(pruned_wheels, pruned_charges);
+    }
+};
+
+// hub のチャージに影響を与える rule (指定された次数が送ってくる場合のケース) に基づいて頂点の次数を探索し、 
+// 1. confs を含まない
+// 2. rule による charge の授与の結果 threhold より大きい charge が hub に送られる
+// ような WheelLike (CartWheel, SubCartWheel) を返す。
+// 次数の候補として、 5, 6, 7, ..., max_degree+ を採用する。(例えば、max_degree = 8 のとき 5, 6, 7, 8+)
+// num_threads > 1 のときは num_threads 個のスレッドで探索する。結果は 1 スレッドのときと同じ順番で返す。
+// checkpointer が有効なときは、探索の途中経過を checkpoint_name という名前で定期的に保存し、終わったら結果を保存する。
+// (resume のときは保存したところから再開する。)
+template <class WheelLike>
+vector<WheelLike> BaseWheel::decideDegreeBySendCases(
+    const WheelLike &wheelgraph, const RuleIndex &rules, const ConfIndex &confs,
+    int max_degree, int threshold, bool charge_bound, int num_threads,
+    const Checkpointer &checkpointer, const string &checkpoint_name) {
+    SendCaseExpander<WheelLike> expander(wheelgraph, rules, confs, max_degree, threshold, charge_bound);
+    int hubdegree = expander.hubDegree();
+    const auto &edgeids = expander.edgeIds();
+    vector<WheelLike> res;
+
+    // 探索木の節点
+    // path は根からの子の番号の列で、葉を path の辞書順に並べると 1 スレッドで深さ優先に探索したときの res の順番になる。
+    class SearchTask {
+    public:
+        WheelLike wheel;
+        int edgeids_idx;
+        vector<int> decided_charges;
+        vector<int> path;
+    };
+    // task の子を path の順に children に追加する。
+    auto expand_task = [&](const SearchTask &task, vector<SearchTask> &children) -> void {
+        auto [pruned_wheels, pruned_charges] = expander.expand(task.wheel, task.edgeids_idx, task.decided_charges);
         for (int i = 0;i < (int)pruned_wheels.size(); i++) {
-            if (edgeids_idx < hubdegree) decided_charges.push_back(pruned_charges[i]);
-            decide_degree(decide_degree, pruned_wheels[i], edgeids_idx + 1, decided_charges);
-            if (edgeids_idx < hubdegree) decided_charges.pop_back();
+            SearchTask child{std::move(pruned_wheels[i]), task.edgeids_idx + 1, task.decided_charges, task.path};
+            if (task.edgeids_idx < hubdegree) child.decided_charges.push_back(pruned_charges[i]);
+            child.path.push_back(i);
+            children.push_back(std::move(child));
         }
         return;
     };
-    vector<int> decided_charges;
-    decided_charges.reserve(hubdegree);
-    decide_degree(decide_degree, wheelgraph, 0, decided_charges); 
+
+    // checkpointer に途中経過を保存するときは、節点を次数だけで表す。 (探索中のグラフは wheelgraph と次数だけが違う。)
+    string fingerprint = fmt::format("decideDegreeBySendCases {} max_degree {} threshold {} charge_bound {} rules {} {:016x} confs {} {:016x}",
+        wheelgraph.toString(), max_degree, threshold, charge_bound, rules.rules().size(), rules.fingerprint(), confs.numConfs(), confs.fingerprint());
+    auto to_checkpoint_task = [&](const WheelLike &wheel, int edgeids_idx, const vector<int> &decided_charges, const vector<int> &path) -> CheckpointTask {
+        return CheckpointTask{wheel.nearTriangulation().degrees(), edgeids_idx, decided_charges, path};
+    };
+    auto from_checkpoint_task = [&](const CheckpointTask &task) -> SearchTask {
+        WheelLike wheel = wheelgraph;
+        for (int v = 0;v < (int)task.degrees.size(); v++) wheel.setDegree(v, task.degrees[v]);
+        return SearchTask{std::move(wheel), task.depth, task.charges, task.path};
+    };
+
+    // 結果 (path, 次数を決めた wheel) とまだ探索していない節点
+    vector<pair<vector<int>, WheelLike>> found;
+    vector<SearchTask> initial_tasks;
+    auto checkpoint = checkpointer.load(checkpoint_name, fingerprint);
+    if (checkpoint.has_value()) {
+        for (const auto &task : checkpoint.value().results) {
+            auto search_task = from_checkpoint_task(task);
+            found.emplace_back(std::move(search_task.path), std::move(search_task.wheel));
+        }
+        for (const auto &task : checkpoint.value().frontier) initial_tasks.push_back(from_checkpoint_task(task));
+    } else {
+        // prune では親が conf を含まないことを使うので、最初に wheelgraph を調べておく。
+        // (次数を決めても conf を含んだままなので、 wheelgraph が conf を含むときは候補はない。)
+        if (!BaseWheel::containOneofConfs(wheelgraph, confs)) initial_tasks.push_back(SearchTask{wheelgraph, 0, {}, {}});
+    }
+    auto save_checkpoint = [&](const vector<SearchTask> &pending_tasks, const vector<vector<pair<vector<int>, WheelLike>>> &results) -> void {
+        SearchCheckpoint checkpoint;
+        for (const auto &task : pending_tasks) checkpoint.frontier.push_back(to_checkpoint_task(task.wheel, task.edgeids_idx, task.decided_charges, task.path));
+        for (const auto &worker_results : results) {
+            for (const auto &[path, wheel] : worker_results) checkpoint.results.push_back(to_checkpoint_task(wheel, (int)edgeids.size(), {}, path));
+        }
+        checkpointer.save(checkpoint_name, fingerprint, checkpoint);
+        return;
+    };
+    auto interval = checkpointer.enabled() ? std::chrono::steady_clock::duration(checkpointer.interval()) : std::chrono::steady_clock::duration::max();
+
+    if (checkpoint.has_value() && checkpoint.value().done) {
+        // 探索は終わっている。
+    } else if (num_threads <= 1) {
+        // 深さ優先に探索する。 stack の末尾の節点から探索するので、子は逆順に積む。
+        vector<SearchTask> stack;
+        // 取り出す順番 (path の昇順) と逆順に積む。
+        std::sort(initial_tasks.begin(), initial_tasks.end(), [](const SearchTask &task0, const SearchTask &task1) {
+            return task0.path > task1.path;
+        });
+        stack = std::move(initial_tasks);
+        vector<vector<pair<vector<int>, WheelLike>>> results(1);
+        vector<SearchTask> children;
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        while (!stack.empty()) {
+            if (std::chrono::steady_clock::now() - last_checkpoint >= interval) {
+                auto all_results = results;
+                all_results.push_back(found);
+                save_checkpoint(stack, all_results);
+                last_checkpoint = std::chrono::steady_clock::now();
+            }
+            SearchTask task = std::move(stack.back());
+            stack.pop_back();
+            if (task.edgeids_idx == (int)edgeids.size()) {
+                results[0].emplace_back(std::move(task.path), std::move(task.wheel));
+                continue;
+            }
+            children.clear();
+            expand_task(task, children);
+            for (int i = (int)children.size() - 1;i >= 0; i--) stack.push_back(std::move(children[i]));
+        }
+        std::move(results[0].begin(), results[0].end(), std::back_inserter(found));
+    } else {
+        // num_threads 個のスレッドで探索木の節点をタスクとして work stealing で探索する。
+        // スレッドごとに結果と探索の統計を持ち、最後にまとめる。
+        vector<vector<pair<vector<int>, WheelLike>>> results(num_threads);
+        vector<SearchStats> stats(num_threads);
+        workStealing(std::move(initial_tasks), num_threads, [&](SearchTask &&task, int worker, auto &&spawn) {
+            if (task.edgeids_idx == (int)edgeids.size()) {
+                results[worker].emplace_back(std::move(task.path), std::move(task.wheel));
+                return;
+            }
+            SearchStats stats_before = searchStats();
+            vector<SearchTask> children;
+            expand_task(task, children);
+            stats[worker] += searchStats() - stats_before;
+            // 後に追加したタスクから取り出されるので、逆順に追加して 1 スレッドのときと同じ順に探索する。
+            for (int i = (int)children.size() - 1;i >= 0; i--) spawn(std::move(children[i]));
+        }, interval, [&](const vector<SearchTask> &pending_tasks) {
+            auto all_results = results;
+            all_results.push_back(found);
+            save_checkpoint(pending_tasks, all_results);
+        });
+        for (int worker = 0;worker < num_threads; worker++) {
+            std::move(results[worker].begin(), results[worker].end(), std::back_inserter(found));
+            searchStats() += stats[worker];
+        }
+    }
+    // 再開したときやスレッドで分担したときは結果が path の順に並んでいないので並べ直す。
+    if (!std::is_sorted(found.begin(), found.end(), [](const auto &result0, const auto &result1) { return result0.first < result1.first; })) {
+        std::sort(found.begin(), found.end(), [](const auto &result0, const auto &result1) {
+            return result0.first < result1.first;
+        });
+    }
+    if (checkpointer.enabled() && !(checkpoint.has_value() && checkpoint.value().done)) {
+        vector<CheckpointTask> results;
+        for (const auto &[path, wheel] : found) results.push_back(to_checkpoint_task(wheel, (int)edgeids.size(), {}, path));
+        checkpointer.finish(checkpoint_name, fingerprint, results);
+    }
+    res.reserve(found.size());
+    for (auto &[path, wheel] : found) res.push_back(std::move(wheel));
     return res;
 }
 
+// decideDegreeBySendCases と同じ探索木を、根から各節点で子を一様に 1 つ選んで葉 (または子のない節点) までたどる。
+// 何度かたどった結果の平均で、探索する節点の数や結果の数を見積もる。
+template <class WheelLike>
+SearchProbe<WheelLike> BaseWheel::probeDecideDegreeBySendCases(
+    const WheelLike &wheelgraph, const RuleIndex &rules, const ConfIndex &confs,
+    int max_degree, int threshold, bool charge_bound, std::mt19937_64 &rng) {
+    SearchProbe<WheelLike> probe;
+    if (BaseWheel::containOneofConfs(wheelgraph, confs)) return probe;
+    SendCaseExpander<WheelLike> expander(wheelgraph, rules, confs, max_degree, threshold, charge_bound);
+    WheelLike wheel = wheelgraph;
+    int edgeids_idx = 0;
+    vector<int> decided_charges;
+    double weight = 1;
+    probe.nodes = 1;
+    while (edgeids_idx < (int)expander.edgeIds().size()) {
+        auto [next_wheels, next_charges] = expander.expand(wheel, edgeids_idx, decided_charges);
+        probe.expanded++;
+        if (next_wheels.empty()) return probe;
+        weight *= next_wheels.size();
+        probe.nodes += weight;
+        int i = std::uniform_int_distribution<int>(0, (int)next_wheels.size() - 1)(rng);
+        if (edgeids_idx < expander.hubDegree()) decided_charges.push_back(next_charges[i]);
+        wheel = std::move(next_wheels[i]);
+        edgeids_idx++;
+    }
+    probe.weight = weight;
+    probe.leaf = std::move(wheel);
+    return probe;
+}
+
 // 頂点番号 index 以上の頂点の　degree を possible_degrees の中から選んで決めた wheelgraph のうち、 
 // confs に含まれる　conf を含まない　wheelgraph の集合を返す。
 template <class WheelLike>
 vector<WheelLike> BaseWheel::searchNoConfGraphs(
     const WheelLike &wheelgraph, int index, const vector<Degree> &possible_degrees, 
-    const vector<Configuration> &confs) {
+    const ConfIndex &confs) {
     vector<WheelLike> wheelgraphs;
     auto base_wheelgraph = wheelgraph;
     if (BaseWheel::containOneofConfs(base_wheelgraph, confs)) return {};
     int vertex_size = base_wheelgraph.nearTriangulation().vertexSize();
     
     // 次数を決めて、 conf を含まない cartwheel を探索する。
-    auto set_degree_recursive = [&](auto &&set_degree_recursive, int v, WheelLike &temp_wheelgraph) -> void {
+    // checked_index: 頂点番号 checked_index 未満の頂点の次数を決めた時点で conf を含まないことを確かめた。
+    // conf を含むか確かめるときは、それ以降に次数を決めた頂点の周りだけを調べる。
+    vector<int> changed_vertices;
+    auto contain_conf_since = [&](const WheelLike &temp_wheelgraph, int checked_index, int v) -> bool {
+        changed_vertices.clear();
+        for (int u = checked_index;u < v; u++) changed_vertices.push_back(u);
+        return BaseWheel::containOneofConfsAround(temp_wheelgraph, changed_vertices, confs);
+    };
+    auto set_degree_recursive = [&](auto &&set_degree_recursive, int v, int checked_index, WheelLike &temp_wheelgraph) -> void {
         if (v % 5 == 0) {
             // 5つ次数を決めるごとに conf を含んでいるか確認
-            if (BaseWheel::containOneofConfs(temp_wheelgraph, confs)) return;
+            if (contain_conf_since(temp_wheelgraph, checked_index, v)) return;
+            checked_index = v;
         }
         if (v == vertex_size) {
-            if (!BaseWheel::containOneofConfs(temp_wheelgraph, confs)) {
+            if (!contain_conf_since(temp_wheelgraph, checked_index, v)) {
                 wheelgraphs.push_back(temp_wheelgraph);
             }
             return;
         }
         for (const auto &degree : possible_degrees) {
             temp_wheelgraph.setDegree(v, degree);
-            set_degree_recursive(set_degree_recursive, v + 1, temp_wheelgraph);
+            set_degree_recursive(set_degree_recursive, v + 1, checked_index, temp_wheelgraph);
         }
-        temp_wheelgraph.setDegree(v, std::nullopt);
+        temp_wheelgraph.setDegree(v, Degree());
         return;
     };
-    set_degree_recursive(set_degree_recursive, index, base_wheelgraph);
+    set_degree_recursive(set_degree_recursive, index, index, base_wheelgraph);
     return wheelgraphs;
 }
 
 // wheel1 と wheel2 が同型かどうか判定する。
 template <class WheelLike>
 bool BaseWheel::isIsomorphic(const WheelLike &wheel1, const WheelLike &wheel2) {
+    STATS_COUNT(Counter::IsomorphismTests, 1);
+    // wheel1, wheel2 をそれぞれ subgraph として照合する手順 (スレッドごとに領域を使い回す。)
+    thread_local MatchPlan plan1, plan2;
+    plan1.build(wheel1.nearTriangulation());
+    plan2.build(wheel2.nearTriangulation());
     for (int ei = 0;ei < (int)wheel2.nearTriangulation().edges().size(); ei++) {
-        if (BaseWheel::numOfSubgraphWithCorrespondingEdge(wheel1.nearTriangulation(), wheel2.nearTriangulation(), 0, ei) > 0
-         && BaseWheel::numOfSubgraphWithCorrespondingEdge(wheel2.nearTriangulation(), wheel1.nearTriangulation(), ei, 0) > 0) {
+        if (BaseWheel::numOfSubgraphWithCorrespondingEdge(wheel1.nearTriangulation(), plan2, 0, ei) > 0
+         && BaseWheel::numOfSubgraphWithCorrespondingEdge(wheel2.nearTriangulation(), plan1, ei, 0) > 0) {
             return true;
         }
     }
     return false;
 }
 
+// hub を根とした wheel の標準形を返す。
+// hub から neighbor への辺をそれぞれ根として NearTriangulation::canonicalCode を計算する。
+// isIsomorphic で同型な wheel は hub が hub に対応するので、標準形が一致する。
+template <class WheelLike>
+vector<int> BaseWheel::canonicalCode(const WheelLike &wheel) {
+    STATS_COUNT(Counter::CanonicalCodes, 1);
+    int hub = 0;
+    vector<int> root_edgeids;
+    root_edgeids.reserve(wheel.numNeighbor());
+    for (int v = 1;v <= wheel.numNeighbor(); v++) {
+        int edgeid = wheel.nearTriangulation().edgeId(hub, v);
+        assert(edgeid != -1);
+        root_edgeids.push_back(edgeid);
+    }
+    return wheel.nearTriangulation().canonicalCode(root_edgeids);
+}
+
+// wheels から同型なものを取り除く。最初に現れたものを残す。
+// 標準形が一致するものだけ isIsomorphic で同型か確かめる。
 template <class WheelLike>
 void BaseWheel::makeUnique(vector<WheelLike> &wheels) {
+    STATS_TIMER(Timer::MakeUnique);
     vector<WheelLike> unique_wheels;
-    vector<int> unique_wheel_idxes;
+    std::unordered_map<vector<int>, vector<int>, CanonicalCodeHash> unique_idxes_by_code;
     for (auto i = 0u;i < wheels.size(); i++) {
         // unique_subwheels の中に　subwheel と同型なものが含まれていたら subwheel は unique_subwheels に追加しない。
+        auto &unique_idxes = unique_idxes_by_code[BaseWheel::canonicalCode(wheels[i])];
         bool add_wheel = true;
-        for (auto j = 0u;j < unique_wheels.size(); j++) {
+        for (int j : unique_idxes) {
             if (BaseWheel::isIsomorphic(wheels[i], unique_wheels[j])) {
+                STATS_COUNT(Counter::Duplicates, 1);
                 add_wheel = false;
                 break;
             }
         }
         if (add_wheel) {
+            unique_idxes.push_back(unique_wheels.size());
             unique_wheels.push_back(wheels[i]);
-            unique_wheel_idxes.push_back(i);
         }
     }
     wheels = unique_wheels;
@@ -518,11 +800,11 @@ void BaseWheel::makeUnique(vector<WheelLike> &wheels) {
 
 // (i) wheel の頂点 from から to へ rule を適用した時にどれだけ charge が流れるかの下限
 // (ii) wheel の頂点 from から to へ rule を適用した時にどれだけ charge が流れるかの上限
-// (iii) wheel の頂点でルールを送るのに関係しているかどうかを表す bool 配列。
 // を返す。
+// is_related が nullptr でないときは、ルールを送るのに関係している wheel の頂点 v について (*is_related)[v] を true にする。
 template <class WheelLike>
-tuple<int, int, vector<bool>> BaseWheel::amountChargeToSend(const WheelLike &wheel, int from, int to, const Rule &rule) {
-    auto is_symmetric = [](const vector<ContainResult> &result_list) {
+pair<int, int> BaseWheel::amountChargeToSend(const WheelLike &wheel, int from, int to, const Rule &rule, vector<bool> *is_related) {
+    auto is_symmetric = [](const ContainResults &result_list) {
         // No のときはsymmetricであることを検出する必要はないことと
         // symmetric であるとき結果は一致していることから、片方でも No なら false を返す。
         if (result_list.size() == 2 && result_list[0].contain != Contain::No && result_list[1].contain != Contain::No) {
@@ -540,13 +822,17 @@ tuple<int, int, vector<bool>> BaseWheel::amountChargeToSend(const WheelLike &whe
             return false;
         }
     };
-    auto edge = std::make_pair(from, to);
-    const auto &edges = wheel.nearTriangulation().edges();
-    int edgeid = std::find(edges.begin(), edges.end(), edge) - edges.begin();
-    assert(edgeid != (int)edges.size());
-    auto result_list = BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.nearTriangulation(), edgeid, rule.sendEdgeId(), {}, true);
+    int edgeid = wheel.nearTriangulation().edgeId(from, to);
+    assert(edgeid != -1);
+    if (!wheel.nearTriangulation().edgeInDegreeClasses(edgeid, rule.sendDegreeClasses())) {
+        // 端点の次数が適合しないので照合しなくても結果は 0 になる。
+        STATS_COUNT(Counter::AnchorSkipped, 1);
+        return make_pair(0, 0);
+    }
+    STATS_COUNT(Counter::AnchorTried, 1);
+    thread_local ContainResults result_list;
+    BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.matchPlan(), edgeid, rule.sendEdgeId(), true, result_list);
     int lower = 0, upper = 0;
-    vector<bool> is_related(wheel.nearTriangulation().vertexSize(), false);
     assert(result_list.size() <= 2);
     if (is_symmetric(result_list)) {
         result_list.pop_back();
@@ -555,36 +841,46 @@ tuple<int, int, vector<bool>> BaseWheel::amountChargeToSend(const WheelLike &whe
         if (res.contain == Contain::Yes) {
             lower ++;
             upper ++;
+            if (is_related == nullptr) continue;
             for (int v = 0;v < wheel.nearTriangulation().vertexSize(); v++) {
-                is_related[v] = is_related[v] || (res.occupied[v] != -1);
+                if (res.occupied[v] != -1) (*is_related)[v] = true;
             }
         } else if (res.contain == Contain::Possible) {
             upper++;
         }
     }
-    return make_tuple(lower * rule.amount(), upper * rule.amount(), is_related);
+    return make_pair(lower * rule.amount(), upper * rule.amount());
 }
 
 // WheelLike には Wheel, CartWheel, SubWheel, SubCartWheel などの型を代入しうる
 template bool BaseWheel::containOneofConfs<Wheel>(
-    const Wheel &wheelgraph, const vector<Configuration> &confs);
+    const Wheel &wheelgraph, const ConfIndex &confs);
 template bool BaseWheel::containOneofConfs<CartWheel>(
-    const CartWheel &wheelgraph, const vector<Configuration> &confs);
+    const CartWheel &wheelgraph, const ConfIndex &confs);
+
+template bool BaseWheel::containOneofConfsAround<Wheel>(
+    const Wheel &wheelgraph, const vector<int> &changed_vertices, const ConfIndex &confs);
+template bool BaseWheel::containOneofConfsAround<CartWheel>(
+    const CartWheel &wheelgraph, const vector<int> &changed_vertices, const ConfIndex &confs);
 
 template vector<Wheel> BaseWheel::searchNoConfGraphs<Wheel>(
     const Wheel &wheelgraph, int index, const vector<Degree> &possible_degrees, 
-    const vector<Configuration> &confs);
+    const ConfIndex &confs);
 template vector<CartWheel> BaseWheel::searchNoConfGraphs<CartWheel>(
     const CartWheel &wheelgraph, int index, const vector<Degree> &possible_degrees, 
-    const vector<Configuration> &confs);
+    const ConfIndex &confs);
 
 template bool BaseWheel::isIsomorphic(const Wheel &wheel1, const Wheel &wheel2);
 template bool BaseWheel::isIsomorphic(const CartWheel &wheel1, const CartWheel &wheel2);
 
+template vector<int> BaseWheel::canonicalCode(const Wheel &wheel);
+template vector<int> BaseWheel::canonicalCode(const CartWheel &wheel);
+
 template void BaseWheel::makeUnique(vector<Wheel> &wheels);
 template void BaseWheel::makeUnique(vector<CartWheel> &wheels);
 
-template tuple<int, int, vector<bool>> BaseWheel::amountChargeToSend(const Wheel &wheel, int from, int to, const Rule &rule);
-template tuple<int, int, vector<bool>> BaseWheel::amountChargeToSend(const CartWheel &wheel, int from, int to, const Rule &rule);
+template pair<int, int> BaseWheel::amountChargeToSend(const Wheel &wheel, int from, int to, const Rule &rule, vector<bool> *is_related);
+template pair<int, int> BaseWheel::amountChargeToSend(const CartWheel &wheel, int from, int to, const Rule &rule, vector<bool> *is_related);
 
-template vector<CartWheel> BaseWheel::decideDegreeBySendCases(const CartWheel &wheel, const vector<Rule> &rules, const vector<Configuration> &confs, int max_degree, int threshold, bool charge_bound);
+template vector<CartWheel> BaseWheel::decideDegreeBySendCases(const CartWheel &wheel, const RuleIndex &rules, const ConfIndex &confs, int max_degree, int threshold, bool charge_bound, int num_threads, const Checkpointer &checkpointer, const string &checkpoint_name);
+template SearchProbe<CartWheel> BaseWheel::probeDecideDegreeBySendCases(const CartWheel &wheel, const RuleIndex &rules, const ConfIndex &confs, int max_degree, int threshold, bool charge_bound, std::mt19937_64 &rng);
@@ -1,10 +1,19 @@
 #pragma once
 #include <vector>
+#include <array>
+#include <cassert>
 #include <set>
+#include <unordered_map>
+#include <random>
+#include <optional>
 #include "configuration.hpp"
+#include "conf_index.hpp"
 #include "near_triangulation.hpp"
 #include "cartwheel.hpp"
 #include "rule.hpp"
+#include "match_plan.hpp"
+#include "checkpoint.hpp"
+#include "search_stats.hpp"
 using std::vector;
 
 enum class Contain {
@@ -22,38 +31,83 @@ public:
     // contain が Yes や Possible だったときに、
     // occupied[v] := v (v は含む側の頂点の番号) に対応する頂点番号 w　(w は含まれる側の頂点の番号)
     vector<int> occupied;
+    ContainResult(void) : contain(Contain::No) {};
     ContainResult(Contain contain, const vector<int> &occupied = vector<int>()): contain(contain), occupied(occupied) {};
 };
 
+// containSubgraphWithCorrespondingEdge の結果 (高々 2 個) を入れる領域
+// 呼び出し側が持って使い回せば occupied の領域も使い回すので、結果を入れるときにメモリを確保しない。
+class ContainResults {
+private:
+    std::array<ContainResult, 2> results_;
+    int size_ = 0;
+
+public:
+    void clear(void) { size_ = 0; }
+    void push_back(Contain contain, const vector<int> &occupied) {
+        assert(size_ < 2);
+        results_[size_].contain = contain;
+        if (contain == Contain::No) results_[size_].occupied.clear();
+        else results_[size_].occupied.assign(occupied.begin(), occupied.end());
+        size_++;
+    }
+    void pop_back(void) { size_--; }
+    int size(void) const { return size_; }
+    bool empty(void) const { return size_ == 0; }
+    const ContainResult &operator[](int i) const { return results_[i]; }
+    const ContainResult *begin(void) const { return results_.data(); }
+    const ContainResult *end(void) const { return results_.data() + size_; }
+};
+
+// decideDegreeBySendCases の探索木を根から 1 本の道に沿ってたどった結果 (BaseWheel::probeDecideDegreeBySendCases)
+// 各節点で子を一様に選ぶとき、深さ d の節点の子の数の積は深さ d + 1 の節点の数の不偏な推定量になる (Knuth の推定量)。
+template <class WheelLike>
+class SearchProbe {
+public:
+    // 探索木の節点の数の推定値 (深さごとの子の数の積の和)
+    double nodes = 0;
+    // 葉に着いたときの、葉までの子の数の積 (探索の結果の数の推定値)。葉に着かなかったときは 0
+    double weight = 0;
+    // たどる途中で子を求めた節点の数
+    int expanded = 0;
+    // 着いた葉 (探索の結果の 1 つ)
+    std::optional<WheelLike> leaf;
+};
+
 // Wheel グラフ全般に共通して使う関数
 class BaseWheel {
 public:
-    static vector<ContainResult> containSubgraphWithCorrespondingEdge(
-        const NearTriangulation &wheelgraph, const NearTriangulation &subgraph, 
-        int edgeid_wheelgraph, int edgeid_subgraph, 
-        const set<int> &except_vertices, bool detect_possible);
+    static void containSubgraphWithCorrespondingEdge(
+        const NearTriangulation &wheelgraph, const MatchPlan &plan, 
+        int edgeid_wheelgraph, int edgeid_subgraph, bool detect_possible, ContainResults &results);
 
-    static int numOfSubgraphWithCorrespondingEdge(
-        const NearTriangulation &wheelgraph, const NearTriangulation &subgraph,
-        int edgeid_wheelgraph, int edgeid_subgraph, 
-        const set<int> &except_vertices = set<int>());
+    static int numOfSubgraphWithCorrespondingEdge(const NearTriangulation &wheelgraph, const MatchPlan &plan, int edgeid_wheelgraph, int edgeid_subgraph);
 
     static bool containConf(const NearTriangulation &wheelgraph, const Configuration &conf);
 
     template <class WheelLike>
-    static bool containOneofConfs(const WheelLike &wheelgraph, const vector<Configuration> &confs);
+    static bool containOneofConfs(const WheelLike &wheelgraph, const ConfIndex &confs);
+
+    template <class WheelLike>
+    static bool containOneofConfsAround(const WheelLike &wheelgraph, const vector<int> &changed_vertices, const ConfIndex &confs);
 
     template <class WheelLike>
     static vector<WheelLike> decideDegreeBySendCases(
-        const WheelLike &wheelgraph, const vector<Rule> &rules, const vector<Configuration> &confs, int max_degree, int threshold, bool charge_bound = false);
+        const WheelLike &wheelgraph, const RuleIndex &rules, const ConfIndex &confs, int max_degree, int threshold, bool charge_bound = false, int num_threads = 1,
+        const Checkpointer &checkpointer = Checkpointer(), const string &checkpoint_name = "");
+
+    template <class WheelLike>
+    static SearchProbe<WheelLike> probeDecideDegreeBySendCases(
+        const WheelLike &wheelgraph, const RuleIndex &rules, const ConfIndex &confs, int max_degree, int threshold, bool charge_bound, std::mt19937_64 &rng);
 
     template <class WheelLike>
     static vector<WheelLike> searchNoConfGraphs(
-        const WheelLike &wheelgraph, int index, const vector<Degree> &possible_degrees, const vector<Configuration> &confs);
+        const WheelLike &wheelgraph, int index, const vector<Degree> &possible_degrees, const ConfIndex &confs);
 
     template <class WheelLike> static bool isIsomorphic(const WheelLike &wheel1, const WheelLike &wheel2);
+    template <class WheelLike> static vector<int> canonicalCode(const WheelLike &wheel);
     template <class WheelLike> static void makeUnique(vector<WheelLike> &wheels);
-    
+
     template <class WheelLike>
-    static tuple<int, int, vector<bool>> amountChargeToSend(const WheelLike &wheel, int from, int to, const Rule &rule);
+    static pair<int, int> amountChargeToSend(const WheelLike &wheel, int from, int to, const Rule &rule, vector<bool> *is_related = nullptr);
 };
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <boost/program_options.hpp>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include "cartwheel.hpp"
+#include "basewheel.hpp"
+#include "corpus.hpp"
+#include "log.hpp"
+#include "allocation_counter.hpp"
+
+namespace fs = std::filesystem;
+using std::string;
+using std::vector;
+
+// 探索で何度も呼ぶ処理 (kernel) の 1 回あたりの時間と allocation の回数を測る。
+// fixture は wheel のディレクトリから選んだ wheel と send cases, confs から作る。
+
+// fixture の wheel を選ぶときの乱数の種 (同じ種なら同じ fixture になる。)
+const uint64_t BENCH_SEED = 0;
+
+// 測る処理
+// pass は fixture 全体に対して処理を 1 回ずつ (ops 回) 行い、結果を最適化で消されないように足し合わせて返す。
+class Kernel {
+public:
+    string name;
+    int64_t ops;
+    std::function<int64_t(void)> pass;
+};
+
+// 測った結果
+class KernelResult {
+public:
+    string name;
+    int64_t ops;
+    double best_ns_per_op;
+    double median_ns_per_op;
+    double allocs_per_op;
+};
+
+// 1 回 pass を実行して allocation の回数を数えてから、
+// min_time_ms 以上になるまで pass を繰り返して 1 回あたりの時間を測ることを repeat 回行い、最も速いものと中央値を返す。
+// kernel.ops は正でなければならない。
+static KernelResult runKernel(const Kernel &kernel, int min_time_ms, int repeat) {
+    int64_t sink = 0;
+    int64_t allocations_before = numAllocations();
+    sink += kernel.pass();
+    int64_t allocations = numAllocations() - allocations_before;
+
+    vector<double> ns_per_op;
+    for (int r = 0;r < repeat; r++) {
+        int64_t passes = 0;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration elapsed;
+        do {
+            sink += kernel.pass();
+            passes++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < std::chrono::milliseconds(min_time_ms));
+        ns_per_op.push_back((double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (passes * kernel.ops));
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    LOG_DEBUG("{} : checksum {}", kernel.name, sink);
+    return KernelResult{kernel.name, kernel.ops, ns_per_op.front(), ns_per_op[ns_per_op.size() / 2], (double)allocations / kernel.ops};
+}
+
+// wheel_dirname の wheel ファイルを名前の順に並べ、 num_samples 個を乱数で選ぶ。
+static vector<Wheel> sampleWheels(const string &wheel_dirname, int num_samples) {
+    vector<string> filenames;
+    for (const auto &entry : fs::directory_iterator(wheel_dirname)) {
+        if (entry.path().extension() == ".wheel") filenames.push_back(entry.path().string());
+    }
+    if (filenames.empty()) {
+        spdlog::critical("There is no wheel file in {}", wheel_dirname);
+        throw std::runtime_error("There is no wheel file in " + wheel_dirname);
+    }
+    std::sort(filenames.begin(), filenames.end());
+    std::mt19937_64 rng(BENCH_SEED);
+    std::shuffle(filenames.begin(), filenames.end(), rng);
+    filenames.resize(std::min<int>(num_samples, filenames.size()));
+    std::sort(filenames.begin(), filenames.end());
+    vector<Wheel> wheels;
+    for (const auto &filename : filenames) {
+        LOG_DEBUG("sampled {}", filename);
+        wheels.push_back(Wheel::readWheelFile(filename));
+    }
+    return wheels;
+}
+
+// second-neighbor まで次数を決めた cartwheel の、次数の定まっていない頂点の次数を max_degree+ にする。
+static void fillDegrees(CartWheel &cartwheel, int max_degree) {
+    const auto &degrees = cartwheel.nearTriangulation().degrees();
+    for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
+        if (degrees[v].unset()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
+    }
+    return;
+}
+
+// 各 kernel の fixture
+// bases は wheel から作った cartwheel (second-neighbor の次数は定まっていない)、
+// leaves は bases から decideDegreeBySendCases の探索木を乱数でたどって着いた葉の次数を埋めたもの (探索で調べる cartwheel と同じ形)、
+// (charge で枝刈りをすると葉に着く道はほとんどないので、 conf を含むものだけを枝刈りした探索木をたどる。)
+// extended は leaves を third-neighbor まで広げたもの。
+class Fixture {
+public:
+    vector<Wheel> wheels;
+    vector<CartWheel> bases;
+    vector<CartWheel> leaves;
+    vector<CartWheel> extended;
+
+    Fixture(const vector<Wheel> &sampled_wheels, const Corpus &corpus, int max_degree) : wheels(sampled_wheels) {
+        std::mt19937_64 rng(BENCH_SEED);
+        for (const auto &wheel : wheels) {
+            auto base = CartWheel::fromWheel(wheel);
+            bases.push_back(base);
+            int threshold = -chargeInitial(base.numNeighbor());
+            // 葉に着くまで何度かたどる。
+            for (int trial = 0;trial < 8; trial++) {
+                auto probe = BaseWheel::probeDecideDegreeBySendCases(base, corpus.send_case_index, corpus.conf_index, max_degree, threshold, false, rng);
+                if (!probe.leaf.has_value()) continue;
+                auto leaf = probe.leaf.value();
+                fillDegrees(leaf, max_degree);
+                leaves.push_back(leaf);
+                leaf.extendThirdNeighbor();
+                fillDegrees(leaf, max_degree);
+                extended.push_back(leaf);
+                break;
+            }
+        }
+        spdlog::info("fixture : {} wheels, {} leaves", wheels.size(), leaves.size());
+    }
+};
+
+// hub と近傍の間の辺 (両方向) と、その辺に適用しうる rule の組
+class RuleApplication {
+public:
+    int cartwheel_idx;
+    int rule_idx;
+    int from;
+    int to;
+};
+
+static vector<RuleApplication> ruleApplications(const vector<CartWheel> &cartwheels, const RuleIndex &rules) {
+    vector<RuleApplication> res;
+    int hub = 0;
+    for (int i = 0;i < (int)cartwheels.size(); i++) {
+        const auto &graph = cartwheels[i].nearTriangulation();
+        for (int v = 1;v <= cartwheels[i].numNeighbor(); v++) {
+            for (auto [from, to] : {std::make_pair(v, hub), std::make_pair(hub, v)}) {
+                for (int rule_idx : rules.applicableRules(graph, graph.edgeId(from, to))) {
+                    res.push_back(RuleApplication{i, rule_idx, from, to});
+                }
+            }
+        }
+    }
+    return res;
+}
+
+static vector<Kernel> makeKernels(const Fixture &fixture, const Corpus &corpus) {
+    vector<Kernel> kernels;
+    const auto &rules = corpus.send_case_index;
+
+    // 探索の途中 (bases) と葉 (leaves) の cartwheel で rule を照合する。
+    vector<CartWheel> match_cartwheels = fixture.bases;
+    match_cartwheels.insert(match_cartwheels.end(), fixture.leaves.begin(), fixture.leaves.end());
+    auto match_applications = ruleApplications(match_cartwheels, rules);
+    kernels.push_back(Kernel{"contain_subgraph", (int64_t)match_applications.size(), [&rules, match_cartwheels, match_applications]() {
+        int64_t res = 0;
+        ContainResults result_list;
+        for (const auto &app : match_applications) {
+            const auto &graph = match_cartwheels[app.cartwheel_idx].nearTriangulation();
+            const auto &rule = rules.rules()[app.rule_idx];
+            BaseWheel::containSubgraphWithCorrespondingEdge(graph, rule.matchPlan(), graph.edgeId(app.from, app.to), rule.sendEdgeId(), true, result_list);
+            res += result_list.size();
+        }
+        return res;
+    }});
+
+    kernels.push_back(Kernel{"contain_confs", (int64_t)match_cartwheels.size(), [&corpus, match_cartwheels]() {
+        int64_t res = 0;
+        for (const auto &cartwheel : match_cartwheels) res += BaseWheel::containOneofConfs(cartwheel, corpus.conf_index);
+        return res;
+    }});
+
+    auto charge_applications = ruleApplications(fixture.leaves, rules);
+    kernels.push_back(Kernel{"amount_charge_to_send", (int64_t)charge_applications.size(), [&fixture, &rules, charge_applications]() {
+        int64_t res = 0;
+        vector<bool> related;
+        for (const auto &app : charge_applications) {
+            const auto &cartwheel = fixture.leaves[app.cartwheel_idx];
+            related.assign(cartwheel.nearTriangulation().vertexSize(), false);
+            auto [lower, upper] = BaseWheel::amountChargeToSend(cartwheel, app.from, app.to, rules.rules()[app.rule_idx], &related);
+            res += lower + upper;
+        }
+        return res;
+    }});
+
+    // 同型なもの (自分自身) と同型でないもの (次の葉) を交互に比べる。
+    int num_leaves = fixture.leaves.size();
+    kernels.push_back(Kernel{"is_isomorphic", 2 * (int64_t)num_leaves, [&fixture, num_leaves]() {
+        int64_t res = 0;
+        for (int i = 0;i < num_leaves; i++) {
+            res += BaseWheel::isIsomorphic(fixture.leaves[i], fixture.leaves[i]);
+            res += BaseWheel::isIsomorphic(fixture.leaves[i], fixture.leaves[(i + 1) % num_leaves]);
+        }
+        return res;
+    }});
+
+    // 葉を 2 回ずつ並べたものから同型なものを取り除く (並べたものの複製を含む)。
+    vector<CartWheel> duplicated = fixture.leaves;
+    duplicated.insert(duplicated.end(), fixture.leaves.begin(), fixture.leaves.end());
+    kernels.push_back(Kernel{"make_unique", 1, [duplicated]() {
+        auto wheels = duplicated;
+        BaseWheel::makeUnique(wheels);
+        return (int64_t)wheels.size();
+    }});
+
+    kernels.push_back(Kernel{"cartwheel_from_wheel", (int64_t)fixture.wheels.size(), [&fixture]() {
+        int64_t res = 0;
+        for (const auto &wheel : fixture.wheels) res += CartWheel::fromWheel(wheel).nearTriangulation().vertexSize();
+        return res;
+    }});
+
+    kernels.push_back(Kernel{"extend_third_neighbor", (int64_t)num_leaves, [&fixture]() {
+        int64_t res = 0;
+        for (const auto &leaf : fixture.leaves) {
+            auto cartwheel = leaf;
+            cartwheel.extendThirdNeighbor();
+            res += cartwheel.nearTriangulation().vertexSize();
+        }
+        return res;
+    }});
+
+    // third-neighbor まで広げた cartwheel と同じグラフを隣接頂点の集合から作る。
+    vector<vector<set<int>>> adjacencies;
+    vector<vector<Degree>> degrees;
+    for (const auto &cartwheel : fixture.extended) {
+        const auto &graph = cartwheel.nearTriangulation();
+        vector<set<int>> VtoV(graph.vertexSize());
+        for (const auto &[u, v] : graph.edges()) VtoV[u].insert(v);
+        adjacencies.push_back(VtoV);
+        degrees.push_back(graph.degrees());
+    }
+    kernels.push_back(Kernel{"near_triangulation", (int64_t)adjacencies.size(), [adjacencies, degrees]() {
+        int64_t res = 0;
+        for (int i = 0;i < (int)adjacencies.size(); i++) {
+            res += NearTriangulation(adjacencies[i].size(), adjacencies[i], degrees[i]).edges().size();
+        }
+        return res;
+    }});
+    return kernels;
+}
+
+int main(const int ac, const char* const* const av) {
+    using namespace boost::program_options;
+    options_description description("Options");
+    description.add_options()
+        ("wheel_dir,W", value<string>()->default_value("proj_wheel"), "The directory which includes wheel files to sample the fixture from")
+        ("samples,n", value<int>()->default_value(32), "The number of wheels to sample")
+        ("conf,c", value<string>(), "The directory which includes configuration files")
+        ("send_case,s", value<string>(), "The directory which includes send case (.rule extension)")
+        ("snapshot,S", value<string>(), "The snapshot file made by a.out --compile_snapshot (used instead of --send_case and --conf)")
+        ("max_degree,m", value<int>(), "Maximum degree to check (e.g. if you choose degree from {5, 6, 7, 8, 9+}, set max_degree 9)")
+        ("kernel,k", value<vector<string>>()->multitoken(), "The kernels to measure (all kernels by default)")
+        ("min_time", value<int>()->default_value(200), "The minimum time (ms) of one measurement of a kernel")
+        ("repeat", value<int>()->default_value(5), "The number of measurements of a kernel (the best and the median are reported)")
+        ("help,H", "Display options")
+        ("verbosity,v", value<int>()->default_value(0), "1 for debug, 2 for trace");
+
+    variables_map vm;
+    store(parse_command_line(ac, av, description), vm);
+    notify(vm);
+
+    if (vm.count("help")) {
+        description.print(std::cout);
+        return 0;
+    }
+    setupLogger(vm["verbosity"].as<int>());
+    if (!vm.count("max_degree")) {
+        spdlog::warn("Specify max_degree");
+        exit(1);
+    }
+    int max_degree = vm["max_degree"].as<int>();
+    // snapshot が指定されていればそれを、そうでなければ各ディレクトリを読み込む。
+    auto load_corpus = [&vm]() -> Corpus {
+        if (vm.count("snapshot")) {
+            return Corpus::fromSnapshot(vm["snapshot"].as<string>());
+        }
+        if (!vm.count("send_case")) {
+            spdlog::warn("Specify directory which includes send_case files");
+            exit(1);
+        }
+        if (!vm.count("conf")) {
+            spdlog::warn("Specify directory which includes configuration files");
+            exit(1);
+        }
+        return Corpus::fromDirectories("", vm["send_case"].as<string>(), vm["conf"].as<string>());
+    };
+    auto corpus = load_corpus();
+
+    Fixture fixture(sampleWheels(vm["wheel_dir"].as<string>(), vm["samples"].as<int>()), corpus, max_degree);
+    auto kernels = makeKernels(fixture, corpus);
+    if (vm.count("kernel")) {
+        auto names = vm["kernel"].as<vector<string>>();
+        for (const auto &name : names) {
+            if (std::none_of(kernels.begin(), kernels.end(), [&name](const Kernel &kernel) { return kernel.name == name; })) {
+                spdlog::warn("Unknown kernel {}", name);
+                exit(1);
+            }
+        }
+        kernels.erase(std::remove_if(kernels.begin(), kernels.end(), [&names](const Kernel &kernel) {
+            return std::find(names.begin(), names.end(), kernel.name) == names.end();
+        }), kernels.end());
+    }
+
+    fmt::print("{:<24} {:>10} {:>14} {:>14} {:>12}\n", "kernel", "ops", "best ns/op", "median ns/op", "allocs/op");
+    for (const auto &kernel : kernels) {
+        // fixture に処理の対象がない (ops が 0 の) kernel は測らない。
+        if (kernel.ops == 0) {
+            fmt::print("{:<24} {:>10} {:>14} {:>14} {:>12}\n", kernel.name, kernel.ops, "n/a", "n/a", "n/a");
+            std::fflush(stdout);
+            continue;
+        }
+        auto result = runKernel(kernel, vm["min_time"].as<int>(), vm["repeat"].as<int>());
+        fmt::print("{:<24} {:>10} {:>14.1f} {:>14.1f} {:>12.2f}\n", result.name, result.ops, result.best_ns_per_op, result.median_ns_per_op, result.allocs_per_op);
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -6,7 +6,10 @@
 #include <fmt/ranges.h>
 #include <boost/algorithm/string.hpp>
 #include <algorithm>
+#include <functional>
 #include "cartwheel.hpp"
+#include "parallel.hpp"
+#include "log.hpp"
 
 using std::make_pair;
 using std::swap;
@@ -21,35 +24,37 @@ Wheel Wheel::readWheelFile(const string &filename) {
         spdlog::critical("Failed to open {}", filename);
         throw std::runtime_error("Failed to open" + filename);
     }
-    int hub = 0;
     int hub_degree;
     ifs >> hub_degree;
 
-    vector<set<int>> VtoV(hub_degree + 1);
-    vector<optional<Degree>> degrees(hub_degree + 1, std::nullopt);
-    degrees[hub] = Degree(hub_degree);
+    vector<Degree> neighbor_degrees(hub_degree, Degree());
     for (int v = 1;v <= hub_degree; v++) {
         string vdeg_str;
         ifs >> vdeg_str;
-        degrees[v] = Degree::fromString(vdeg_str);
-
-        int u = (v == hub_degree ? 1 : v + 1);
-        VtoV[v].insert(u);
-        VtoV[u].insert(v);
-        VtoV[hub].insert(v);
-        VtoV[v].insert(hub);
+        neighbor_degrees[v - 1] = Degree::fromString(vdeg_str);
     }
+    return Wheel::fromNeighborDegrees(neighbor_degrees);
+}
 
-    return Wheel(NearTriangulation(hub_degree + 1, VtoV, degrees));
+// archive の index 番目の wheel を返す。
+Wheel Wheel::readWheelArchive(const WheelArchive &archive, int index) {
+    return Wheel::fromNeighborDegrees(archive.neighborDegrees(index));
 }
 
 // hub_degree を指定してその他の次数はまだ決まっていない Wheel を返す。
 Wheel Wheel::fromHubDegree(int hub_degree) {
+    return Wheel::fromNeighborDegrees(vector<Degree>(hub_degree, Degree()));
+}
+
+// neighbor_degrees[i] := neighbor i + 1 の次数 として、 hub の次数が neighbor_degrees の長さである Wheel を返す。
+Wheel Wheel::fromNeighborDegrees(const vector<Degree> &neighbor_degrees) {
     int hub = 0;
+    int hub_degree = (int)neighbor_degrees.size();
     vector<set<int>> VtoV(hub_degree + 1);
-    vector<optional<Degree>> degrees(hub_degree + 1, std::nullopt);
+    vector<Degree> degrees(hub_degree + 1, Degree());
     degrees[hub] = Degree(hub_degree);
     for (int v = 1;v <= hub_degree; v++) {
+        degrees[v] = neighbor_degrees[v - 1];
         int u = (v == hub_degree ? 1 : v + 1);
         VtoV[v].insert(u);
         VtoV[u].insert(v);
@@ -71,7 +76,7 @@ string Wheel::toString(void) const {
     string res = std::to_string(hub_degree);
 
     auto deg_str = [&degrees](int u) -> string {
-        return degrees[u].has_value() ? degrees[u].value().toString() : "?";
+        return degrees[u].unset() ? "?" : degrees[u].toString();
     };
 
     for (int v = 1;v <= hub_degree; v++) {
@@ -81,7 +86,7 @@ string Wheel::toString(void) const {
     return res;
 }
 
-void Wheel::setDegree(int v, const optional<Degree> &degree) {
+void Wheel::setDegree(int v, const Degree &degree) {
     wheel_.setDegree(v, degree);
     return;
 }
@@ -93,22 +98,22 @@ const NearTriangulation &Wheel::nearTriangulation(void) const {
 int Wheel::numNeighbor(void) const {
     int hub = 0;
     const auto &degrees = wheel_.degrees();
-    assert(degrees[hub].has_value() && degrees[hub].value().fixed());
-    return degrees[hub].value().lower();
+    assert(degrees[hub].fixed());
+    return degrees[hub].lower();
 }
 
 CartWheel::CartWheel(int num_neighbor, const vector<vector<int>> &hub_neighbors_neighbors, const NearTriangulation &cartwheel) : 
     cartwheel_(cartwheel),
     num_neighbor_(num_neighbor),
-    hub_neighbors_neighbors_(hub_neighbors_neighbors),
-    third_neighbors_(vector<vector<int>>(cartwheel.vertexSize())) {}
+    hub_neighbors_neighbors_(std::make_shared<const vector<vector<int>>>(hub_neighbors_neighbors)),
+    third_neighbors_(std::make_shared<const vector<vector<int>>>(cartwheel.vertexSize())) {}
 
 // wheel を受け取って hub の second neighbor の次数はまだ決まっていない CartWheel を返す。
 CartWheel CartWheel::fromWheel(const Wheel &wheel) {
     int hub = 0;
     int hub_degree = wheel.numNeighbor();
     vector<set<int>> VtoV(hub_degree + 1);
-    vector<optional<Degree>> degrees = wheel.nearTriangulation().degrees();
+    vector<Degree> degrees = wheel.nearTriangulation().degrees();
     vector<vector<int>> hub_neighbors_neighbors(hub_degree + 1);
 
     auto add_edge = [&VtoV](int v, int u) -> void {
@@ -120,7 +125,7 @@ CartWheel CartWheel::fromWheel(const Wheel &wheel) {
     auto new_vertex = [&VtoV, &degrees]() -> int {
         int v = (int)VtoV.size();
         VtoV.push_back({});
-        degrees.push_back(std::nullopt);
+        degrees.push_back(Degree());
         return v;
     };
 
@@ -130,7 +135,7 @@ CartWheel CartWheel::fromWheel(const Wheel &wheel) {
         int u = (v == hub_degree ? 1 : v + 1);
         add_edge(v, u);
         add_edge(hub, v);
-        if (!degrees[v].value().fixed() && !degrees[u].value().fixed()) {
+        if (!degrees[v].fixed() && !degrees[u].fixed()) {
             // u も v も次数が固定されていない(8+など)のとき、
             // second_neighbor を作る必要がない。
             continue;
@@ -142,7 +147,7 @@ CartWheel CartWheel::fromWheel(const Wheel &wheel) {
     }
 
     for (int v = 1;v <= hub_degree; v++) {
-        auto degv = degrees[v].value();
+        auto degv = degrees[v];
         if (!degv.fixed()) continue;
         int u = (v == 1 ? hub_degree : v - 1);
         int first = second_neighbors[u];
@@ -171,7 +176,7 @@ string CartWheel::toString(const vector<bool> &show_degree) const {
     // int hub_degree = numNeighbor();
     const auto &degrees = cartwheel_.degrees();
     auto deg_str = [&degrees, &show_degree](int u) -> string {
-        return degrees[u].has_value() && show_degree[u] ? degrees[u].value().toString() : "?";
+        return !degrees[u].unset() && show_degree[u] ? degrees[u].toString() : "?";
     };
 
     // N E deg0 deg1 .. deg{N-1} u0 v0 u1 v1 .. u{N-1} v{N-1}
@@ -194,7 +199,7 @@ string CartWheel::toString(void) const {
     return toString(show_degree);
 }
 
-void CartWheel::setDegree(int v, const optional<Degree> &degree) {
+void CartWheel::setDegree(int v, const Degree &degree) {
     cartwheel_.setDegree(v, degree);
     return;
 }
@@ -209,18 +214,19 @@ int CartWheel::numNeighbor(void) const {
 }
 
 const vector<vector<int>> &CartWheel::hubNeighborsNeighbors(void) const {
-    return hub_neighbors_neighbors_;
+    return *hub_neighbors_neighbors_;
 }
 
 const vector<vector<int>> &CartWheel::thirdNeighbors(void) const {
-    return third_neighbors_;
+    return *third_neighbors_;
 }
 
 // hub の third-neighbor を構築する。
 void CartWheel::extendThirdNeighbor(void) {
+    STATS_TIMER(Timer::ExtendThirdNeighbor);
     int vertex_size = nearTriangulation().vertexSize();
     vector<set<int>> VtoV(vertex_size);
-    vector<optional<Degree>> degrees = nearTriangulation().degrees();
+    vector<Degree> degrees = nearTriangulation().degrees();
     vector<vector<int>> third_neighbors(vertex_size);
 
     auto add_edge = [&VtoV](int v, int u) -> void {
@@ -232,21 +238,21 @@ void CartWheel::extendThirdNeighbor(void) {
     auto new_vertex = [&VtoV, &degrees, &third_neighbors]() -> int {
         int v = (int)VtoV.size();
         VtoV.push_back({});
-        degrees.push_back(std::nullopt);
+        degrees.push_back(Degree());
         third_neighbors.push_back({});
         return v;
     };
 
     auto get_degree = [degrees](int v) -> Degree {
-        assert(degrees[v].has_value());
-        return degrees[v].value();
+        assert(!degrees[v].unset());
+        return degrees[v];
     };
 
     // second-neighbor までの VtoV を計算する。
     const auto &edges = nearTriangulation().edges();
-    const auto &diagonal_vertices = nearTriangulation().diagonalVertices();
-    for (const auto& edge : edges) {
-        for (auto v : diagonal_vertices.at(edge)) {
+    for (int edgeid = 0;edgeid < (int)edges.size(); edgeid++) {
+        const auto &edge = edges[edgeid];
+        for (auto v : nearTriangulation().diagonalVertices(edgeid)) {
             add_edge(v, edge.first);
             add_edge(v, edge.second);
             add_edge(edge.first, edge.second);
@@ -260,14 +266,14 @@ void CartWheel::extendThirdNeighbor(void) {
         if (!degv.fixed()) {
             circuit.push_back(v);
         } else {
-            int v_neighbor_size = (int)hub_neighbors_neighbors_[v].size();
+            int v_neighbor_size = (int)hubNeighborsNeighbors()[v].size();
             for (int v_neighbor_idx = 0;v_neighbor_idx < v_neighbor_size - 1; v_neighbor_idx++) {
-                circuit.push_back(hub_neighbors_neighbors_[v][v_neighbor_idx]);
+                circuit.push_back(hubNeighborsNeighbors()[v][v_neighbor_idx]);
             }
             int v_after = (v == hubdegree ? 1 : v + 1);
             Degree degv_after = get_degree(v_after);
             if (!degv_after.fixed()) {
-                circuit.push_back(hub_neighbors_neighbors_[v].back());
+                circuit.push_back(hubNeighborsNeighbors()[v].back());
             }
         }
     }
@@ -336,14 +342,15 @@ void CartWheel::extendThirdNeighbor(void) {
 
     // メンバを更新
     cartwheel_ = NearTriangulation(VtoV.size(), VtoV, degrees);
-    third_neighbors_ = third_neighbors;
+    third_neighbors_ = std::make_shared<const vector<vector<int>>>(std::move(third_neighbors));
     return;
 }
 
 // (i) hub が rules に従って近傍から charge を送受した結果 0 を超えたかどうかの判定結果
 // (ii) cartwheel の頂点でルールを送るのに関係しているかどうかを表す bool 配列。
 //　を返す。
-pair<bool, vector<bool>> CartWheel::isOvercharged(const vector<Rule> &rules) const {
+pair<bool, vector<bool>> CartWheel::isOvercharged(const RuleIndex &rules) const {
+    STATS_TIMER(Timer::IsOvercharged);
     int hub = 0;
     int hub_degree = numNeighbor();
     int charge_receive = 0, charge_send = 0;
@@ -351,27 +358,28 @@ pair<bool, vector<bool>> CartWheel::isOvercharged(const vector<Rule> &rules) con
     vector<bool> is_rule_related(cartwheel_.vertexSize(), false);
     vector<pair<string, int>> degree_charge_of_neighbors(hub_degree, make_pair("", 0));
     for (int hub_neighbor = 1;hub_neighbor <= hub_degree; hub_neighbor++) {
-        for (const auto &rule : rules) {
+        // 端点の次数から適用しうる rule についてだけ送受する量を計算する。
+        for (int rule_idx : rules.applicableRules(cartwheel_, cartwheel_.edgeId(hub_neighbor, hub))) {
             // 受け取る量
-            auto [receive_lower, receive_upper, receive_related] = BaseWheel::amountChargeToSend(*this, hub_neighbor, hub, rule);
-            // 送る量
-            auto [send_lower, send_upper, send_related] = BaseWheel::amountChargeToSend(*this, hub, hub_neighbor, rule);
-            assert(receive_lower == receive_upper && send_lower == send_upper); 
+            auto [receive_lower, receive_upper] = BaseWheel::amountChargeToSend(*this, hub_neighbor, hub, rules.rules()[rule_idx], &is_rule_related);
+            assert(receive_lower == receive_upper);
             charge_receive += receive_lower;
-            charge_send += send_lower;
-            for (int i = 0;i < cartwheel_.vertexSize(); i++) {
-                is_rule_related[i] = is_rule_related[i] || receive_related[i] || send_related[i];
-            }
             degree_charge_of_neighbors[hub_neighbor - 1].second += receive_lower;
         }
-        assert(degrees[hub_neighbor - 1].has_value());
-        degree_charge_of_neighbors[hub_neighbor - 1].first = degrees[hub_neighbor].value().toString();
+        for (int rule_idx : rules.applicableRules(cartwheel_, cartwheel_.edgeId(hub, hub_neighbor))) {
+            // 送る量
+            auto [send_lower, send_upper] = BaseWheel::amountChargeToSend(*this, hub, hub_neighbor, rules.rules()[rule_idx], &is_rule_related);
+            assert(send_lower == send_upper);
+            charge_send += send_lower;
+        }
+        assert(!degrees[hub_neighbor - 1].unset());
+        degree_charge_of_neighbors[hub_neighbor - 1].first = degrees[hub_neighbor].toString();
     }
-    spdlog::debug("charges receive: {}", fmt::join(degree_charge_of_neighbors, ", "));
+    LOG_DEBUG("charges receive: {}", fmt::join(degree_charge_of_neighbors, ", "));
     int charge_initial = chargeInitial(hub_degree);
     int charge = charge_initial + charge_receive - charge_send;
-    spdlog::debug("cartwheel : {}", toString());
-    spdlog::debug("charge (initial, receive, send, result) : {}, {}, {}, {}", charge_initial, charge_receive, charge_send, charge);
+    LOG_DEBUG("cartwheel : {}", toString());
+    LOG_DEBUG("charge (initial, receive, send, result) : {}, {}, {}, {}", charge_initial, charge_receive, charge_send, charge);
     return make_pair(charge > 0, is_rule_related);
 }
 
@@ -379,133 +387,507 @@ int chargeInitial(int degree) {
     return 10 * (6 - degree);
 }
 
+// second-neighbor まで次数を決めた cartwheel を third-neighbor まで広げる。
+// second-neighbor で次数の定まっていない頂点は次数を max_degree+ にする。
+static void extendToThirdNeighbor(CartWheel &cartwheel, int max_degree) {
+    const auto &degrees = cartwheel.nearTriangulation().degrees();
+    for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
+        if (degrees[v].unset()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
+    }
+    cartwheel.extendThirdNeighbor();
+    return;
+}
+
 // degree がまだ定まっていない頂点の　degree を 5, 6, ..., max_degree+ の中から選んで決めた cartwheel のうち、 
 // (i) reducible_confs に含まれる conf を含まない 
 // (ii) rule による charge の授与の結果 hub が 0 より大きい charge を持つようになる。
 // ような cartwheel を出力する。
-void searchOverChargedCartWheel(
-    const Wheel &wheel, const vector<Rule> &rules, const vector<Rule> &send_cases,
-    const vector<Configuration> &reducible_confs, int max_degree) {
+// 結果は logger に出力する。
+WheelResult searchOverChargedCartWheel(
+    const Wheel &wheel, const RuleIndex &rules, const RuleIndex &send_cases,
+    const ConfIndex &reducible_confs, int max_degree, int num_search_threads, const Checkpointer &checkpointer, spdlog::logger &logger) {
+    WheelResult result;
+    result.wheel = wheel.toString();
+    // 各段階にかかった時間を result に記録する。
+    auto start = std::chrono::steady_clock::now();
+    auto phase_start = start;
+    auto record_phase = [&](const string &phase) {
+        auto now = std::chrono::steady_clock::now();
+        result.elapsed_ms.push_back({phase, std::chrono::duration_cast<std::chrono::milliseconds>(now - phase_start).count()});
+        phase_start = now;
+    };
     auto base_cartwheel = CartWheel::fromWheel(wheel);
     int threshold = -chargeInitial(base_cartwheel.numNeighbor());
+    searchStats() = SearchStats();
 
-    auto possible_cartwheels_within_secondneighbor = BaseWheel::decideDegreeBySendCases(base_cartwheel, send_cases, reducible_confs, max_degree, threshold, true);
-    spdlog::info("extending third neighbors...");
-    std::transform(possible_cartwheels_within_secondneighbor.begin(), possible_cartwheels_within_secondneighbor.end(), possible_cartwheels_within_secondneighbor.begin(), [&max_degree](CartWheel &cartwheel){
-        const auto &degrees = cartwheel.nearTriangulation().degrees();
-        // second-neighbor で次数の定まっていない頂点は次数を max_degree+ にする。
-        for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
-            if (!degrees[v].has_value()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
-        }
-        cartwheel.extendThirdNeighbor();
-        return cartwheel;
-    });
+    auto possible_cartwheels_within_secondneighbor = BaseWheel::decideDegreeBySendCases(base_cartwheel, send_cases, reducible_confs, max_degree, threshold, true, num_search_threads, checkpointer, "second");
+    record_phase("second_neighbor");
+    logger.info("extending third neighbors...");
+    for (auto &cartwheel : possible_cartwheels_within_secondneighbor) extendToThirdNeighbor(cartwheel, max_degree);
     // decideThirdNeighborDegreeByRulesでルールに影響のある third-neighbor の次数を決める(そのような頂点の次数の組み合わせしか探索する必要がない)。
     vector<CartWheel> possible_cartwheels;
-    for (const auto& cartwheel : possible_cartwheels_within_secondneighbor) {
-        auto cartwheels = BaseWheel::decideDegreeBySendCases(cartwheel, send_cases, reducible_confs, max_degree, threshold, true);
+    for (int i = 0;i < (int)possible_cartwheels_within_secondneighbor.size(); i++) {
+        const auto &cartwheel = possible_cartwheels_within_secondneighbor[i];
+        auto cartwheels = BaseWheel::decideDegreeBySendCases(cartwheel, send_cases, reducible_confs, max_degree, threshold, true, num_search_threads, checkpointer, fmt::format("third_{}", i));
         possible_cartwheels.insert(possible_cartwheels.end(), cartwheels.begin(), cartwheels.end());
     }
+    record_phase("third_neighbor");
     std::transform(possible_cartwheels.begin(), possible_cartwheels.end(), possible_cartwheels.begin(), [&max_degree](CartWheel &cartwheel){
         const auto &degrees = cartwheel.nearTriangulation().degrees();
         // third-neighbor で次数の定まっていない頂点は次数を max_degree+ にする。
         for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
-            if (!degrees[v].has_value()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
+            if (degrees[v].unset()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
         }
         return cartwheel;
     });
     BaseWheel::makeUnique(possible_cartwheels);
-    spdlog::info("number of cartwheel to check : {}", possible_cartwheels.size());
+    record_phase("unique");
+    logger.info("number of cartwheel to check : {}", possible_cartwheels.size());
     int num_overcharged = 0;
     int idx_cartwheel = 0;
     for (const auto &cartwheel : possible_cartwheels) {
-        spdlog::debug("checking cartwheel [{}/{}]", idx_cartwheel, possible_cartwheels.size());
+        logger.debug("checking cartwheel [{}/{}]", idx_cartwheel, possible_cartwheels.size());
         auto [is_ovecharged, is_related] = cartwheel.isOvercharged(rules);
         if (is_ovecharged) {
-            spdlog::info("overcharged cartwheel (for machine) : {}", cartwheel.toString(is_related));
+            string payload = cartwheel.toString(is_related);
+            logger.info("overcharged cartwheel (for machine) : {}", payload);
+            result.payloads.push_back(payload);
             num_overcharged ++;
         }
         idx_cartwheel ++;
     }
-    spdlog::info("the ratio of overcharged cartwheel {}/{}", num_overcharged, possible_cartwheels.size());
-    return;
+    record_phase("check");
+    logger.info("the ratio of overcharged cartwheel {}/{}", num_overcharged, possible_cartwheels.size());
+    logger.debug("search stats : {}", searchStats().toString());
+    result.num_candidates = possible_cartwheels.size();
+    result.num_overcharged = num_overcharged;
+#if DISCHARGE_ENABLE_STATS
+    result.counters = searchStats().counters();
+    result.timers_ms = searchStats().timersMs();
+#endif
+    result.elapsed_ms.push_back({"total", std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()});
+    result.max_rss_kb = maxRssKb();
+    return result;
 }
 
-void evaluateWheel(const string &wheel_filename, const string &rules_dirname, const string &send_cases_dirname, const string &confs_dirname, int max_degree) {
-    spdlog::debug("reading {}", wheel_filename);
+// num_search_threads 個のスレッドで 1 つの wheel の探索を行う。
+// result_filename が指定されているときは評価結果を追記する。
+// 探索の途中経過は checkpointer のディレクトリの下の wheel のファイル名のディレクトリに保存し、評価が終わったら消す。
+void evaluateWheel(const string &wheel_filename, const Corpus &corpus, int max_degree, int num_search_threads, const string &result_filename, const Checkpointer &checkpointer) {
+    LOG_DEBUG("reading {}", wheel_filename);
     Wheel wheel = Wheel::readWheelFile(wheel_filename);
-    vector<Rule> rules = getRules(rules_dirname);
-    vector<Rule> send_cases = getRules(send_cases_dirname);
-    vector<Configuration> confs = getConfs(confs_dirname);
     spdlog::info("start evaluating {}", wheel_filename);
-    searchOverChargedCartWheel(wheel, rules, send_cases, confs, max_degree);
+    auto wheel_checkpointer = checkpointer.sub(fs::path(wheel_filename).filename().string());
+    auto result = searchOverChargedCartWheel(wheel, corpus.rule_index, corpus.send_case_index, corpus.conf_index, max_degree, num_search_threads, wheel_checkpointer, *spdlog::default_logger());
+    if (result_filename != "") {
+        result.id = fs::path(wheel_filename).filename().string();
+        ResultWriter(result_filename).write(result);
+    }
+    wheel_checkpointer.clear();
     return;
 }
 
-vector<Wheel> searchPossibleOverChargedWheels(int hubdegree, const vector<Degree> &possible_degrees, 
-    const vector<Configuration> &confs, const vector<Rule> &send_cases) {
-    Wheel base_wheel = Wheel::fromHubDegree(hubdegree);
-    vector<Wheel> res;
-    // decide degree and generate wheel that is unique up to rotationaly symmetry
-    vector<int> temp_degree_idx(hubdegree, -1);
-    auto decide_degree = [&](auto &&decide_degree, int v, int lowerst_deg_idx) -> void {
-        // decide v-th neighbor's degree
-        if (v == hubdegree) {
-            // lexicographical order
-            auto original_order = temp_degree_idx;
-            bool original_is_min = true;
-            for (int i = 0;i < hubdegree; i++) {
-                rotate(temp_degree_idx.begin(), temp_degree_idx.begin() + 1, temp_degree_idx.end());
-                if (temp_degree_idx < original_order) {
-                    original_is_min = false;
-                    break;
+// 見積もりで探索木をたどるときの乱数の種 (同じ wheel には同じ見積もりを返す。)
+const uint64_t WHEEL_ESTIMATE_SEED = 0;
+
+// wheel を評価する job を並べるときの、探索木をたどらない大まかな見積もり
+// 次数が 6, 7 の近傍が多い wheel ほど charge を送る場合分けが多くなり、探索に時間がかかる傾向がある。
+static double expectedCost(const Wheel &wheel) {
+    const auto &degrees = wheel.nearTriangulation().degrees();
+    double cost = 0;
+    for (int v = 1;v <= wheel.numNeighbor(); v++) {
+        if (!degrees[v].unset() && degrees[v].lower() >= 6 && degrees[v].upper() <= 7) cost++;
+    }
+    return cost;
+}
+
+// wheel_names[idx] という名前の wheel (read_wheel(idx) で読む) をまとめて評価する。
+// 一度だけ読み込んだ corpus を共有して、 num_threads 個のスレッドで wheel を分担して評価する。
+// log_dirname が指定されているときは、wheel ごとの結果を log_dirname/(wheel の名前のファイル名部分).log に出力する。
+// result_filename が指定されているときは、wheel ごとの評価結果 (id は wheel の名前のファイル名部分) を result_filename に追記する。
+// それぞれの wheel の探索は num_search_threads 個のスレッドで行う。
+// 探索の途中経過は checkpointer のディレクトリの下の wheel の名前のディレクトリに保存し、評価が終わったら消す。
+// schedule が有効なときは、スレッドの代わりに num_threads 個の子プロセスで評価する (scheduleJobs を参照)。
+static void evaluateWheels(const vector<string> &wheel_names, const std::function<Wheel(int)> &read_wheel, const Corpus &corpus, int max_degree, int num_threads, int num_search_threads, const string &log_dirname, const string &result_filename, const Checkpointer &checkpointer, const ScheduleOptions &schedule) {
+    if (log_dirname != "" && fs::create_directories(log_dirname)) spdlog::info("made {} directory", log_dirname);
+    auto evaluate = [&](int idx) -> WheelResult {
+        const string &wheel_name = wheel_names[idx];
+        auto logger = spdlog::default_logger();
+        if (log_dirname != "") {
+            string log_filename = (fs::path(log_dirname) / fs::path(wheel_name).filename()).string() + ".log";
+            logger = makeFileLogger(log_filename);
+        }
+        WheelResult result;
+        auto wheel_checkpointer = checkpointer.sub(fs::path(wheel_name).filename().string());
+        try {
+            Wheel wheel = read_wheel(idx);
+            logger->info("start evaluating {}", wheel_name);
+            result = searchOverChargedCartWheel(wheel, corpus.rule_index, corpus.send_case_index, corpus.conf_index, max_degree, num_search_threads, wheel_checkpointer, *logger);
+        } catch (const std::exception &e) {
+            // 1 つの wheel の失敗で他の wheel の評価を止めない。
+            logger->critical("Failed to evaluate {} : {}", wheel_name, e.what());
+            result.failed = true;
+            result.error = e.what();
+        }
+        logger->flush();
+        result.id = fs::path(wheel_name).filename().string();
+        if (!result.failed) wheel_checkpointer.clear();
+        return result;
+    };
+
+    if (schedule.enabled()) {
+        vector<string> ids;
+        for (const auto &wheel_name : wheel_names) ids.push_back(fs::path(wheel_name).filename().string());
+        // 評価にかかる時間を探索木をたどって見積もる (schedule.num_probes が 0 のときは近傍の次数から見積もる)。
+        // manifest で評価を終えている wheel は実行しないので見積もらない。
+        // 読めない wheel は警告を出し、子プロセスでの評価に失敗したものとして記録する。
+        auto manifest = readManifest(schedule.manifest_filename);
+        vector<int> unfinished;
+        for (int idx = 0;idx < (int)ids.size(); idx++) {
+            if (!manifest.finished.count(ids[idx])) unfinished.push_back(idx);
+        }
+        spdlog::info("estimating the cost of {} wheels with {} probes", unfinished.size(), schedule.num_probes);
+        vector<double> expected_costs(wheel_names.size(), 0);
+        parallelFor((int)unfinished.size(), num_threads, [&](int i) {
+            int idx = unfinished[i];
+            try {
+                Wheel wheel = read_wheel(idx);
+                if (schedule.num_probes > 0) {
+                    expected_costs[idx] = estimateWheel(wheel, corpus, max_degree, schedule.num_probes, WHEEL_ESTIMATE_SEED).predicted_ms;
+                } else {
+                    expected_costs[idx] = expectedCost(wheel);
                 }
+            } catch (const std::exception &e) {
+                spdlog::warn("Failed to estimate the cost of {} : {}", wheel_names[idx], e.what());
             }
-            swap(original_order, temp_degree_idx);
-            if (!original_is_min) {
-                return;
-            }
+        });
+        scheduleJobs(ids, expected_costs, evaluate, num_threads, schedule, manifest);
+        return;
+    }
+
+    std::unique_ptr<ResultWriter> result_writer;
+    if (result_filename != "") result_writer = std::make_unique<ResultWriter>(result_filename);
+    spdlog::info("start evaluating {} wheels with {} threads", wheel_names.size(), num_threads);
+    parallelFor((int)wheel_names.size(), num_threads, [&](int idx) {
+        auto result = evaluate(idx);
+        if (result_writer) result_writer->write(result);
+        spdlog::info("finished {} [{}/{}]", wheel_names[idx], idx + 1, wheel_names.size());
+    });
+    return;
+}
+
+// wheel_filenames に含まれる wheel をまとめて評価する。
+void evaluateWheels(const vector<string> &wheel_filenames, const Corpus &corpus, int max_degree, int num_threads, int num_search_threads, const string &log_dirname, const string &result_filename, const Checkpointer &checkpointer, const ScheduleOptions &schedule) {
+    evaluateWheels(wheel_filenames, [&](int idx) {
+        return Wheel::readWheelFile(wheel_filenames[idx]);
+    }, corpus, max_degree, num_threads, num_search_threads, log_dirname, result_filename, checkpointer, schedule);
+    return;
+}
+
+// archive_filename の index が indexes に含まれる wheel をまとめて評価する。
+// wheel の名前 (log のファイル名) は wheel ごとのファイルに書き出したときと同じ <hub_degree>_<index>.wheel とする。
+void evaluateWheelArchive(const string &archive_filename, const vector<int> &indexes, const Corpus &corpus, int max_degree, int num_threads, int num_search_threads, const string &log_dirname, const string &result_filename, const Checkpointer &checkpointer, const ScheduleOptions &schedule) {
+    WheelArchive archive(archive_filename);
+    if (archive.maxDegree() != max_degree) {
+        spdlog::warn("The wheels in {} are generated with max_degree {} (evaluating with max_degree {})", archive_filename, archive.maxDegree(), max_degree);
+    }
+    vector<string> wheel_names;
+    for (int index : indexes) {
+        if (index < 0 || index >= archive.size()) {
+            spdlog::critical("{} has no wheel whose index is {} (the number of wheels is {})", archive_filename, index, archive.size());
+            throw std::runtime_error("Index out of range of " + archive_filename);
+        }
+        wheel_names.push_back(fmt::format("{}_{}.wheel", archive.hubDegree(), index));
+    }
+    evaluateWheels(wheel_names, [&](int idx) {
+        return Wheel::readWheelArchive(archive, indexes[idx]);
+    }, corpus, max_degree, num_threads, num_search_threads, log_dirname, result_filename, checkpointer, schedule);
+    return;
+}
+
+// searchOverChargedCartWheel で探索する節点の数と評価にかかる時間を、探索木を num_probes 回たどって見積もる。
+// second-neighbor の探索木でたどり着いた葉から、 third-neighbor の探索木を続けてたどる。
+// (second-neighbor の葉の数の推定値 × third-neighbor の探索木の節点の数の推定値) も不偏な推定量になる。
+WheelEstimate estimateWheel(const Wheel &wheel, const Corpus &corpus, int max_degree, int num_probes, uint64_t seed) {
+    auto start = std::chrono::steady_clock::now();
+    WheelEstimate estimate;
+    estimate.wheel = wheel.toString();
+    auto base_cartwheel = CartWheel::fromWheel(wheel);
+    const auto &graph = base_cartwheel.nearTriangulation();
+    int hub_degree = base_cartwheel.numNeighbor();
+    int threshold = -chargeInitial(hub_degree);
+    estimate.hub_degree = hub_degree;
+    for (int v = 1;v <= hub_degree; v++) {
+        const auto &degree = graph.degrees()[v];
+        if (!degree.fixed()) estimate.unfixed_neighbors++;
+        estimate.send_cases += corpus.send_case_index.applicableRules(graph, graph.edgeId(v, 0)).size();
+        estimate.send_cases += corpus.send_case_index.applicableRules(graph, graph.edgeId(0, v)).size();
+    }
+
+    std::mt19937_64 rng(seed);
+    int num_expanded = 0;
+    for (int probe = 0;probe < num_probes; probe++) {
+        auto second = BaseWheel::probeDecideDegreeBySendCases(base_cartwheel, corpus.send_case_index, corpus.conf_index, max_degree, threshold, true, rng);
+        num_expanded += second.expanded;
+        double nodes = second.nodes;
+        if (second.leaf.has_value()) {
+            auto cartwheel = std::move(second.leaf.value());
+            extendToThirdNeighbor(cartwheel, max_degree);
+            auto third = BaseWheel::probeDecideDegreeBySendCases(cartwheel, corpus.send_case_index, corpus.conf_index, max_degree, threshold, true, rng);
+            num_expanded += third.expanded;
+            nodes += second.weight * third.nodes;
+            estimate.leaves += second.weight * third.weight / num_probes;
+        }
+        estimate.nodes += nodes / num_probes;
+    }
+    estimate.probes = num_probes;
+    estimate.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    // たどるときに子を求めた節点 1 つあたりの時間で、探索木の全ての節点の子を求める時間を見積もる。
+    if (num_expanded > 0) estimate.predicted_ms = estimate.nodes * estimate.elapsed_ms / num_expanded;
+    return estimate;
+}
+
+// wheel_names[idx] という名前の wheel (read_wheel(idx) で読む) の評価にかかる手間を num_threads 個のスレッドで見積もり、 estimate_filename に書き出す。
+static void estimateWheels(const vector<string> &wheel_names, const std::function<Wheel(int)> &read_wheel, const Corpus &corpus, int max_degree, int num_threads, int num_probes, const string &estimate_filename) {
+    if (fs::exists(estimate_filename)) fs::remove(estimate_filename);
+    ResultWriter writer(estimate_filename);
+    spdlog::info("start estimating {} wheels with {} probes", wheel_names.size(), num_probes);
+    parallelFor((int)wheel_names.size(), num_threads, [&](int idx) {
+        auto estimate = estimateWheel(read_wheel(idx), corpus, max_degree, num_probes, WHEEL_ESTIMATE_SEED);
+        estimate.id = fs::path(wheel_names[idx]).filename().string();
+        writer.write(estimate);
+        LOG_DEBUG("estimated {} : nodes {:.1f}, predicted {:.1f} ms", estimate.id, estimate.nodes, estimate.predicted_ms);
+    });
+    spdlog::info("wrote the estimates into {}", estimate_filename);
+    return;
+}
+
+// wheel_filenames に含まれる wheel の評価にかかる手間を見積もる。
+void estimateWheels(const vector<string> &wheel_filenames, const Corpus &corpus, int max_degree, int num_threads, int num_probes, const string &estimate_filename) {
+    estimateWheels(wheel_filenames, [&](int idx) {
+        return Wheel::readWheelFile(wheel_filenames[idx]);
+    }, corpus, max_degree, num_threads, num_probes, estimate_filename);
+    return;
+}
+
+// archive_filename の index が indexes に含まれる wheel の評価にかかる手間を見積もる。
+void estimateWheelArchive(const string &archive_filename, const vector<int> &indexes, const Corpus &corpus, int max_degree, int num_threads, int num_probes, const string &estimate_filename) {
+    WheelArchive archive(archive_filename);
+    vector<string> wheel_names;
+    for (int index : indexes) {
+        if (index < 0 || index >= archive.size()) {
+            spdlog::critical("{} has no wheel whose index is {} (the number of wheels is {})", archive_filename, index, archive.size());
+            throw std::runtime_error("Index out of range of " + archive_filename);
+        }
+        wheel_names.push_back(fmt::format("{}_{}.wheel", archive.hubDegree(), index));
+    }
+    estimateWheels(wheel_names, [&](int idx) {
+        return Wheel::readWheelArchive(archive, indexes[idx]);
+    }, corpus, max_degree, num_threads, num_probes, estimate_filename);
+    return;
+}
+
+const int WHEEL_FLUSH_SIZE = 256;
+const auto WHEEL_FLUSH_INTERVAL = std::chrono::seconds(10);
+
+// 古い summary が残っていると生成が終わったように見えるので消しておく。
+WheelWriter::WheelWriter(const string &output_dirname, int hub_degree, int max_degree, bool archive)
+    : output_dirname_(output_dirname), hub_degree_(hub_degree), max_degree_(max_degree), next_task_(0), count_(0),
+      start_(std::chrono::steady_clock::now()), last_flush_(start_) {
+    fs::remove(fmt::format("{}/{}.summary", output_dirname_, hub_degree_));
+    if (archive) archive_ = std::make_unique<WheelArchiveWriter>(fmt::format("{}/{}.wheels", output_dirname_, hub_degree_), hub_degree_, max_degree_);
+}
+
+void WheelWriter::reserveTask(int task) {
+    if (task >= (int)finished_.size()) {
+        finished_.resize(task + 1, false);
+        pending_.resize(task + 1);
+    }
+    return;
+}
+
+// バッファの wheel をファイルに書き出す。 mutex_ を取ってから呼ぶ。
+// 書きかけのファイルが読まれないように、一時ファイルに書いてから名前を変える。
+// (archive のときは wheel を追記してからヘッダの count を書き直す。)
+void WheelWriter::flush(void) {
+    if (archive_) {
+        for (const auto &wheel : buffer_) {
+            const auto &degrees = wheel.nearTriangulation().degrees();
+            archive_->append(vector<Degree>(degrees.begin() + 1, degrees.end()));
+        }
+        archive_->flush();
+        count_ = archive_->count();
+    } else {
+        for (const auto &wheel : buffer_) {
+            string filename = fmt::format("{}/{}_{}.wheel", output_dirname_, hub_degree_, count_++);
+            wheel.writeWheelFile(filename + ".tmp");
+            fs::rename(filename + ".tmp", filename);
+        }
+    }
+    if (!buffer_.empty()) LOG_DEBUG("wrote {} wheels", count_);
+    buffer_.clear();
+    last_flush_ = std::chrono::steady_clock::now();
+    return;
+}
+
+void WheelWriter::flushIfNeeded(void) {
+    if ((int)buffer_.size() >= WHEEL_FLUSH_SIZE || std::chrono::steady_clock::now() - last_flush_ >= WHEEL_FLUSH_INTERVAL) flush();
+    return;
+}
+
+// task 番目のタスクで見つかった wheel を受け取る。
+void WheelWriter::write(int task, const Wheel &wheel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reserveTask(task);
+    if (task == next_task_) {
+        buffer_.push_back(wheel);
+        flushIfNeeded();
+    } else {
+        pending_[task].push_back(wheel);
+    }
+    return;
+}
+
+// task 番目のタスクが終わったときに呼ぶ。
+void WheelWriter::finishTask(int task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reserveTask(task);
+    finished_[task] = true;
+    while (next_task_ < (int)finished_.size() && finished_[next_task_]) {
+        next_task_++;
+        if (next_task_ < (int)pending_.size()) {
+            std::move(pending_[next_task_].begin(), pending_[next_task_].end(), std::back_inserter(buffer_));
+            vector<Wheel>().swap(pending_[next_task_]);
+        }
+    }
+    flushIfNeeded();
+    return;
+}
+
+// 全てのタスクが終わった後に呼び、残りの wheel と summary を書き出す。書き出した wheel の数を返す。
+int WheelWriter::close(void) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (next_task_ != (int)finished_.size()) {
+        spdlog::critical("WheelWriter is closed before all tasks finish");
+        throw std::runtime_error("WheelWriter is closed before all tasks finish");
+    }
+    flush();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_).count();
+    string filename = fmt::format("{}/{}.summary", output_dirname_, hub_degree_);
+    {
+        std::ofstream ofs(filename + ".tmp");
+        ofs << "hub_degree " << hub_degree_ << std::endl;
+        ofs << "max_degree " << max_degree_ << std::endl;
+        ofs << "wheels " << count_ << std::endl;
+        ofs << "format " << (archive_ ? "archive" : "file") << std::endl;
+        ofs << "elapsed_ms " << elapsed << std::endl;
+    }
+    fs::rename(filename + ".tmp", filename);
+    return count_;
+}
+
+// 最初の WHEEL_PREFIX_LENGTH 個の neighbor の次数 (prefix) ごとにタスクに分けて wheel を探索する。
+const int WHEEL_PREFIX_LENGTH = 3;
+
+// neighbor の次数の列を回転と鏡映で同一視したときの代表元 (辞書順最小のもの) だけを探索し、
+// confs を含まず hub が overcharged になりうる wheel を見つけたときに writer に渡す。
+// 回転について辞書順最小の列 (necklace) は FKM アルゴリズムで生成するので、回転で最小にならない prefix は探索しない。
+// その上で、列を反転したものの回転のどれよりも辞書順で大きくないもの (bracelet) だけを残す。
+// 探索は prefix ごとに num_threads 個のスレッドで分担し、 prefix の番号をタスクの番号として writer に渡す。
+// (writer は 1 スレッドで探索したときと同じ順番 (次数の列の辞書順) に並べて書き出す。)
+void searchPossibleOverChargedWheels(int hubdegree, const vector<Degree> &possible_degrees, 
+    const ConfIndex &confs, const RuleIndex &send_cases, int num_threads, WheelWriter &writer) {
+    int num_degrees = (int)possible_degrees.size();
+
+    // degree_idx[1..hubdegree] が鏡映で裏返した列の回転のどれよりも辞書順で大きくないか。
+    auto is_bracelet = [&](const vector<int> &degree_idx) -> bool {
+        for (int shift = 0;shift < hubdegree; shift++) {
+            // 反転した列を shift だけ回転した列と比較する。
             for (int i = 0;i < hubdegree; i++) {
-                base_wheel.setDegree(i + 1, possible_degrees[temp_degree_idx[i]]);
+                int reflected = degree_idx[1 + (hubdegree - 1 - i + shift) % hubdegree];
+                if (reflected < degree_idx[1 + i]) return false;
+                if (reflected > degree_idx[1 + i]) break;
             }
-            if (BaseWheel::containOneofConfs(base_wheel, confs)) return;
-            // remove clearly not overcharged wheel
-            int recv = 0;
-            for (int neighbor = 1;neighbor <= hubdegree; neighbor++) {
-                int max_recv_u = 0;
-                for (const auto &send_case : send_cases) {
-                    auto [_tmp0, recv_u, _tmp1] =  BaseWheel::amountChargeToSend(base_wheel, neighbor, 0, send_case);
-                    max_recv_u = std::max(max_recv_u, recv_u > 0 ? send_case.amount() : 0); // rule が2回適用されるときでも、1回の適用しか考えない。2回の適用は別の rule で見ているのと max をとっているので大丈夫。
-                }
-                recv += max_recv_u;
+        }
+        return true;
+    };
+
+    // 次数の列が決まった wheel について conf を含まず、 hub が overcharged になりうるとき writer に渡す。
+    auto check_wheel = [&](const vector<int> &degree_idx, Wheel &base_wheel, int task) -> void {
+        if (!is_bracelet(degree_idx)) return;
+        for (int i = 0;i < hubdegree; i++) {
+            base_wheel.setDegree(i + 1, possible_degrees[degree_idx[i + 1]]);
+        }
+        if (BaseWheel::containOneofConfs(base_wheel, confs)) return;
+        // remove clearly not overcharged wheel
+        int recv = 0;
+        for (int neighbor = 1;neighbor <= hubdegree; neighbor++) {
+            int max_recv_u = 0;
+            for (int send_case_idx : send_cases.applicableRules(base_wheel.nearTriangulation(), base_wheel.nearTriangulation().edgeId(neighbor, 0))) {
+                const auto &send_case = send_cases.rules()[send_case_idx];
+                auto [_tmp0, recv_u] =  BaseWheel::amountChargeToSend(base_wheel, neighbor, 0, send_case);
+                max_recv_u = std::max(max_recv_u, recv_u > 0 ? send_case.amount() : 0); // rule が2回適用されるときでも、1回の適用しか考えない。2回の適用は別の rule で見ているのと max をとっているので大丈夫。
             }
-            if (chargeInitial(hubdegree) + recv <= 0) return;
-            res.push_back(base_wheel);
+            recv += max_recv_u;
+        }
+        if (chargeInitial(hubdegree) + recv <= 0) return;
+        writer.write(task, base_wheel);
+        return;
+    };
+
+    // FKM アルゴリズム
+    // degree_idx[1..t-1] が決まっていて、その中で回転について最小になる周期が p のとき、 degree_idx[t..] を決める。
+    // degree_idx[0] は番兵で 0 とする。 t が prefix_end を超えたら on_prefix を呼ぶ。
+    int prefix_length = std::min(WHEEL_PREFIX_LENGTH, hubdegree);
+    auto generate = [&](auto &&generate, int t, int p, int prefix_end, vector<int> &degree_idx, auto &&on_prefix) -> void {
+        if (t > prefix_end) {
+            on_prefix(t, p);
             return;
         }
-        for (int i = lowerst_deg_idx;i < (int)possible_degrees.size(); i++) {
-            temp_degree_idx[v] = i;
-            decide_degree(decide_degree, v + 1, lowerst_deg_idx);
-            temp_degree_idx[v] = -1;
+        degree_idx[t] = degree_idx[t - p];
+        generate(generate, t + 1, p, prefix_end, degree_idx, on_prefix);
+        for (int j = degree_idx[t - p] + 1;j < num_degrees; j++) {
+            degree_idx[t] = j;
+            generate(generate, t + 1, t, prefix_end, degree_idx, on_prefix);
         }
+        degree_idx[t] = 0;
+        return;
     };
-    for (int deg_idx = 0;deg_idx < (int)possible_degrees.size();deg_idx++ ) {
-        // degree of 0-th neighbor
-        temp_degree_idx[0] = deg_idx;
-        decide_degree(decide_degree, 1, deg_idx);
-        temp_degree_idx[0] = -1;
-    }
-    return res;
+
+    // prefix (と周期) を辞書順に列挙する。
+    class Prefix {
+    public:
+        vector<int> degree_idx;
+        int t, p;
+    };
+    vector<Prefix> prefixes;
+    vector<int> degree_idx(hubdegree + 1, 0);
+    generate(generate, 1, 1, prefix_length, degree_idx, [&](int t, int p) {
+        prefixes.push_back({degree_idx, t, p});
+    });
+
+    parallelFor((int)prefixes.size(), num_threads, [&](int task) {
+        Wheel base_wheel = Wheel::fromHubDegree(hubdegree);
+        auto temp_degree_idx = prefixes[task].degree_idx;
+        generate(generate, prefixes[task].t, prefixes[task].p, hubdegree, temp_degree_idx, [&](int, int p) {
+            // 周期が hubdegree を割り切るときに necklace になる。
+            if (hubdegree % p == 0) check_wheel(temp_degree_idx, base_wheel, task);
+        });
+        writer.finishTask(task);
+    });
+    return;
 }
 
 // hub の次数が hub_degree で confs を含まない wheel のファイルを output_dirname　ディレクトリに出力する。
-void generateWheels(int hub_degree, const string &confs_dirname, const string &send_cases_dirname, int max_degree, const string &output_dirname) {
+// archive が true のときは wheel ごとのファイルではなく 1 つの archive ファイル (<hub_degree>.wheels) に出力する。
+// wheel の探索は num_threads 個のスレッドで行う。
+void generateWheels(int hub_degree, const Corpus &corpus, int max_degree, const string &output_dirname, int num_threads, bool archive) {
     vector<Degree> possible_degrees;
     for (int deg = 5; deg < max_degree; deg++) possible_degrees.push_back(Degree(deg));
     possible_degrees.push_back(Degree(max_degree, MAX_DEGREE));
 
-    vector<Configuration> confs = getConfs(confs_dirname);
-    vector<Rule> send_cases = getRules(send_cases_dirname);
+    const vector<Configuration> &confs = corpus.confs;
+    const RuleIndex &send_cases = corpus.send_case_index;
 
     // 高速化のため confs の中で直径が 2 以下のもののみ考える。
     vector<Configuration> confs_filetered;
@@ -513,16 +895,15 @@ void generateWheels(int hub_degree, const string &confs_dirname, const string &s
         return conf.diameter() <= 2;
     });
 
-    spdlog::info("calculating wheel which does not contain conf...");
-    auto wheels = searchPossibleOverChargedWheels(hub_degree, possible_degrees, confs, send_cases);
-    
-    spdlog::info("output wheel file into wheel directory");
     bool madedir = fs::create_directory(output_dirname);
     if (madedir) spdlog::info("made {} directory", output_dirname);
-    int count = 0;
-    for (auto &wheel : wheels) {
-        wheel.writeWheelFile(fmt::format("{}/{}_{}.wheel", output_dirname, hub_degree, count++));
-    }
+
+    // 見つかった wheel から順に wheel directory に書き出す。
+    spdlog::info("calculating wheel which does not contain conf...");
+    WheelWriter writer(output_dirname, hub_degree, max_degree, archive);
+    searchPossibleOverChargedWheels(hub_degree, possible_degrees, corpus.conf_index, send_cases, num_threads, writer);
+    int count = writer.close();
+    spdlog::info("wrote {} wheels into {}", count, output_dirname);
     return;
 }
 
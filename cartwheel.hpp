@@ -1,10 +1,18 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <mutex>
+#include <chrono>
+#include <memory>
 #include "basewheel.hpp"
 #include "near_triangulation.hpp"
 #include "configuration.hpp"
 #include "rule.hpp"
+#include "corpus.hpp"
+#include "wheel_archive.hpp"
+#include "result.hpp"
+#include "checkpoint.hpp"
+#include "scheduler.hpp"
 
 using std::vector;
 using std::string;
@@ -23,15 +31,49 @@ private:
 public:
     Wheel(const NearTriangulation &wheel);
     static Wheel readWheelFile(const string &filename);
+    static Wheel readWheelArchive(const WheelArchive &archive, int index);
     static Wheel fromHubDegree(int hub_degree);
+    static Wheel fromNeighborDegrees(const vector<Degree> &neighbor_degrees);
     void writeWheelFile(const string &filename) const;
 
     string toString(void) const;
-    void setDegree(int v, const optional<Degree> &degree);
+    void setDegree(int v, const Degree &degree);
     const NearTriangulation &nearTriangulation(void) const;
     int numNeighbor(void) const;
 };
 
+// WheelWriter
+// generateWheels で見つかった wheel を見つかった順にファイル (<hub_degree>_<index>.wheel) に書き出す。
+// archive を指定したときは 1 つの archive ファイル (<hub_degree>.wheels) に書き出す。
+// wheel は探索のタスクごとに受け取り、 1 スレッドで探索したときと同じ順番に番号を付ける。
+// 書き出す wheel はバッファにため、 WHEEL_FLUSH_SIZE 個たまるか前回から WHEEL_FLUSH_INTERVAL 経ったときにまとめて書く。
+// 最後に <hub_degree>.summary に wheel の数などを書くので、これがあれば生成が終わっている。
+class WheelWriter {
+private:
+    string output_dirname_;
+    int hub_degree_, max_degree_;
+    std::unique_ptr<WheelArchiveWriter> archive_;
+    std::mutex mutex_;
+    // next_task_ より前のタスクは全て終わっていて、その wheel はバッファに入っているか書き出されている。
+    int next_task_;
+    vector<bool> finished_;
+    // pending_[task] := next_task_ より後のタスクで見つかった wheel
+    vector<vector<Wheel>> pending_;
+    vector<Wheel> buffer_;
+    // ファイルに書き出した wheel の数
+    int count_;
+    std::chrono::steady_clock::time_point start_, last_flush_;
+
+    void reserveTask(int task);
+    void flush(void);
+    void flushIfNeeded(void);
+public:
+    WheelWriter(const string &output_dirname, int hub_degree, int max_degree, bool archive);
+    void write(int task, const Wheel &wheel);
+    void finishTask(int task);
+    int close(void);
+};
+
 // CartWheel
 // hub とその neighbor, second neighbor, third neighbor からなるグラフ
 class CartWheel {
@@ -39,27 +81,33 @@ private:
     NearTriangulation cartwheel_;
     int num_neighbor_;
     // hub の neighbor の　neighbor のうち、hub の second-neighbor を時計回りに並べたもの。
-    vector<vector<int>> hub_neighbors_neighbors_;
+    // hub_neighbors_neighbors_, third_neighbors_ は setDegree では変わらないので、コピーしたものとは共有する。
+    std::shared_ptr<const vector<vector<int>>> hub_neighbors_neighbors_;
     // hub の次数7の neighbor v について second-neighbor ( hub からは third-neighbor ) を格納しておく。
     // 具体的には u \in hub_neighbors_neighbors_[v] としたとき
     // third_neighbors[u] := u の neighbor で hub の third-neighbr を時計回りに並べたもの。
-    vector<vector<int>> third_neighbors_;
+    std::shared_ptr<const vector<vector<int>>> third_neighbors_;
 public:
     CartWheel(int num_neighbor, const vector<vector<int>> &hub_neighbors_neighbors, const NearTriangulation &cartwheel);
     static CartWheel fromWheel(const Wheel &wheel);
 
     string toString(const vector<bool> &show_degree) const;
     string toString(void) const;
-    void setDegree(int v, const optional<Degree> &degree);
+    void setDegree(int v, const Degree &degree);
     const NearTriangulation &nearTriangulation(void) const;
     int numNeighbor(void) const;
     const vector<vector<int>> &hubNeighborsNeighbors(void) const;
     const vector<vector<int>> &thirdNeighbors(void) const;
 
     void extendThirdNeighbor(void);
-    pair<bool, vector<bool>> isOvercharged(const vector<Rule> &rules) const;
+    pair<bool, vector<bool>> isOvercharged(const RuleIndex &rules) const;
 };
 
 int chargeInitial(int degree);
-void evaluateWheel(const string &wheel_filename, const string &rules_dirname, const string &send_cases_dirname, const string &confs_dirname, int max_degree);
-void generateWheels(int hub_degree, const string &confs_dirname, const string &send_cases_dirname, int max_degree, const string &output_dirname);
+void evaluateWheel(const string &wheel_filename, const Corpus &corpus, int max_degree, int num_search_threads, const string &result_filename, const Checkpointer &checkpointer);
+void evaluateWheels(const vector<string> &wheel_filenames, const Corpus &corpus, int max_degree, int num_threads, int num_search_threads, const string &log_dirname, const string &result_filename, const Checkpointer &checkpointer, const ScheduleOptions &schedule);
+void evaluateWheelArchive(const string &archive_filename, const vector<int> &indexes, const Corpus &corpus, int max_degree, int num_threads, int num_search_threads, const string &log_dirname, const string &result_filename, const Checkpointer &checkpointer, const ScheduleOptions &schedule);
+WheelEstimate estimateWheel(const Wheel &wheel, const Corpus &corpus, int max_degree, int num_probes, uint64_t seed);
+void estimateWheels(const vector<string> &wheel_filenames, const Corpus &corpus, int max_degree, int num_threads, int num_probes, const string &estimate_filename);
+void estimateWheelArchive(const string &archive_filename, const vector<int> &indexes, const Corpus &corpus, int max_degree, int num_threads, int num_probes, const string &estimate_filename);
+void generateWheels(int hub_degree, const Corpus &corpus, int max_degree, const string &output_dirname, int num_threads, bool archive);
@@ -3,6 +3,11 @@
 #
 # The script is used to make sure the hub of each wheel has charge at most 0.
 # If the hub of all wheels has charge at most 0, the message "All finished" is displayed.
+# The number of wheels is read from ./proj_wheel/<The degree of the hub>.summary (written by enum_wheel.sh),
+# or counted from ./proj_wheel/<The degree of the hub>_*.wheel if there is no summary (e.g. the shipped ./proj_wheel),
+# and the wheels of index 0, 1, ..., (the number of wheels) - 1 are checked.
+# If ./proj_log/<The degree of the hub>.results.jsonl (written by discharge.sh) exists, the results are aggregated from it
+# and the wheels which are not finished are written into the output file.
 # 
 # Usage)
 # bash charge_result.sh proj <The degree of the hub> <The output file>
@@ -21,9 +26,27 @@ fi
 
 
 if [ "$1" = "proj" ]; then
-    num_wheel=(0 0 0 0 0 0 0 4703 6530 5435 3079 1036)
+    summary="./proj_wheel/$2.summary"
+    if [ -f "$summary" ]; then
+        n=$(awk '$1 == "wheels" {print $2}' "$summary")
+    else
+        # the wheels enumerated without summary (the shipped ./proj_wheel) are numbered 0, 1, ..., n - 1
+        n=$(find ./proj_wheel -maxdepth 1 -name "$2_*.wheel" | wc -l)
+        if [ "$n" -eq 0 ]; then
+            echo -e "\e[31merror:\e[m neither $summary nor ./proj_wheel/$2_*.wheel exists. Enumerate the wheels by enum_wheel.sh first"
+            exit 1
+        fi
+    fi
+    # the index of the last wheel
+    last=$(( n - 1 ))
+    results="./proj_log/$2.results.jsonl"
+    if [ -f "$results" ]; then
+        # aggregate the results written by discharge.sh in one pass
+        ./build/a.out --aggregate "$results" -d "$2" -b 0 -e "$last" --remaining "$3"
+        exit 0
+    fi
     sum=0
-    for i in $(seq 0 ${num_wheel["$2"]}); do
+    for i in $(seq 0 "$last"); do
         a=$(grep 'the ratio of overcharged cartwheel 0/' "./proj_log/$2_$i.wheel.log" | wc -l) && true
         if [ $a -ne 1 ]; then
             echo "$i has overcharged cartwheel" >> "$3"
@@ -0,0 +1,227 @@
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include "checkpoint.hpp"
+#include "log.hpp"
+
+namespace fs = std::filesystem;
+
+// checkpoint ファイルの先頭に置く識別子
+const char CHECKPOINT_MAGIC[8] = {'D', 'I', 'S', 'C', 'H', 'C', 'K', 'P'};
+
+// checkpoint は int32 の列 (リトルエンディアン) として書き出す。
+//
+// magic (8 byte) version (fingerprint の長さ) fingerprint done
+// (results の数) task ... (frontier の数) task ...
+//
+// task := depth (charges の数) charge ... (path の長さ) path ... N (deg_lower deg_upper) * N
+// 次数が定まっていない頂点は deg_lower = deg_upper = 0 とする。
+class CheckpointWriter {
+private:
+    std::ofstream ofs_;
+
+public:
+    CheckpointWriter(const string &filename) : ofs_(filename, std::ios::binary) {
+        if (!ofs_) {
+            spdlog::critical("Failed to open {}", filename);
+            throw std::runtime_error("Failed to open " + filename);
+        }
+    }
+
+    bool good(void) const {
+        return (bool)ofs_;
+    }
+
+    void writeBytes(const void *src, size_t n) {
+        ofs_.write(static_cast<const char *>(src), n);
+    }
+
+    void writeInt(int32_t value) {
+        writeBytes(&value, sizeof(value));
+    }
+
+    void writeInts(const vector<int> &values) {
+        writeInt((int32_t)values.size());
+        for (int value : values) writeInt(value);
+    }
+
+    void writeString(const string &str) {
+        writeInt((int32_t)str.size());
+        writeBytes(str.data(), str.size());
+    }
+
+    void writeTask(const CheckpointTask &task) {
+        writeInt(task.depth);
+        writeInts(task.charges);
+        writeInts(task.path);
+        writeInt((int32_t)task.degrees.size());
+        for (const auto &degree : task.degrees) {
+            writeInt(degree.unset() ? 0 : degree.lower());
+            writeInt(degree.unset() ? 0 : degree.upper());
+        }
+    }
+};
+
+class CheckpointReader {
+private:
+    std::ifstream ifs_;
+    string filename_;
+
+public:
+    CheckpointReader(const string &filename) : ifs_(filename, std::ios::binary), filename_(filename) {
+        if (!ifs_) {
+            spdlog::critical("Failed to open {}", filename);
+            throw std::runtime_error("Failed to open " + filename);
+        }
+    }
+
+    void readBytes(void *dst, size_t n) {
+        ifs_.read(static_cast<char *>(dst), n);
+        if (!ifs_) {
+            spdlog::critical("{} is truncated", filename_);
+            throw std::runtime_error(filename_ + " is truncated");
+        }
+    }
+
+    int readInt(void) {
+        int32_t value;
+        readBytes(&value, sizeof(value));
+        return value;
+    }
+
+    vector<int> readInts(void) {
+        vector<int> values(readInt());
+        for (int &value : values) value = readInt();
+        return values;
+    }
+
+    string readString(void) {
+        string str(readInt(), '\0');
+        readBytes(str.data(), str.size());
+        return str;
+    }
+
+    CheckpointTask readTask(void) {
+        CheckpointTask task;
+        task.depth = readInt();
+        task.charges = readInts();
+        task.path = readInts();
+        task.degrees.resize(readInt());
+        for (auto &degree : task.degrees) {
+            int lower = readInt();
+            int upper = readInt();
+            if (lower != 0) degree = Degree(lower, upper);
+        }
+        return task;
+    }
+};
+
+Checkpointer::Checkpointer(void) : dirname_(""), interval_(0), resume_(false) {}
+
+Checkpointer::Checkpointer(const string &dirname, int interval_seconds, bool resume)
+    : dirname_(dirname), interval_(interval_seconds), resume_(resume) {}
+
+bool Checkpointer::enabled(void) const {
+    return dirname_ != "";
+}
+
+// 途中経過を保存する間隔
+std::chrono::seconds Checkpointer::interval(void) const {
+    return interval_;
+}
+
+// dirname の下のディレクトリ name に保存する Checkpointer を返す。 (wheel ごとに分けるときに使う。)
+Checkpointer Checkpointer::sub(const string &name) const {
+    if (!enabled()) return *this;
+    return Checkpointer((fs::path(dirname_) / name).string(), interval_.count(), resume_);
+}
+
+string Checkpointer::path(const string &name, const string &extension) const {
+    return (fs::path(dirname_) / (name + extension)).string();
+}
+
+// 書きかけのファイルで前の checkpoint を壊さないように、一時ファイルに書いてから名前を変える。
+void Checkpointer::write(const string &name, const string &extension, const string &fingerprint, const SearchCheckpoint &checkpoint) const {
+    fs::create_directories(dirname_);
+    string filename = path(name, extension);
+    {
+        CheckpointWriter writer(filename + ".tmp");
+        writer.writeBytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        writer.writeInt(CHECKPOINT_VERSION);
+        writer.writeString(fingerprint);
+        writer.writeInt(checkpoint.done);
+        writer.writeInt((int32_t)checkpoint.results.size());
+        for (const auto &task : checkpoint.results) writer.writeTask(task);
+        writer.writeInt((int32_t)checkpoint.frontier.size());
+        for (const auto &task : checkpoint.frontier) writer.writeTask(task);
+        if (!writer.good()) {
+            spdlog::critical("Failed to write {}", filename);
+            throw std::runtime_error("Failed to write " + filename);
+        }
+    }
+    fs::rename(filename + ".tmp", filename);
+    return;
+}
+
+// resume のとき、探索 name の途中経過 (終わっていれば結果) を返す。
+// 保存されていないか resume でないときは std::nullopt を返す。
+optional<SearchCheckpoint> Checkpointer::load(const string &name, const string &fingerprint) const {
+    if (!enabled() || !resume_) return std::nullopt;
+    for (const char *extension : {".done", ".ckpt"}) {
+        string filename = path(name, extension);
+        if (!fs::exists(filename)) continue;
+        CheckpointReader reader(filename);
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        reader.readBytes(magic, sizeof(magic));
+        if (std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+            spdlog::critical("{} is not a checkpoint file", filename);
+            throw std::runtime_error(filename + " is not a checkpoint file");
+        }
+        int version = reader.readInt();
+        if (version != CHECKPOINT_VERSION) {
+            spdlog::critical("The version of {} is {} (expected {}). Remove the checkpoint and search again", filename, version, CHECKPOINT_VERSION);
+            throw std::runtime_error("Version mismatch of " + filename);
+        }
+        if (reader.readString() != fingerprint) {
+            spdlog::critical("{} is a checkpoint of another search. Remove the checkpoint and search again", filename);
+            throw std::runtime_error("Fingerprint mismatch of " + filename);
+        }
+        SearchCheckpoint checkpoint;
+        checkpoint.done = reader.readInt();
+        checkpoint.results.resize(reader.readInt());
+        for (auto &task : checkpoint.results) task = reader.readTask();
+        checkpoint.frontier.resize(reader.readInt());
+        for (auto &task : checkpoint.frontier) task = reader.readTask();
+        LOG_DEBUG("resume {} ({} results, {} pending)", filename, checkpoint.results.size(), checkpoint.frontier.size());
+        return checkpoint;
+    }
+    return std::nullopt;
+}
+
+// 探索 name の途中経過を保存する。
+void Checkpointer::save(const string &name, const string &fingerprint, const SearchCheckpoint &checkpoint) const {
+    if (!enabled()) return;
+    write(name, ".ckpt", fingerprint, checkpoint);
+    LOG_DEBUG("saved checkpoint {} ({} results, {} pending)", path(name, ".ckpt"), checkpoint.results.size(), checkpoint.frontier.size());
+    return;
+}
+
+// 探索 name が終わったときに結果を保存し、途中経過を消す。
+void Checkpointer::finish(const string &name, const string &fingerprint, const vector<CheckpointTask> &results) const {
+    if (!enabled()) return;
+    SearchCheckpoint checkpoint;
+    checkpoint.done = true;
+    checkpoint.results = results;
+    write(name, ".done", fingerprint, checkpoint);
+    fs::remove(path(name, ".ckpt"));
+    return;
+}
+
+// 保存した途中経過と結果を全て消す。 (全ての探索が終わって結果を出力した後に呼ぶ。)
+void Checkpointer::clear(void) const {
+    if (!enabled()) return;
+    fs::remove_all(dirname_);
+    return;
+}
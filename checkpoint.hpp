@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <optional>
+#include <chrono>
+#include "near_triangulation.hpp"
+
+using std::string;
+using std::vector;
+using std::optional;
+
+// checkpoint ファイルの形式のバージョン。形式を変えたら上げる。
+const int CHECKPOINT_VERSION = 1;
+
+// 探索木の節点 (まだ探索していない節点か、探索が終わって結果になった葉)
+// 1 回の探索で扱うグラフは全て同じ形 (次数だけが違う) なので、次数だけを持つ。
+// depth, charges は探索ごとの状態で、 path は根からの子の番号の列 (結果を 1 スレッドで探索したときの順番に並べるのに使う。)
+class CheckpointTask {
+public:
+    vector<Degree> degrees;
+    int depth = 0;
+    vector<int> charges;
+    vector<int> path;
+};
+
+// 1 回の探索の途中経過
+// done が true のときは探索が終わっていて、 results が全ての結果。
+class SearchCheckpoint {
+public:
+    bool done = false;
+    vector<CheckpointTask> frontier;
+    vector<CheckpointTask> results;
+};
+
+// 長時間かかる探索の途中経過を dirname のファイルに保存し、 resume のときはそこから再開する。
+// 探索は名前 (name) で区別し、途中経過を <name>.ckpt に、終わった探索の結果を <name>.done に書く。
+// 保存した時の探索の入力と違う入力で再開しないように、入力を表す文字列 (fingerprint) も書いておく。
+// dirname が空のときは何もしない。
+class Checkpointer {
+private:
+    string dirname_;
+    std::chrono::seconds interval_;
+    bool resume_;
+
+    string path(const string &name, const string &extension) const;
+    void write(const string &name, const string &extension, const string &fingerprint, const SearchCheckpoint &checkpoint) const;
+
+public:
+    Checkpointer(void);
+    Checkpointer(const string &dirname, int interval_seconds, bool resume);
+
+    bool enabled(void) const;
+    std::chrono::seconds interval(void) const;
+    Checkpointer sub(const string &name) const;
+    optional<SearchCheckpoint> load(const string &name, const string &fingerprint) const;
+    void save(const string &name, const string &fingerprint, const SearchCheckpoint &checkpoint) const;
+    void finish(const string &name, const string &fingerprint, const vector<CheckpointTask> &results) const;
+    void clear(void) const;
+};
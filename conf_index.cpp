@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <climits>
+#include <cassert>
+#include <tuple>
+#include <spdlog/spdlog.h>
+#include "conf_index.hpp"
+#include "search_stats.hpp"
+#include "log.hpp"
+
+// BaseWheel::containSubgraphWithCorrespondingEdge の match_degree (detect_possible = false) と同じ判定をする。
+bool ConfIndex::VertexCondition::accept(const Degree &degree_wheelgraph) const {
+    if (degree.unset()) return true;
+    if (degree_wheelgraph.unset()) return false;
+    return degree.include(degree_wheelgraph);
+}
+
+bool ConfIndex::VertexCondition::operator==(const VertexCondition &other) const {
+    return !(*this < other) && !(other < *this);
+}
+
+bool ConfIndex::VertexCondition::operator<(const VertexCondition &other) const {
+    auto key = [](const VertexCondition &cond) {
+        return std::make_pair(cond.except, cond.degree.mask());
+    };
+    return key(*this) < key(other);
+}
+
+bool ConfIndex::Block::operator==(const Block &other) const {
+    if (step.edge != other.step.edge || step.diagonals.size() != other.step.diagonals.size()) return false;
+    for (int k = 0;k < step.diagonals.size(); k++) {
+        if (step.diagonals[k] != other.step.diagonals[k]
+         || step.first_edgeids[k] != other.step.first_edgeids[k]
+         || step.second_edgeids[k] != other.step.second_edgeids[k]) return false;
+    }
+    return first_vertex == other.first_vertex && new_vertices == other.new_vertices;
+}
+
+// 照合の手順の木をたどる作業領域
+// スレッドごとに 1 つ持って呼び出しの間で使い回すので、 wheelgraph の大きさが変わらなければメモリを確保しない。
+class ConfNetworkScratch {
+public:
+    // 辺をたどる途中の状態 (BaseWheel::containSubgraphWithCorrespondingEdge と同じ。)
+    // vs_matches[k], new_matches は diagonal vertex の組を対応させた数 (no-4-cut の仮定の確認に使う。)
+    class Frame {
+    public:
+        int edgeid_w, edgeid_s, next_pair;
+        std::array<int8_t, 2> vs_matches;
+        int8_t new_matches;
+    };
+
+    // 子の節点ごとに分かれるときに残しておく状態
+    class Snapshot {
+    public:
+        vector<int> located, occupied;
+        vector<uint8_t> visited;
+        vector<Frame> stack;
+    };
+
+    // located[vs] : 番号を付け直した conf の頂点 vs に対応している wheelgraph の頂点
+    // occupied[vw] : wheelgraph の頂点 vw に対応している conf の頂点
+    // visited[es] : 番号を付け直した conf の辺 es を訪れたか
+    vector<int> located, occupied;
+    vector<uint8_t> visited;
+    vector<Frame> stack;
+    // 今いる節点までの block の手順 (path[i] := block i の手順) と、そこで現れた頂点の次数の条件
+    vector<const MatchPlan::EdgeStep *> path;
+    vector<std::pair<Degree, bool>> conditions;
+    // snapshots[level] := 深さ level で子の節点ごとに分かれるときの状態
+    vector<Snapshot> snapshots;
+
+    void save(Snapshot &snapshot) const {
+        snapshot.located.assign(located.begin(), located.end());
+        snapshot.occupied.assign(occupied.begin(), occupied.end());
+        snapshot.visited.assign(visited.begin(), visited.end());
+        snapshot.stack.assign(stack.begin(), stack.end());
+    }
+
+    void restore(const Snapshot &snapshot) {
+        located.assign(snapshot.located.begin(), snapshot.located.end());
+        occupied.assign(snapshot.occupied.begin(), snapshot.occupied.end());
+        visited.assign(snapshot.visited.begin(), snapshot.visited.end());
+        stack.assign(snapshot.stack.begin(), snapshot.stack.end());
+    }
+};
+
+static ConfNetworkScratch &confNetworkScratch(void) {
+    thread_local ConfNetworkScratch scratch;
+    return scratch;
+}
+
+// conf の照合の手順 (matchPlan) の辺と頂点に、 inside edge から深さ優先でたどる順に番号を付け直して block の列を返す。
+// 辺をたどるときは containSubgraphWithCorrespondingEdge と同じく diagonal vertex の順に次の 2 辺をたどり、
+// 辺の番号はたどった順、頂点の番号は初めて現れた順に付ける。
+// (containSubgraphWithCorrespondingEdge が block i の手順を見るときには、そこで見る頂点は block i 以前に現れている。)
+// required_depth には対応が必要な頂点が全て現れる block の数を入れる。 inside edge からたどれない頂点があるときは INT_MAX 。
+vector<ConfIndex::Block> ConfIndex::compile(const Configuration &conf, int &required_depth) const {
+    const MatchPlan &plan = conf.matchPlan();
+    vector<int> edge_label(plan.numEdges(), -1), vertex_label(plan.vertexSize(), -1), vertex_block(plan.vertexSize(), -1);
+    vector<int> order;
+    int num_vertices = 0;
+    auto label_vertex = [&](int v, int block) {
+        if (vertex_label[v] != -1) return;
+        vertex_label[v] = num_vertices++;
+        vertex_block[v] = block;
+    };
+    auto visit = [&](auto &&visit, int edgeid) -> void {
+        int block = (int)order.size();
+        edge_label[edgeid] = block;
+        order.push_back(edgeid);
+        const auto &step = plan.step(edgeid);
+        if (block == 0) {
+            label_vertex(step.edge.first, 0);
+            label_vertex(step.edge.second, 0);
+        }
+        for (int vs : step.diagonals) label_vertex(vs, block);
+        for (int k = 0;k < step.diagonals.size(); k++) {
+            if (edge_label[step.first_edgeids[k]] == -1) visit(visit, step.first_edgeids[k]);
+            if (edge_label[step.second_edgeids[k]] == -1) visit(visit, step.second_edgeids[k]);
+        }
+    };
+    visit(visit, conf.getInsideEdgeId());
+
+    required_depth = 0;
+    for (int v : plan.requiredVertices()) {
+        required_depth = vertex_block[v] == -1 ? INT_MAX : std::max(required_depth, vertex_block[v] + 1);
+        if (required_depth == INT_MAX) break;
+    }
+    vector<bool> required(plan.vertexSize(), false);
+    for (int v : plan.requiredVertices()) required[v] = true;
+
+    // 頂点の番号は block の順に付けたので、 block ごとに連続している。
+    vector<int> labeled_vertices(num_vertices);
+    for (int v = 0;v < plan.vertexSize(); v++) {
+        if (vertex_label[v] != -1) labeled_vertices[vertex_label[v]] = v;
+    }
+    vector<Block> blocks(order.size());
+    for (auto &block : blocks) block.first_vertex = 0;
+    for (int label = 0;label < num_vertices; label++) {
+        int v = labeled_vertices[label];
+        auto &block = blocks[vertex_block[v]];
+        if (block.new_vertices.empty()) block.first_vertex = label;
+        block.new_vertices.push_back(VertexCondition{plan.condition(v), !required[v]});
+    }
+    for (int b = 0;b < (int)order.size(); b++) {
+        const auto &step = plan.step(order[b]);
+        auto &block = blocks[b];
+        block.step.edge = {vertex_label[step.edge.first], vertex_label[step.edge.second]};
+        for (int k = 0;k < step.diagonals.size(); k++) {
+            block.step.diagonals.push_back(vertex_label[step.diagonals[k]]);
+            block.step.first_edgeids[k] = edge_label[step.first_edgeids[k]];
+            block.step.second_edgeids[k] = edge_label[step.second_edgeids[k]];
+        }
+        for (int k = step.diagonals.size();k < 2; k++) block.step.first_edgeids[k] = block.step.second_edgeids[k] = -1;
+    }
+    return blocks;
+}
+
+// confs から索引を作る。
+ConfIndex::ConfIndex(const vector<Configuration> &confs) : num_confs_((int)confs.size()), max_radius_(0), max_vertices_(0), max_edges_(0), fingerprint_(CONTENT_HASH_SEED) {
+    int num_skipped = 0;
+    for (int conf_idx = 0;conf_idx < (int)confs.size(); conf_idx++) {
+        const auto &conf = confs[conf_idx];
+        conf_names_.push_back(conf.fileName());
+        fingerprint_ = hashInt(fingerprint_, conf.ringSize());
+        fingerprint_ = hashInt(fingerprint_, conf.getInsideEdgeId());
+        fingerprint_ = hashInt(fingerprint_, conf.hasCutVertex());
+        fingerprint_ = conf.nearTriangulation().contentHash(fingerprint_);
+        int required_depth;
+        vector<Block> blocks = compile(conf, required_depth);
+        // inside edge からたどれない頂点がある conf はどこにも含まれない。
+        if (required_depth == INT_MAX) {
+            num_skipped++;
+            continue;
+        }
+        // conf が含まれるときは conf の辺は wheel の辺に対応するので、 wheel での距離は conf の直径以下になる。
+        // カット点を持つときは ring の頂点が対応しないことがあり、 ring の頂点を除いた直径では足りないので conf の頂点数で抑える。
+        int radius = conf.hasCutVertex() ? conf.nearTriangulation().vertexSize() - 1 : conf.diameter();
+        max_radius_ = std::max(max_radius_, radius);
+
+        // block 0 の最初の 2 頂点が inside edge の始点、終点
+        std::array<VertexCondition, 2> endpoints = {blocks[0].new_vertices[0], blocks[0].new_vertices[1]};
+        auto root = std::find_if(roots_.begin(), roots_.end(), [&](const EndpointNode &node) {
+            return node.endpoints == endpoints;
+        });
+        if (root == roots_.end()) {
+            std::array<uint32_t, 2> degree_classes = {acceptedDegreeClasses(endpoints[0].degree, false), acceptedDegreeClasses(endpoints[1].degree, false)};
+            roots_.push_back({endpoints, degree_classes, 0, {}});
+            root = roots_.end() - 1;
+        }
+        root->radius = std::max(root->radius, radius);
+
+        // block の列に沿って木を下り、なければ節点を作る。 (nodes_ は伸びるので添字で扱う。)
+        int node_idx = -1;
+        for (int depth = 1;depth <= (int)blocks.size(); depth++) {
+            auto children = [&]() -> vector<int> & {
+                return node_idx == -1 ? root->children : nodes_[node_idx].children;
+            };
+            const Block &block = blocks[depth - 1];
+            auto child = std::find_if(children().begin(), children().end(), [&](int idx) {
+                return nodes_[idx].block == block;
+            });
+            int child_idx;
+            if (child == children().end()) {
+                int num_vertices = (node_idx == -1 ? 0 : nodes_[node_idx].num_vertices) + (int)block.new_vertices.size();
+                child_idx = (int)nodes_.size();
+                nodes_.push_back(Node{block, depth, num_vertices, INT_MAX, -1, {}, {}});
+                children().push_back(child_idx);
+            } else {
+                child_idx = *child;
+            }
+            node_idx = child_idx;
+            auto &node = nodes_[node_idx];
+            if (required_depth < node.min_required_depth) {
+                node.min_required_depth = required_depth;
+                node.min_required_conf = conf_idx;
+            }
+            max_vertices_ = std::max(max_vertices_, node.num_vertices);
+        }
+        nodes_[node_idx].conf_idxes.push_back(conf_idx);
+        max_edges_ = std::max(max_edges_, (int)blocks.size());
+    }
+    if (num_skipped > 0) LOG_DEBUG("{} confs have vertices not reachable from the inside edge and are never contained", num_skipped);
+    LOG_DEBUG("compiled {} confs into {} nodes", confs.size(), numNodes());
+}
+
+int ConfIndex::numConfs(void) const {
+    return num_confs_;
+}
+
+int ConfIndex::numNodes(void) const {
+    return (int)roots_.size() + (int)nodes_.size();
+}
+
+uint64_t ConfIndex::fingerprint(void) const {
+    return fingerprint_;
+}
+
+// ring の頂点を除いて、いずれかの conf が wheelgraph に含まれているか判定する。
+// BaseWheel::containConf を全ての conf について呼んだ結果と一致する。
+bool ConfIndex::containedIn(const NearTriangulation &wheelgraph) const {
+    return containedIn(wheelgraph, {});
+}
+
+// wheelgraph から changed_vertices の頂点の次数だけを変える前のグラフが、どの conf も含んでいなかったとき、
+// wheelgraph がいずれかの conf を含んでいるか判定する。
+// 新しく含まれる conf は changed_vertices のいずれかの頂点を使うので、そこから conf の半径以内にある辺だけを対応させる。
+// (conf ごとではなく 1 段目の節点ごとに半径の最大値で絞り込むが、前のグラフがどの conf も含まないので結果は変わらない。)
+bool ConfIndex::containedInAround(const NearTriangulation &wheelgraph, const vector<int> &changed_vertices) const {
+    if (changed_vertices.empty()) return false;
+    return containedIn(wheelgraph, wheelgraph.distancesFrom(changed_vertices, max_radius_));
+}
+
+// 子の節点 node_idx に下りる。 (block と、そこで現れた頂点の次数の条件を作業領域に置く。)
+void ConfIndex::descend(int node_idx) const {
+    auto &scratch = confNetworkScratch();
+    const Node &node = nodes_[node_idx];
+    scratch.path[node.depth - 1] = &node.block.step;
+    for (int t = 0;t < (int)node.block.new_vertices.size(); t++) {
+        const auto &cond = node.block.new_vertices[t];
+        scratch.conditions[node.block.first_vertex + t] = {cond.degree, cond.except};
+    }
+    return;
+}
+
+// 節点 node_idx まで下りた状態から、作業領域の stack に積んだ辺の組をたどって対応を広げ、
+// 節点 node_idx の部分木のいずれかの conf が含まれていれば true を返す。
+// 辺のたどり方は BaseWheel::containSubgraphWithCorrespondingEdge と同じで、部分木の conf はまだ決まっていない block を見るまで同じようにたどる。
+// 決まっていない block を見るときは子の節点に下り、子が複数あれば状態を snapshots[level] に残して子ごとに続ける。
+bool ConfIndex::matchFrom(const NearTriangulation &wheelgraph, int node_idx, int level) const {
+    auto &scratch = confNetworkScratch();
+    auto &located = scratch.located, &occupied = scratch.occupied;
+    auto &stack = scratch.stack;
+    const auto &degrees = wheelgraph.degrees();
+    while (!stack.empty()) {
+        auto frame = stack.back();
+        if (frame.next_pair == -1 && scratch.visited[frame.edgeid_s]) {
+            stack.pop_back();
+            continue;
+        }
+        if (frame.edgeid_s >= nodes_[node_idx].depth) {
+            // block edgeid_s は部分木の conf ごとに異なりうるので、子の節点に下りる。
+            const auto &children = nodes_[node_idx].children;
+            assert(!children.empty());
+            for (int i = 0;i + 1 < (int)children.size(); i++) {
+                if ((int)scratch.snapshots.size() <= level) scratch.snapshots.resize(level + 1);
+                scratch.save(scratch.snapshots[level]);
+                descend(children[i]);
+                if (matchFrom(wheelgraph, children[i], level + 1)) return true;
+                scratch.restore(scratch.snapshots[level]);
+            }
+            node_idx = children.back();
+            descend(node_idx);
+            continue;
+        }
+        stack.pop_back();
+        if (frame.next_pair == -1) {
+            scratch.visited[frame.edgeid_s] = 1;
+            frame.next_pair = 0;
+            frame.vs_matches = {0, 0};
+            frame.new_matches = 0;
+        }
+        const auto &step = *scratch.path[frame.edgeid_s];
+        const auto &diagonal_vertices_w = wheelgraph.diagonalVertices(frame.edgeid_w);
+        int num_diagonals_w = diagonal_vertices_w.size();
+        int num_pairs = step.diagonals.size() * num_diagonals_w;
+        for (int pair_idx = frame.next_pair;pair_idx < num_pairs; pair_idx++) {
+            int k = pair_idx / num_diagonals_w;
+            int vs = step.diagonals[k], vw = diagonal_vertices_w[pair_idx % num_diagonals_w];
+            if (!(located[vs] == -1 && occupied[vw] == -1) && !(located[vs] == vw && occupied[vw] == vs)) continue;
+            // minimal counterexample は 4-cut を持たないので、 diagonal vertex の対応のさせ方は辺ごとに高々 1 通り
+            frame.vs_matches[k]++;
+            if (located[vs] == -1) frame.new_matches++;
+            assert(frame.vs_matches[k] <= 1 && frame.new_matches <= 1);
+            const auto &[degree, except] = scratch.conditions[vs];
+            if (!VertexCondition{degree, except}.accept(degrees[vw])) return false;
+            occupied[vw] = vs;
+            located[vs] = vw;
+            const auto &edge_w = wheelgraph.edges()[frame.edgeid_w];
+            frame.next_pair = pair_idx + 1;
+            stack.push_back(frame);
+            stack.push_back({wheelgraph.edgeId(edge_w.second, vw), step.second_edgeids[k], -1, {0, 0}, 0});
+            stack.push_back({wheelgraph.edgeId(edge_w.first, vw), step.first_edgeids[k], -1, {0, 0}, 0});
+            break;
+        }
+    }
+    // 対応が必要な頂点が全て現れている conf が部分木にあり、ここまでに現れた対応が必要な頂点が全て対応していれば含まれる。
+    const Node &node = nodes_[node_idx];
+    if (node.min_required_depth > node.depth) return false;
+    for (int v = 0;v < node.num_vertices; v++) {
+        if (!scratch.conditions[v].second && located[v] == -1) return false;
+    }
+    LOG_TRACE("contains {}", conf_names_[node.min_required_conf]);
+    return true;
+}
+
+// 深さ 1 の節点 node_idx の conf の inside edge を wheelgraph の辺 edgeid_wheelgraph に対応させて、いずれかの conf が含まれるか判定する。
+// inside edge の端点の次数は呼び出す側で確かめておく。
+// inside edge の diagonal vertex の対応のさせ方は containSubgraphWithCorrespondingEdge と同じく場合分けして、それぞれで matchFrom を呼ぶ。
+bool ConfIndex::matchRoot(const NearTriangulation &wheelgraph, int node_idx, int edgeid_wheelgraph) const {
+    auto &scratch = confNetworkScratch();
+    descend(node_idx);
+    const auto &step = nodes_[node_idx].block.step;
+    const auto &edge_wheelgraph = wheelgraph.edges()[edgeid_wheelgraph];
+    const auto &degrees = wheelgraph.degrees();
+    auto match_degree = [&](int vs, int vw) {
+        const auto &[degree, except] = scratch.conditions[vs];
+        return VertexCondition{degree, except}.accept(degrees[vw]);
+    };
+
+    // inside edge の端点と diagonal vertex の組 pairs を対応させて、辺の組 starts[0], starts[1], ... から対応を広げる。
+    // (次数が適合しない場合分けでは作業領域に触れないように、対応させるときに初期化する。)
+    auto extend = [&](std::initializer_list<pair<int, int>> pairs, std::initializer_list<pair<int, int>> starts) -> bool {
+        auto correspond = [&](int vs, int vw) {
+            scratch.occupied[vw] = vs;
+            scratch.located[vs] = vw;
+        };
+        scratch.located.assign(max_vertices_, -1);
+        scratch.occupied.assign(wheelgraph.vertexSize(), -1);
+        scratch.visited.assign(max_edges_, 0);
+        scratch.stack.clear();
+        correspond(step.edge.first, edge_wheelgraph.first);
+        correspond(step.edge.second, edge_wheelgraph.second);
+        for (auto [vs, vw] : pairs) correspond(vs, vw);
+        for (auto it = std::rbegin(starts);it != std::rend(starts); it++) scratch.stack.push_back({it->first, it->second, -1, {0, 0}, 0});
+        return matchFrom(wheelgraph, node_idx, 0);
+    };
+    const auto &diagonal_vertices_subgraph = step.diagonals;
+    const auto &diagonal_vertices_wheelgraph = wheelgraph.diagonalVertices(edgeid_wheelgraph);
+    int num_diagonals_s = diagonal_vertices_subgraph.size(), num_diagonals_w = diagonal_vertices_wheelgraph.size();
+    if (num_diagonals_s == 1 && num_diagonals_w == 2) {
+        int vs = diagonal_vertices_subgraph[0];
+        for (auto vw : diagonal_vertices_wheelgraph) {
+            if (!match_degree(vs, vw)) continue;
+            if (extend({{vs, vw}},
+                       {{wheelgraph.edgeId(edge_wheelgraph.first, vw), step.first_edgeids[0]},
+                        {wheelgraph.edgeId(edge_wheelgraph.second, vw), step.second_edgeids[0]}})) return true;
+        }
+        return false;
+    }
+    if (num_diagonals_s == 2 && num_diagonals_w == 1) {
+        int vw = diagonal_vertices_wheelgraph[0];
+        for (int k = 0;k < 2; k++) {
+            int vs = diagonal_vertices_subgraph[k];
+            if (!match_degree(vs, vw)) continue;
+            if (extend({{vs, vw}},
+                       {{wheelgraph.edgeId(edge_wheelgraph.first, vw), step.first_edgeids[k]},
+                        {wheelgraph.edgeId(edge_wheelgraph.second, vw), step.second_edgeids[k]}})) return true;
+        }
+        return false;
+    }
+    if (num_diagonals_s == 2 && num_diagonals_w == 2) {
+        int vw0 = diagonal_vertices_wheelgraph[0], vw1 = diagonal_vertices_wheelgraph[1];
+        for (int i = 0;i < 2; i++) {
+            int vs0 = diagonal_vertices_subgraph[i], vs1 = diagonal_vertices_subgraph[1 - i];
+            if (!match_degree(vs0, vw0) || !match_degree(vs1, vw1)) continue;
+            if (extend({{vs0, vw0}, {vs1, vw1}},
+                       {{wheelgraph.edgeId(edge_wheelgraph.first, vw0), step.first_edgeids[i]},
+                        {wheelgraph.edgeId(edge_wheelgraph.second, vw0), step.second_edgeids[i]},
+                        {wheelgraph.edgeId(edge_wheelgraph.first, vw1), step.first_edgeids[1 - i]},
+                        {wheelgraph.edgeId(edge_wheelgraph.second, vw1), step.second_edgeids[1 - i]}})) return true;
+        }
+        return false;
+    }
+    // それ以外のケースでは inside edge から対応を広げる。 (inside edge は番号 0 の辺)
+    // diagonal vertex が 1 点ずつのときは最初にその組を対応させるので、次数が適合しなければ作業領域に触れずに済ませる。
+    if (num_diagonals_s == 1 && num_diagonals_w == 1 && !match_degree(diagonal_vertices_subgraph[0], diagonal_vertices_wheelgraph[0])) return false;
+    return extend({}, {{edgeid_wheelgraph, 0}});
+}
+
+// dist が空でないときは、始点の dist が conf の半径以下の辺だけを対応させる。
+// 1 段目の節点ごとに、端点の次数の分類が適合する wheelgraph の辺だけを見て、その辺に深さ 1 の節点ごとに inside edge を対応させる。
+bool ConfIndex::containedIn(const NearTriangulation &wheelgraph, const vector<int> &dist) const {
+    const auto &degrees = wheelgraph.degrees();
+    int num_edges = (int)wheelgraph.edges().size();
+    auto &scratch = confNetworkScratch();
+    if ((int)scratch.path.size() < max_edges_) scratch.path.resize(max_edges_);
+    if ((int)scratch.conditions.size() < max_vertices_) scratch.conditions.resize(max_vertices_);
+    thread_local vector<int> edgeids;
+    for (const auto &root : roots_) {
+        wheelgraph.edgesInDegreeClasses(root.degree_classes, edgeids);
+        STATS_COUNT(Counter::AnchorSkipped, num_edges - (int)edgeids.size());
+        for (int edgeid_wheelgraph : edgeids) {
+            auto [u, v] = wheelgraph.edges()[edgeid_wheelgraph];
+            if (!dist.empty() && dist[u] > root.radius) {
+                STATS_COUNT(Counter::AnchorSkipped, 1);
+                continue;
+            }
+            if (!root.endpoints[0].accept(degrees[u]) || !root.endpoints[1].accept(degrees[v])) continue;
+            for (int node_idx : root.children) {
+                STATS_COUNT(Counter::AnchorTried, 1);
+                if (matchRoot(wheelgraph, node_idx, edgeid_wheelgraph)) return true;
+            }
+        }
+    }
+    return false;
+}
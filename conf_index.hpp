@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <set>
+#include <array>
+#include <string>
+#include <optional>
+#include "configuration.hpp"
+#include "near_triangulation.hpp"
+#include "match_plan.hpp"
+
+using std::vector;
+using std::set;
+using std::string;
+using std::optional;
+
+// reducible configuration の集合をまとめて照合するための索引 (照合の手順を共有する木)
+// conf の照合の手順 (MatchPlan) の辺と頂点に、 inside edge からたどる順に番号を付け直す。
+// 番号 i の辺をたどるときに見るもの (その辺の手順と、その辺で初めて現れる頂点の次数の条件) を block i とし、
+// block 0, 1, ..., d-1 が同じ conf を木の深さ d の節点にまとめる。
+// wheel の辺ごとに、 containSubgraphWithCorrespondingEdge と同じ順番で辺をたどりながら木を下り、
+// まだ決まっていない block を見るところで子の節点ごとに分かれて続ける。
+// こうして、手順の最初の部分が同じ conf は、その部分の照合を一度だけ行う。
+class ConfIndex {
+private:
+    // 対応させる conf の頂点の次数の条件
+    // degree が Degree() のときはどの次数にも適合する。(次数が定まっていないか、 except_vertices に入っている。)
+    class VertexCondition {
+    public:
+        Degree degree;
+        // except_vertices に入っている (対応する頂点がなくてもよい)
+        bool except;
+
+        bool accept(const Degree &degree_wheelgraph) const;
+        bool operator==(const VertexCondition &other) const;
+        bool operator<(const VertexCondition &other) const;
+    };
+
+    // 番号を付け直した conf の辺 1 本をたどるときに見るもの
+    class Block {
+    public:
+        MatchPlan::EdgeStep step;
+        // この辺で初めて現れる頂点の番号は first_vertex, first_vertex + 1, ... で、その次数の条件が new_vertices
+        // (block 0 は inside edge の始点、終点を含む。)
+        int first_vertex;
+        vector<VertexCondition> new_vertices;
+
+        bool operator==(const Block &other) const;
+    };
+
+    // 照合の手順の木の節点
+    // 深さ depth の節点は block 0, ..., depth-1 が同じ conf の集まりを表す。 block は親から来るときの block depth-1 。
+    class Node {
+    public:
+        Block block;
+        int depth;
+        // block 0, ..., depth-1 で現れる頂点の数
+        int num_vertices;
+        // 部分木の conf について、対応が必要な頂点が全て現れる深さ (required_depth) の最小値と、それを与える conf
+        int min_required_depth;
+        int min_required_conf;
+        vector<int> children;
+        // block の数が depth の conf (葉だけが持つ。)
+        vector<int> conf_idxes;
+    };
+
+    // 1 段目の節点: inside edge の端点の条件
+    // degree_classes は端点の条件に適合しうる次数の分類で、これを使って対応させる wheel の辺を絞り込む。
+    // children は block 0 ごとの深さ 1 の節点 (nodes_ の添字)
+    class EndpointNode {
+    public:
+        std::array<VertexCondition, 2> endpoints;
+        std::array<uint32_t, 2> degree_classes;
+        // 子の conf の radiuses の最大値
+        int radius;
+        vector<int> children;
+    };
+
+    int num_confs_;
+    // conf_names_[i] := i 番目の conf のファイル名 (ログに使う。)
+    vector<string> conf_names_;
+    int max_radius_;
+    vector<EndpointNode> roots_;
+    vector<Node> nodes_;
+    // 番号を付け直した conf の頂点の数、辺の数の最大値
+    int max_vertices_;
+    int max_edges_;
+    // confs の内容 (順番を含む) のハッシュ (checkpoint の fingerprint に使う。)
+    uint64_t fingerprint_;
+
+    vector<Block> compile(const Configuration &conf, int &required_depth) const;
+    void descend(int node_idx) const;
+    bool matchFrom(const NearTriangulation &wheelgraph, int node_idx, int level) const;
+    bool matchRoot(const NearTriangulation &wheelgraph, int node_idx, int edgeid_wheelgraph) const;
+    bool containedIn(const NearTriangulation &wheelgraph, const vector<int> &dist) const;
+
+public:
+    ConfIndex(void) : num_confs_(0), max_radius_(0), max_vertices_(0), max_edges_(0), fingerprint_(CONTENT_HASH_SEED) {};
+    ConfIndex(const vector<Configuration> &confs);
+
+    int numConfs(void) const;
+    int numNodes(void) const;
+    uint64_t fingerprint(void) const;
+    bool containedIn(const NearTriangulation &wheelgraph) const;
+    bool containedInAround(const NearTriangulation &wheelgraph, const vector<int> &changed_vertices) const;
+};
@@ -2,6 +2,7 @@
 #include <filesystem>
 #include <spdlog/spdlog.h>
 #include "configuration.hpp"
+#include "log.hpp"
 
 namespace fs = std::filesystem;
 
@@ -30,8 +31,8 @@ bool confHasCutVertex(int vertex_size, int ring_size, const vector<set<int>> &Vt
         return;
     };
     dfs(dfs, ring_size, -1);
-    spdlog::trace("num : {}", fmt::join(num, ", "));
-    spdlog::trace("low :{}", fmt::join(low, ", "));
+    LOG_TRACE("num : {}", fmt::join(num, ", "));
+    LOG_TRACE("low :{}", fmt::join(low, ", "));
     return has_cutvertex;
 }
 
@@ -51,8 +52,26 @@ Configuration::Configuration(int ring_size, bool has_cutvertex, const string &fi
         }
     }
     assert(inside_edge_id_ < (int)conf_.edges().size());
+    diameter_ = computeDiameter();
+    buildMatchPlan();
 };
 
+// 計算済みの inside_edge_id, diameter から Configuration を構築する。(snapshot から読み込むときに使う。)
+Configuration::Configuration(int ring_size, int inside_edge_id, bool has_cutvertex, int diameter, const string &filename, const NearTriangulation &conf) :
+    conf_(conf), ring_size_(ring_size), inside_edge_id_(inside_edge_id), has_cutvertex_(has_cutvertex), diameter_(diameter), filename_(filename) {
+    assert(inside_edge_id_ < (int)conf_.edges().size());
+    buildMatchPlan();
+}
+
+void Configuration::buildMatchPlan(void) {
+    set<int> ring_vertices;
+    if (has_cutvertex_) {
+        for (int v = 0;v < ring_size_; v++) ring_vertices.insert(v);
+    }
+    match_plan_ = MatchPlan(conf_, ring_vertices);
+    return;
+}
+
 Configuration Configuration::readConfFile(const string &filename) {
     std::ifstream ifs(filename);
     if (!ifs) {
@@ -65,7 +84,7 @@ Configuration Configuration::readConfFile(const string &filename) {
     ifs >> vertex_size >> ring_size;
 
     vector<set<int>> VtoV(vertex_size);
-    vector<optional<Degree>> degrees(vertex_size, std::nullopt);
+    vector<Degree> degrees(vertex_size, Degree());
 
     for (int vi = 0;vi < ring_size; vi++) {
         int vip = (vi + 1) % ring_size;
@@ -89,10 +108,10 @@ Configuration Configuration::readConfFile(const string &filename) {
     }
 
     if (confHasCutVertex(vertex_size, ring_size, VtoV)) {
-        spdlog::trace("has cut vertex");
+        LOG_TRACE("has cut vertex");
         return Configuration(ring_size, true, filename, NearTriangulation(vertex_size, VtoV, degrees));
     }
-    spdlog::trace("has no cut vertex");
+    LOG_TRACE("has no cut vertex");
 
     // delete ring and add - to degree of ring incident vertex
     vector<set<int>> VtoV2(vertex_size - ring_size);
@@ -109,7 +128,7 @@ Configuration Configuration::readConfFile(const string &filename) {
         // primal で
         // (i) 3 本の辺が ring に出ている頂点が configuration に含まれているなら、その頂点の次数を -1 しても reducible である。
         // を使う。
-        int deg = degrees[v].value().upper();
+        int deg = degrees[v].upper();
         if (is_incident_ring && deg - n_adj == 3) {
             degrees[v] = Degree(std::max(deg - 1, MIN_DEGREE), deg);
         }
@@ -133,6 +152,10 @@ int Configuration::getInsideEdgeId(void) const {
     return inside_edge_id_;
 }
 
+const MatchPlan &Configuration::matchPlan(void) const {
+    return match_plan_;
+}
+
 bool Configuration::hasCutVertex(void) const {
     return has_cutvertex_;
 }
@@ -142,9 +165,14 @@ const string &Configuration::fileName(void) const {
 }
 
 
+// configuration の直径 (構築時に計算済み) を返す。
+int Configuration::diameter(void) const {
+    return diameter_;
+}
+
 // configuration の直径を計算する。
 // 注意: ring の頂点を通るパスは考えない。
-int Configuration::diameter(void) const {
+int Configuration::computeDiameter(void) const {
     int vertex_size = conf_.vertexSize();
     int offset = has_cutvertex_ ? ring_size_ : 0;
     vector<vector<int>> dist(vertex_size - offset, vector<int>(vertex_size - offset, 10000));
@@ -177,7 +205,7 @@ vector<Configuration> getConfs(const std::string &dirname) {
     spdlog::info("reading confs from {} ...", dirname);
     for (const fs::directory_entry &file : fs::directory_iterator(dirname)) {
         if (file.is_regular_file() && file.path().extension().string<char>() == ".conf") {
-            spdlog::trace("reading {}", file.path().string<char>());
+            LOG_TRACE("reading {}", file.path().string<char>());
             confs.push_back(Configuration::readConfFile(file.path().string<char>()));
         } 
     }
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include "near_triangulation.hpp"
+#include "match_plan.hpp"
 
 using std::string;
 
@@ -10,10 +11,17 @@ private:
     int ring_size_;
     int inside_edge_id_;
     bool has_cutvertex_;
+    int diameter_;
     string filename_;
+    // conf を照合する手順 (カット点を持つときは ring の頂点を except_vertices とする。)
+    MatchPlan match_plan_;
+
+    int computeDiameter(void) const;
+    void buildMatchPlan(void);
     
 public:
     Configuration(int ring_size, bool has_cutvertex, const string &filename, const NearTriangulation &conf);
+    Configuration(int ring_size, int inside_edge_id, bool has_cutvertex, int diameter, const string &filename, const NearTriangulation &conf);
     static Configuration readConfFile(const string &filename);
 
     const NearTriangulation &nearTriangulation(void) const;
@@ -23,6 +31,7 @@ public:
     int diameter(void) const;
     
     int getInsideEdgeId(void) const;
+    const MatchPlan &matchPlan(void) const;
 };
 
 vector<Configuration> getConfs(const std::string &dirname);
@@ -0,0 +1,277 @@
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <iterator>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include "corpus.hpp"
+
+namespace fs = std::filesystem;
+
+// snapshot ファイルの先頭に置く識別子
+const char SNAPSHOT_MAGIC[8] = {'D', 'I', 'S', 'C', 'H', 'S', 'N', 'P'};
+// snapshot ファイルの先頭 (SNAPSHOT_MAGIC と SNAPSHOT_VERSION) の大きさ
+const int SNAPSHOT_HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + sizeof(int32_t);
+
+// rules_dirname, send_cases_dirname, confs_dirname のファイルを読み込む。
+// 空文字列を指定したものは読み込まない。
+Corpus Corpus::fromDirectories(const string &rules_dirname, const string &send_cases_dirname, const string &confs_dirname) {
+    Corpus corpus;
+    if (rules_dirname != "") corpus.rules = getRules(rules_dirname);
+    if (send_cases_dirname != "") corpus.send_cases = getRules(send_cases_dirname);
+    if (confs_dirname != "") corpus.confs = getConfs(confs_dirname);
+    corpus.buildIndexes();
+    return corpus;
+}
+
+void Corpus::buildIndexes(void) {
+    rule_index = RuleIndex(rules);
+    send_case_index = RuleIndex(send_cases);
+    conf_index = ConfIndex(confs);
+    return;
+}
+
+// snapshot は int32 の列 (リトルエンディアン) として書き出す。
+//
+// magic (8 byte) version
+// (rules の数) rule ...
+// (send cases の数) rule ...
+// (confs の数) conf ...
+//
+// rule := send_edgeid amount near_triangulation
+// conf := ring_size inside_edge_id has_cutvertex diameter (filename の長さ) filename near_triangulation
+// near_triangulation := N (deg_lower deg_upper) * N E (u v) * E ((diagonal の数) d0 d1) * E
+// 次数が定まっていない頂点は deg_lower = deg_upper = 0 とする。
+// diagonal が 2 個未満の時は残りを -1 で埋める。
+class SnapshotWriter {
+private:
+    std::ofstream ofs_;
+
+public:
+    SnapshotWriter(const string &filename) : ofs_(filename, std::ios::binary) {
+        if (!ofs_) {
+            spdlog::critical("Failed to open {}", filename);
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        ofs_.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        writeInt(SNAPSHOT_VERSION);
+    }
+
+    void writeInt(int32_t value) {
+        ofs_.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void writeString(const string &str) {
+        writeInt((int32_t)str.size());
+        ofs_.write(str.data(), str.size());
+    }
+
+    void writeNearTriangulation(const NearTriangulation &graph) {
+        writeInt(graph.vertexSize());
+        for (const auto &degree : graph.degrees()) {
+            writeInt(degree.unset() ? 0 : degree.lower());
+            writeInt(degree.unset() ? 0 : degree.upper());
+        }
+        writeInt((int32_t)graph.edges().size());
+        for (const auto &[u, v] : graph.edges()) {
+            writeInt(u);
+            writeInt(v);
+        }
+        for (int edgeid = 0;edgeid < (int)graph.edges().size(); edgeid++) {
+            const auto &diagonal_vertices = graph.diagonalVertices(edgeid);
+            writeInt((int32_t)diagonal_vertices.size());
+            for (int i = 0;i < 2; i++) {
+                writeInt(i < (int)diagonal_vertices.size() ? diagonal_vertices[i] : -1);
+            }
+        }
+    }
+
+    // 書き出しに失敗していない (ディスクが一杯になったときなどは false になる。) か
+    bool good(void) {
+        ofs_.flush();
+        return ofs_.good();
+    }
+};
+
+// snapshot を先頭から順に読む。
+// 数や番号は読むときに確かめ、壊れたファイルからは rule や conf を作らない。
+class SnapshotReader {
+private:
+    const char *data_;
+    size_t size_, pos_;
+    string filename_;
+
+    [[noreturn]] void fail(const string &message) const {
+        spdlog::critical("{} is broken ({} at {})", filename_, message, pos_);
+        throw std::runtime_error(filename_ + " is broken");
+    }
+
+public:
+    SnapshotReader(const char *data, size_t size, const string &filename) : data_(data), size_(size), pos_(0), filename_(filename) {}
+
+    void read(void *dst, size_t n) {
+        if (pos_ + n > size_) {
+            spdlog::critical("{} is truncated", filename_);
+            throw std::runtime_error(filename_ + " is truncated");
+        }
+        std::memcpy(dst, data_ + pos_, n);
+        pos_ += n;
+    }
+
+    int readInt(void) {
+        int32_t value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    // 要素の数を読む。 要素は 1 つあたり min_bytes 以上の大きさなので、残りの大きさに入りきらない数は壊れている。
+    int readCount(const char *what, size_t min_bytes) {
+        int n = readInt();
+        if (n < 0 || (size_t)n > (size_ - pos_) / min_bytes) fail(fmt::format("{} {}", what, n));
+        return n;
+    }
+
+    // [0, size) の番号を読む。
+    int readId(const char *what, int size) {
+        int id = readInt();
+        if (id < 0 || id >= size) fail(fmt::format("{} {} out of [0, {})", what, id, size));
+        return id;
+    }
+
+    string readString(void) {
+        int size = readCount("string length", 1);
+        string str(size, '\0');
+        read(str.data(), size);
+        return str;
+    }
+
+    NearTriangulation readNearTriangulation(void) {
+        int vertex_size = readCount("vertex size", 2 * sizeof(int32_t));
+        vector<Degree> degrees(vertex_size, Degree());
+        for (int v = 0;v < vertex_size; v++) {
+            int lower = readInt();
+            int upper = readInt();
+            if (lower == 0 && upper == 0) continue;
+            if (lower < MIN_DEGREE || lower > upper || upper > MAX_DEGREE) fail(fmt::format("degree [{}, {}]", lower, upper));
+            degrees[v] = Degree(lower, upper);
+        }
+        int edge_size = readCount("edge size", 5 * sizeof(int32_t));
+        vector<pair<int, int>> edges(edge_size);
+        for (auto &[u, v] : edges) {
+            u = readId("vertex", vertex_size);
+            v = readId("vertex", vertex_size);
+        }
+        vector<DiagonalVertices> diagonal_vertices(edge_size);
+        for (auto &diagonal : diagonal_vertices) {
+            int n = readInt();
+            if (n < 0 || n > 2) fail(fmt::format("number of diagonal vertices {}", n));
+            for (int i = 0;i < 2; i++) {
+                if (i < n) {
+                    diagonal.push_back(readId("diagonal vertex", vertex_size));
+                } else {
+                    readInt();
+                }
+            }
+        }
+        return NearTriangulation(vertex_size, edges, diagonal_vertices, degrees);
+    }
+
+    Rule readRule(void) {
+        int send_edgeid = readInt();
+        int amount = readInt();
+        NearTriangulation graph = readNearTriangulation();
+        if (send_edgeid < 0 || send_edgeid >= (int)graph.edges().size()) fail(fmt::format("send edge {}", send_edgeid));
+        return Rule(send_edgeid, amount, graph);
+    }
+
+    Configuration readConf(void) {
+        int ring_size = readInt();
+        int inside_edge_id = readInt();
+        bool has_cutvertex = readInt();
+        int diameter = readInt();
+        string filename = readString();
+        NearTriangulation graph = readNearTriangulation();
+        if (ring_size < 0) fail(fmt::format("ring size {}", ring_size));
+        if (inside_edge_id < 0 || inside_edge_id >= (int)graph.edges().size()) fail(fmt::format("inside edge {}", inside_edge_id));
+        return Configuration(ring_size, inside_edge_id, has_cutvertex, diameter, filename, graph);
+    }
+};
+
+// corpus をまとめて 1 つの snapshot ファイルに書き出す。
+// 書きかけのファイルを snapshot として残さないように、一時ファイルに書いてから名前を変える。
+void Corpus::writeSnapshot(const string &filename) const {
+    {
+        SnapshotWriter writer(filename + ".tmp");
+        for (const auto *rule_set : {&rules, &send_cases}) {
+            writer.writeInt((int32_t)rule_set->size());
+            for (const auto &rule : *rule_set) {
+                writer.writeInt(rule.sendEdgeId());
+                writer.writeInt(rule.amount());
+                writer.writeNearTriangulation(rule.nearTriangulation());
+            }
+        }
+        writer.writeInt((int32_t)confs.size());
+        for (const auto &conf : confs) {
+            writer.writeInt(conf.ringSize());
+            writer.writeInt(conf.getInsideEdgeId());
+            writer.writeInt(conf.hasCutVertex());
+            writer.writeInt(conf.diameter());
+            writer.writeString(conf.fileName());
+            writer.writeNearTriangulation(conf.nearTriangulation());
+        }
+        if (!writer.good()) {
+            spdlog::critical("Failed to write {}", filename);
+            throw std::runtime_error("Failed to write " + filename);
+        }
+    }
+    fs::rename(filename + ".tmp", filename);
+    spdlog::info("wrote {} rules, {} send cases, {} confs into {}", rules.size(), send_cases.size(), confs.size(), filename);
+    return;
+}
+
+// writeSnapshot で書き出した snapshot ファイルを読み込む。
+// ファイル全体を 1 度に読んでから、 rule や conf をプロセスのメモリに作り直して索引を作る。
+// (テキストのファイルを 1 つずつ開いて解析するより速いが、プロセスの間でメモリを共有するわけではない。)
+Corpus Corpus::fromSnapshot(const string &filename) {
+    spdlog::info("reading snapshot {} ...", filename);
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        spdlog::critical("Failed to open {}", filename);
+        throw std::runtime_error("Failed to open " + filename);
+    }
+    vector<char> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (ifs.bad()) {
+        spdlog::critical("Failed to read {}", filename);
+        throw std::runtime_error("Failed to read " + filename);
+    }
+    if (data.size() < (size_t)SNAPSHOT_HEADER_SIZE) {
+        spdlog::critical("{} is truncated", filename);
+        throw std::runtime_error(filename + " is truncated");
+    }
+
+    Corpus corpus;
+    SnapshotReader reader(data.data(), data.size(), filename);
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    reader.read(magic, sizeof(magic));
+    if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+        spdlog::critical("{} is not a snapshot file", filename);
+        throw std::runtime_error(filename + " is not a snapshot file");
+    }
+    int version = reader.readInt();
+    if (version != SNAPSHOT_VERSION) {
+        spdlog::critical("The version of {} is {} (expected {}). Compile the snapshot again", filename, version, SNAPSHOT_VERSION);
+        throw std::runtime_error("Version mismatch of " + filename);
+    }
+    // rule は send_edgeid, amount と near_triangulation (少なくとも 4 個の int32)、 conf は少なくとも 7 個の int32
+    for (auto *rule_set : {&corpus.rules, &corpus.send_cases}) {
+        int n = reader.readCount("number of rules", 4 * sizeof(int32_t));
+        rule_set->reserve(n);
+        for (int i = 0;i < n; i++) rule_set->push_back(reader.readRule());
+    }
+    int n = reader.readCount("number of confs", 7 * sizeof(int32_t));
+    corpus.confs.reserve(n);
+    for (int i = 0;i < n; i++) corpus.confs.push_back(reader.readConf());
+    corpus.buildIndexes();
+    spdlog::info("read {} rules, {} send cases, {} confs", corpus.rules.size(), corpus.send_cases.size(), corpus.confs.size());
+    return corpus;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "configuration.hpp"
+#include "conf_index.hpp"
+#include "rule.hpp"
+
+using std::string;
+using std::vector;
+
+// snapshot ファイルの形式のバージョン。形式を変えたら上げる。
+const int SNAPSHOT_VERSION = 1;
+
+// 探索に使う rule, send case, configuration の集まり
+class Corpus {
+public:
+    vector<Rule> rules;
+    vector<Rule> send_cases;
+    vector<Configuration> confs;
+    // rules, send_cases, confs から作った索引 (fromDirectories, fromSnapshot で作る。)
+    RuleIndex rule_index;
+    RuleIndex send_case_index;
+    ConfIndex conf_index;
+
+    static Corpus fromDirectories(const string &rules_dirname, const string &send_cases_dirname, const string &confs_dirname);
+    static Corpus fromSnapshot(const string &filename);
+    void writeSnapshot(const string &filename) const;
+
+private:
+    void buildIndexes(void);
+};
@@ -4,7 +4,15 @@
 # We specify the degree of the hub(=: d), the smaller index of the range (=: l), the larger index of the range(=: r), 
 # the directory that contains rule files, the directory that contains configuration files.
 # Then, the script executes the discharging procedure to ./proj_wheel/d_l.wheel, ./proj_wheel/d_{l+1}.wheel ... ./proj_wheel/d_r.wheel
-# The log files (e.g. 7_0.wheel.log) are placed in ./proj_log directory.
+# (or the wheels of index l, l+1, ..., r in the wheel archive ./proj_wheel/d.wheels if it exists).
+# The wheels are evaluated by one process, which reads rules and configurations only once and evaluates each wheel
+# in a child process, at most $(nproc) at once and the wheels expected to take longer first
+# (set the environment variable THREADS to change the number of processes,
+# TIMEOUT (seconds) and MEMORY_LIMIT (MB) to limit the time and the memory to evaluate one wheel).
+# The log files (e.g. 7_0.wheel.log) are placed in ./proj_log directory,
+# and the result of each wheel is appended to ./proj_log/<The degree of the hub>.results.jsonl.
+# The wheels which already have their results there are skipped, so the same command resumes an interrupted run
+# (the wheels which failed, e.g. by the time limit, are evaluated again).
 #
 # Usage)
 # bash discharge.sh proj <The degree of the hub> <The smaller index of the range> <The larger index of the range> <The directory that contains rule files> <The directory that contains configuration files>
@@ -28,20 +36,21 @@ rule=$5
 conf=$6
 
 #
-# degree 7: we need to execute ./proj_wheel/7_{0..4703}.wheel 
-# degree 8: we need to execute ./proj_wheel/8_{0..6530}.wheel 
-# degree 9: we need to execute ./proj_wheel/9_{0..5435}.wheel 
-# degree 10: we need to execute ./proj_wheel/10_{0..3079}.wheel 
-# degree 11: we need to execute ./proj_wheel/11_{0..1036}.wheel
+# degree d: we need to execute ./proj_wheel/d_{0..n-1}.wheel,
+# where n is the number of wheels written in ./proj_wheel/d.summary by enum_wheel.sh (the line "wheels n").
+# (the shipped ./proj_wheel has no summary; n is the number of files ./proj_wheel/d_*.wheel there.)
 #
 if [ "$1" = "proj" ]; then
     send="./proj_send"
+    threads=${THREADS:-$(nproc)}
     mkdir -p proj_log
-    for i in $(seq $l $r); do
-        a=$(grep "the ratio of overcharged cartwheel 0/" ./proj_log/$2_$i.wheel.log | wc -l) && true
-        if [ $a -eq 0 ]; then
-            ./build/a.out -w "./proj_wheel/$2_$i.wheel" -r "$rule" -c "$conf" -s "$send" -m 9 -v 1 > "./proj_log/$2_$i.wheel.log" &
-        fi
-    done
+    results="./proj_log/$2.results.jsonl"
+    # use the wheel archive (./proj_wheel/d.wheels) if it exists
+    wheels="./proj_wheel"
+    if [ -f "./proj_wheel/$2.wheels" ]; then
+        wheels="./proj_wheel/$2.wheels"
+    fi
+    ./build/a.out -W "$wheels" -d "$2" -b "$l" -e "$r" -r "$rule" -c "$conf" -s "$send" -m 9 -j "$threads" -L "./proj_log" -R "$results" \
+        --schedule --timeout "${TIMEOUT:-0}" --memory_limit "${MEMORY_LIMIT:-0}" -v 1 >> "./proj_log/$2_$l-$r.batch.log"
 fi
 
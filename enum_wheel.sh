@@ -5,6 +5,12 @@
 # We specify the degree of the hub and the directory that contains configuration files.
 # The log file (e.g. proj_deg7.log, ...) is placed in ./log directory. 
 # The results (the wheel files) will be placed in ./proj_wheel directory.
+# The wheels are enumerated with $(nproc) threads
+# (set the environment variable THREADS to change the number of threads).
+# If the environment variable ARCHIVE is 1, the wheels are written into one wheel archive (./proj_wheel/<degree>.wheels)
+# instead of one file per wheel.
+# The wheels of the same degree enumerated before (<degree>_*.wheel, <degree>.wheels and <degree>.summary in ./proj_wheel)
+# are removed first, because the new numbering may be shorter and the old files would be left over.
 #
 # Usage)
 # bash enum_wheel.sh proj <The degree of the hub> <The directory that contains configurations>
@@ -25,10 +31,17 @@ deg=$2
 conf=$3
 send="./proj_send"
 wheel="./proj_wheel"
+threads="${THREADS:-$(nproc)}"
+archive=""
+if [ "${ARCHIVE:-0}" = "1" ]; then
+    archive="-A"
+fi
 
 mkdir -p log
 mkdir -p "$wheel"
+# remove the wheels enumerated before (find does not fail on too many files unlike rm with a glob)
+find "$wheel" -maxdepth 1 \( -name "${deg}_*.wheel" -o -name "${deg}.wheels" -o -name "${deg}.summary" \) -delete
 
 if [ "$1" = "proj" ]; then
-    ./build/a.out -d "$deg" -c "$conf" -s "$send" -m 9 -o "$wheel" -v 1 > ./log/proj_deg$deg.log &
+    ./build/a.out -d "$deg" -c "$conf" -s "$send" -m 9 -o "$wheel" -j "$threads" $archive -v 1 > ./log/proj_deg$deg.log &
 fi
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <iostream>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/sinks/ostream_sink.h>
+#include "log.hpp"
+
+// ログの書き出しは別スレッドで行い、探索するスレッドがファイルの I/O で止まらないようにする。
+const size_t LOG_QUEUE_SIZE = 8192;
+// fork した子プロセスでは書き出しのスレッドがないので、同期的に書き出す。
+static bool synchronous_logging = false;
+
+// 非同期に出力する default logger を設定し、 verbosity に応じてログレベルを決める。
+// verbosity: 0 for info, 1 for debug, 2 for trace
+void setupLogger(int verbosity) {
+    spdlog::init_thread_pool(LOG_QUEUE_SIZE, 1);
+    auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto logger = std::make_shared<spdlog::async_logger>("", sink, spdlog::thread_pool(), spdlog::async_overflow_policy::block);
+    spdlog::set_default_logger(logger);
+    // 終了時 (exit を呼んだ時も含む) にキューに残っているログを書き出す。
+    std::atexit([]() { spdlog::shutdown(); });
+
+    if (verbosity == 1) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+    if (verbosity == 2) {
+        spdlog::set_level(spdlog::level::trace);
+    }
+    return;
+}
+
+// fork した子プロセスで、以降のログを同期的に書き出すようにする。
+// 親から引き継いだ thread pool は破棄すると存在しないスレッドを待ってしまうので、破棄せずに残しておく。
+// 標準出力 (と spdlog の標準出力/標準エラー出力の sink が共有する mutex) は fork したときに親の書き出しのスレッドが使っていたかもしれないので、
+// default logger は自前の mutex を持つ sink で標準エラー出力に書き出し、 wheel の評価に失敗した理由などの warn 以上のログだけを出す。
+void setupLoggerInChild(void) {
+    synchronous_logging = true;
+    new std::shared_ptr<spdlog::details::thread_pool>(spdlog::thread_pool());
+    auto sink = std::make_shared<spdlog::sinks::ostream_sink_mt>(std::cerr, true);
+    sink->set_level(spdlog::level::warn);
+    auto logger = std::make_shared<spdlog::logger>("", sink);
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [pid %P] [%l] %v");
+    logger->set_level(spdlog::get_level());
+    spdlog::set_default_logger(logger);
+    return;
+}
+
+// filename に非同期に出力する logger を返す。ログレベルは default logger に合わせる。
+std::shared_ptr<spdlog::logger> makeFileLogger(const std::string &filename) {
+    auto sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(filename, true);
+    if (synchronous_logging) {
+        auto logger = std::make_shared<spdlog::logger>("", sink);
+        logger->set_level(spdlog::get_level());
+        return logger;
+    }
+    auto logger = std::make_shared<spdlog::async_logger>("", sink, spdlog::thread_pool(), spdlog::async_overflow_policy::block);
+    logger->set_level(spdlog::get_level());
+    return logger;
+}
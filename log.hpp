@@ -0,0 +1,24 @@
+#pragma once
+#include <spdlog/spdlog.h>
+
+// 探索中に呼ばれるログはこのマクロを使う。
+// spdlog::trace などを直接呼ぶと、ログレベルが無効でも引数 (toString() など) が評価されてしまうので、
+// ログレベルが有効なときだけ引数を評価する。
+// DISCHARGE_ENABLE_TRACE を 0 にしてビルドすると trace のログはコンパイル時に取り除かれる。
+#ifndef DISCHARGE_ENABLE_TRACE
+#define DISCHARGE_ENABLE_TRACE 1
+#endif
+
+#define LOG_DEBUG(...) \
+    do { if (spdlog::should_log(spdlog::level::debug)) spdlog::debug(__VA_ARGS__); } while (0)
+
+#if DISCHARGE_ENABLE_TRACE
+#define LOG_TRACE(...) \
+    do { if (spdlog::should_log(spdlog::level::trace)) spdlog::trace(__VA_ARGS__); } while (0)
+#else
+#define LOG_TRACE(...) do {} while (0)
+#endif
+
+void setupLogger(int verbosity);
+void setupLoggerInChild(void);
+std::shared_ptr<spdlog::logger> makeFileLogger(const std::string &filename);
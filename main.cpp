@@ -1,24 +1,53 @@
 #include <iostream>
+#include <algorithm>
+#include <fstream>
 #include <string>
+#include <vector>
 #include <filesystem>
 #include <boost/program_options.hpp>
 #include <spdlog/spdlog.h>
 #include "cartwheel.hpp"
+#include "corpus.hpp"
+#include "log.hpp"
+#include "result.hpp"
+#include "wheel_archive.hpp"
 
 namespace fs = std::filesystem;
 using std::string;
+using std::vector;
 
 int main(const int ac, const char* const* const av) {
     using namespace boost::program_options;
     options_description description("Options");
     description.add_options()
-        ("degree,d", value<string>(), "Hub's degree to generate wheel (subwheel) file")
-        ("wheel,w", value<string>(), "The wheel (subwheel) file to evaluate")
+        ("degree,d", value<string>(), "Hub's degree to generate wheel (subwheel) file (or to evaluate wheel files in --wheel_dir)")
+        ("wheel,w", value<string>(), "The wheel (subwheel) file to evaluate (or the wheel archive (.wheels) with the index of the wheel by --begin)")
+        ("wheel_dir,W", value<string>(), "The directory which includes wheel files to evaluate at once (specify the range by --begin, --end or the wheel files by --list), or the wheel archive (.wheels) (specify the range by --begin, --end or the wheels by --list)")
+        ("begin,b", value<int>(), "The smaller index of the range of wheel files (<degree>_<index>.wheel) to evaluate")
+        ("end,e", value<int>(), "The larger index of the range of wheel files (<degree>_<index>.wheel) to evaluate")
+        ("list,l", value<string>(), "The file which lists wheel files to evaluate (one file name per line)")
+        ("threads,j", value<int>()->default_value(1), "The number of threads to evaluate wheel files in --wheel_dir (or to generate wheel files)")
+        ("search_threads", value<int>()->default_value(1), "The number of threads to search cartwheels of one wheel")
+        ("logdir,L", value<string>()->default_value(""), "The directory that the result of each wheel file in --wheel_dir is placed")
+        ("result,R", value<string>()->default_value(""), "The file that the result of each evaluated wheel is appended to (one JSON object per line)")
+        ("checkpoint", value<string>()->default_value(""), "The directory that the progress of the search of each wheel is saved in (removed when the wheel is evaluated)")
+        ("checkpoint_interval", value<int>()->default_value(600), "The interval (seconds) to save the progress of the search")
+        ("resume", "Resume the search from the progress saved in --checkpoint")
+        ("schedule", "Evaluate each wheel in --wheel_dir in a child process (at most --threads at once), longest expected first, and skip the wheels already evaluated in --result")
+        ("timeout", value<int>()->default_value(0), "The time limit (seconds) to evaluate one wheel with --schedule (0 for no limit)")
+        ("memory_limit", value<int>()->default_value(0), "The memory limit (MB of address space) to evaluate one wheel with --schedule (0 for no limit)")
+        ("estimate", value<string>(), "Estimate the cost to evaluate each wheel (--wheel or --wheel_dir) by random probes of the search tree instead of evaluating it, and write the estimates into the file (one JSON object per line)")
+        ("probes", value<int>()->default_value(2), "The number of random probes of the search tree to estimate the cost of one wheel with --estimate or --schedule (0 for --schedule to order the wheels by their neighbors' degrees only)")
+        ("aggregate", value<vector<string>>()->multitoken(), "Aggregate the result files written by --result (specify the range of wheels by --degree, --begin, --end)")
+        ("remaining", value<string>()->default_value(""), "The file that the wheels which are not finished are written to by --aggregate (one wheel name per line)")
         ("conf,c", value<string>(), "The directory which includes configuration files")
         ("send_case,s", value<string>(), "The directory which includes send case (.rule extension)")
         ("rule,r", value<string>(), "The directory which includes rule files")
+        ("snapshot,S", value<string>(), "The snapshot file made by --compile_snapshot (used instead of --rule, --send_case and --conf)")
+        ("compile_snapshot", value<string>(), "Compile rules (--rule), send cases (--send_case) and configurations (--conf) into the snapshot file")
         ("max_degree,m", value<int>(), "Maximum degree to check (e.g. if you choose degree from {5, 6, 7, 8, 9+}, set max_degree 9)")
         ("outdir,o", value<string>(), "The directory that wheel (subwheel) files are placed")
+        ("archive,A", "Write the generated wheels into one wheel archive <outdir>/<degree>.wheels instead of one file per wheel")
         ("help,H", "Display options")
         ("verbosity,v", value<int>()->default_value(0), "1 for debug, 2 for trace");
 
@@ -30,25 +59,54 @@ int main(const int ac, const char* const* const av) {
         description.print(std::cout);
         return 0;
     }
-    if (vm.count("verbosity")) {
-        auto v = vm["verbosity"].as<int>();
-        if (v == 1) {
-            spdlog::set_level(spdlog::level::debug);
-        }
-        if (v == 2) {
-            spdlog::set_level(spdlog::level::trace);
-        }
+    setupLogger(vm["verbosity"].as<int>());
+    Checkpointer checkpointer(vm["checkpoint"].as<string>(), vm["checkpoint_interval"].as<int>(), vm.count("resume"));
+    if (vm.count("resume") && !checkpointer.enabled()) {
+        spdlog::warn("Specify the directory of the checkpoint to resume");
+        exit(1);
     }
-    if (vm.count("degree")) {
-        Degree degree = Degree::fromString(vm["degree"].as<string>());
-        if (!vm.count("conf")) {
-            spdlog::warn("Specify directory which includes configuration files");
+    // snapshot が指定されていればそれを、そうでなければ各ディレクトリを読み込む。
+    auto load_corpus = [&vm](bool need_rules, bool need_send_cases, bool need_confs) -> Corpus {
+        if (vm.count("snapshot")) {
+            return Corpus::fromSnapshot(vm["snapshot"].as<string>());
+        }
+        if (need_rules && !vm.count("rule")) {
+            spdlog::warn("Specify directory which includes rule files");
             exit(1);
         }
-        if (!vm.count("send_case")) {
+        if (need_send_cases && !vm.count("send_case")) {
             spdlog::warn("Specify directory which includes send_case files");
             exit(1);
         }
+        if (need_confs && !vm.count("conf")) {
+            spdlog::warn("Specify directory which includes configuration files");
+            exit(1);
+        }
+        return Corpus::fromDirectories(
+            need_rules ? vm["rule"].as<string>() : "",
+            need_send_cases ? vm["send_case"].as<string>() : "",
+            need_confs ? vm["conf"].as<string>() : "");
+    };
+    if (vm.count("compile_snapshot")) {
+        auto corpus = load_corpus(true, true, true);
+        corpus.writeSnapshot(vm["compile_snapshot"].as<string>());
+    }
+    if (vm.count("aggregate")) {
+        int hub_degree = 0, begin = 0, end = -1;
+        if (vm.count("degree")) {
+            if (!vm.count("begin") || !vm.count("end")) {
+                spdlog::warn("Specify the range (begin, end) of wheels to aggregate");
+                exit(1);
+            }
+            hub_degree = Degree::fromString(vm["degree"].as<string>()).lower();
+            begin = vm["begin"].as<int>();
+            end = vm["end"].as<int>();
+        }
+        aggregateResults(vm["aggregate"].as<vector<string>>(), hub_degree, begin, end, vm["remaining"].as<string>());
+        return 0;
+    }
+    if (vm.count("degree") && !vm.count("wheel_dir")) {
+        Degree degree = Degree::fromString(vm["degree"].as<string>());
         if (!vm.count("max_degree")) {
             spdlog::warn("Specify max_degree");
             exit(1);
@@ -57,34 +115,137 @@ int main(const int ac, const char* const* const av) {
             spdlog::warn("Specify output directory");
             exit(1);
         }
-        auto confdir = vm["conf"].as<string>();
-        auto send_casedir = vm["send_case"].as<string>();
         int max_degree = vm["max_degree"].as<int>();
         auto outdir = vm["outdir"].as<string>();
         assert(degree.fixed());
-        generateWheels(degree.lower(), confdir, send_casedir, max_degree, outdir);
+        auto corpus = load_corpus(false, true, true);
+        generateWheels(degree.lower(), corpus, max_degree, outdir, vm["threads"].as<int>(), vm.count("archive"));
     }
     if (vm.count("wheel")) {
         auto filename = vm["wheel"].as<string>();
-        if (!vm.count("rule")) {
-            spdlog::warn("Specify directory which includes rule files");
+        if (!vm.count("max_degree")) {
+            spdlog::warn("Specify max_degree");
             exit(1);
         }
-        if (!vm.count("conf")) {
-            spdlog::warn("Specify directory which includes configuration files");
-            exit(1);
+        int max_degree = vm["max_degree"].as<int>();
+        if (vm.count("estimate") && fs::path(filename).extension() == ".wheel") {
+            auto corpus = load_corpus(false, true, true);
+            estimateWheels({filename}, corpus, max_degree, 1, vm["probes"].as<int>(), vm["estimate"].as<string>());
+        } else if (vm.count("estimate") && fs::path(filename).extension() == ".wheels") {
+            if (!vm.count("begin")) {
+                spdlog::warn("Specify the index of the wheel in the wheel archive by --begin");
+                exit(1);
+            }
+            auto corpus = load_corpus(false, true, true);
+            estimateWheelArchive(filename, {vm["begin"].as<int>()}, corpus, max_degree, 1, vm["probes"].as<int>(), vm["estimate"].as<string>());
+        } else if (fs::path(filename).extension() == ".wheel") {
+            auto corpus = load_corpus(true, true, true);
+            evaluateWheel(filename, corpus, max_degree, vm["search_threads"].as<int>(), vm["result"].as<string>(), checkpointer);
+        } else if (fs::path(filename).extension() == ".wheels") {
+            if (!vm.count("begin")) {
+                spdlog::warn("Specify the index of the wheel in the wheel archive by --begin");
+                exit(1);
+            }
+            auto corpus = load_corpus(true, true, true);
+            evaluateWheelArchive(filename, {vm["begin"].as<int>()}, corpus, max_degree, 1, vm["search_threads"].as<int>(), "", vm["result"].as<string>(), checkpointer, ScheduleOptions());
         }
+    }
+    if (vm.count("wheel_dir")) {
+        auto wheeldir = vm["wheel_dir"].as<string>();
         if (!vm.count("max_degree")) {
             spdlog::warn("Specify max_degree");
             exit(1);
         }
-        auto rulesdir = vm["rule"].as<string>();
-        auto confsdir = vm["conf"].as<string>();
-        auto casesdir = vm["send_case"].as<string>();
         int max_degree = vm["max_degree"].as<int>();
-        if (fs::path(filename).extension() == ".wheel") {
-            evaluateWheel(filename, rulesdir, casesdir, confsdir, max_degree);
-        } 
+        int num_threads = vm["threads"].as<int>();
+        auto logdir = vm["logdir"].as<string>();
+        // --schedule では --result を終わった wheel の記録 (manifest) として使う。
+        ScheduleOptions schedule;
+        if (vm.count("schedule")) {
+            if (vm["result"].as<string>() == "") {
+                spdlog::warn("Specify the result file (--result) to record the evaluated wheels with --schedule");
+                exit(1);
+            }
+            schedule.manifest_filename = vm["result"].as<string>();
+            schedule.timeout_seconds = vm["timeout"].as<int>();
+            schedule.memory_limit_mb = vm["memory_limit"].as<int>();
+            schedule.num_probes = vm["probes"].as<int>();
+        }
+        // wheel archive のときは index の範囲か、 wheel の名前 (<degree>_<index>.wheel) のリストで指定する。
+        if (fs::is_regular_file(wheeldir) && fs::path(wheeldir).extension() == ".wheels") {
+            vector<int> indexes;
+            if (vm.count("list")) {
+                auto listname = vm["list"].as<string>();
+                std::ifstream ifs(listname);
+                if (!ifs) {
+                    spdlog::warn("Failed to open {}", listname);
+                    exit(1);
+                }
+                // 名前の hub の次数は archive の hub の次数と一致していなければならない。
+                WheelArchive archive(wheeldir);
+                auto is_number = [](const string &str) {
+                    return !str.empty() && str.size() <= 9 && std::all_of(str.begin(), str.end(), [](char c) { return '0' <= c && c <= '9'; });
+                };
+                string name;
+                while (ifs >> name) {
+                    string stem = fs::path(name).stem().string();
+                    auto pos = stem.rfind('_');
+                    if (pos == string::npos || !is_number(stem.substr(0, pos)) || !is_number(stem.substr(pos + 1))) {
+                        spdlog::warn("{} in {} is not the name of a wheel (<degree>_<index>.wheel)", name, listname);
+                        exit(1);
+                    }
+                    int degree = std::stoi(stem.substr(0, pos));
+                    if (degree != archive.hubDegree()) {
+                        spdlog::warn("{} in {} is a wheel whose hub has degree {}, but the hub of the wheels in {} has degree {}", name, listname, degree, wheeldir, archive.hubDegree());
+                        exit(1);
+                    }
+                    indexes.push_back(std::stoi(stem.substr(pos + 1)));
+                }
+            } else {
+                if (!vm.count("begin") || !vm.count("end")) {
+                    spdlog::warn("Specify the range (begin, end) of wheels in the wheel archive, or the list of wheels");
+                    exit(1);
+                }
+                for (int i = vm["begin"].as<int>();i <= vm["end"].as<int>(); i++) indexes.push_back(i);
+            }
+            if (vm.count("estimate")) {
+                auto corpus = load_corpus(false, true, true);
+                estimateWheelArchive(wheeldir, indexes, corpus, max_degree, num_threads, vm["probes"].as<int>(), vm["estimate"].as<string>());
+                return 0;
+            }
+            auto corpus = load_corpus(true, true, true);
+            evaluateWheelArchive(wheeldir, indexes, corpus, max_degree, num_threads, vm["search_threads"].as<int>(), logdir, vm["result"].as<string>(), checkpointer, schedule);
+            return 0;
+        }
+        vector<string> filenames;
+        if (vm.count("list")) {
+            auto listname = vm["list"].as<string>();
+            std::ifstream ifs(listname);
+            if (!ifs) {
+                spdlog::warn("Failed to open {}", listname);
+                exit(1);
+            }
+            string name;
+            while (ifs >> name) {
+                filenames.push_back((fs::path(wheeldir) / name).string());
+            }
+        } else {
+            if (!vm.count("degree") || !vm.count("begin") || !vm.count("end")) {
+                spdlog::warn("Specify degree and the range (begin, end) of wheel files, or the list of wheel files");
+                exit(1);
+            }
+            auto degree = vm["degree"].as<string>();
+            for (int i = vm["begin"].as<int>();i <= vm["end"].as<int>(); i++) {
+                filenames.push_back(fmt::format("{}/{}_{}.wheel", wheeldir, degree, i));
+            }
+        }
+        if (vm.count("estimate")) {
+            auto corpus = load_corpus(false, true, true);
+            estimateWheels(filenames, corpus, max_degree, num_threads, vm["probes"].as<int>(), vm["estimate"].as<string>());
+            return 0;
+        }
+        auto corpus = load_corpus(true, true, true);
+        evaluateWheels(filenames, corpus, max_degree, num_threads, vm["search_threads"].as<int>(), logdir, vm["result"].as<string>(), checkpointer, schedule);
     }
 
     return 0;
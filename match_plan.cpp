@@ -0,0 +1,58 @@
+#include <cassert>
+#include "match_plan.hpp"
+
+MatchPlan::MatchPlan(const NearTriangulation &subgraph, const set<int> &except_vertices) {
+    build(subgraph, except_vertices);
+}
+
+// except_vertices に入っている subgraph の頂点は対応する頂点がなくてもよく、どの次数とも適合する。
+void MatchPlan::build(const NearTriangulation &subgraph, const set<int> &except_vertices) {
+    vertex_size_ = subgraph.vertexSize();
+    if (topology_ != subgraph.topology()) {
+        topology_ = subgraph.topology();
+        buildSteps(subgraph);
+    }
+    conditions_.assign(subgraph.degrees().begin(), subgraph.degrees().end());
+    required_vertices_.clear();
+    for (int v = 0;v < vertex_size_; v++) {
+        if (except_vertices.count(v)) conditions_[v] = Degree();
+        else required_vertices_.push_back(v);
+    }
+    return;
+}
+
+// subgraph の辺ごとに、たどるときに見るものを計算する。
+void MatchPlan::buildSteps(const NearTriangulation &subgraph) {
+    steps_.resize(subgraph.edges().size());
+    for (int edgeid = 0;edgeid < (int)subgraph.edges().size(); edgeid++) {
+        auto &step = steps_[edgeid];
+        step.edge = subgraph.edges()[edgeid];
+        step.diagonals = subgraph.diagonalVertices(edgeid);
+        for (int k = 0;k < step.diagonals.size(); k++) {
+            step.first_edgeids[k] = subgraph.edgeId(step.edge.first, step.diagonals[k]);
+            step.second_edgeids[k] = subgraph.edgeId(step.edge.second, step.diagonals[k]);
+            assert(step.first_edgeids[k] != -1 && step.second_edgeids[k] != -1);
+        }
+    }
+    return;
+}
+
+int MatchPlan::vertexSize(void) const {
+    return vertex_size_;
+}
+
+int MatchPlan::numEdges(void) const {
+    return steps_.size();
+}
+
+const MatchPlan::EdgeStep &MatchPlan::step(int edgeid) const {
+    return steps_[edgeid];
+}
+
+const Degree &MatchPlan::condition(int v) const {
+    return conditions_[v];
+}
+
+const vector<int> &MatchPlan::requiredVertices(void) const {
+    return required_vertices_;
+}
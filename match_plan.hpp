@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include <set>
+#include <array>
+#include <memory>
+#include "near_triangulation.hpp"
+
+using std::vector;
+using std::set;
+using std::pair;
+
+// MatchPlan
+// subgraph (rule や conf など) を wheelgraph と照合する手順 (BaseWheel::containSubgraphWithCorrespondingEdge) のうち、
+// subgraph だけで決まる部分を前もって計算しておいたもの (rule や conf は読み込んだときに 1 度だけ計算する。)
+// 照合は根の辺から三角形をたどって頂点を対応させていく。辺 e をたどるときには e の diagonal vertex を対応させ、
+// 続けて (e の始点, diagonal vertex), (e の終点, diagonal vertex) の 2 辺をたどる。
+// どこまで対応をたどれるかは wheelgraph の形と次数によるので、たどる順番は照合するときに決める。
+class MatchPlan {
+public:
+    // subgraph の辺 edge をたどるときに見るもの
+    // diagonals[k] を対応させた後は first_edgeids[k], second_edgeids[k] の辺をこの順にたどる。
+    class EdgeStep {
+    public:
+        pair<int, int> edge;
+        DiagonalVertices diagonals;
+        std::array<int, 2> first_edgeids;
+        std::array<int, 2> second_edgeids;
+    };
+
+private:
+    int vertex_size_;
+    // steps_ を計算した subgraph の辺集合 (次数だけが異なる subgraph で build し直すときは steps_ を計算し直さない。)
+    std::shared_ptr<const NearTriangulationTopology> topology_;
+    // steps_[e] := subgraph の辺 e をたどるときに見るもの
+    vector<EdgeStep> steps_;
+    // conditions_[v] := subgraph の頂点 v と対応させる頂点の次数の条件
+    // except_vertices に入っている頂点はどの次数とも適合するので、次数が定まっていない頂点と同じく Degree() とする。
+    vector<Degree> conditions_;
+    // 照合の結果を判定するときに、対応する頂点があって次数が適合しているかを確かめる頂点 (except_vertices に入っていない頂点)
+    vector<int> required_vertices_;
+
+    void buildSteps(const NearTriangulation &subgraph);
+
+public:
+    MatchPlan(void) : vertex_size_(0) {};
+    MatchPlan(const NearTriangulation &subgraph, const set<int> &except_vertices = set<int>());
+    // subgraph の手順を計算し直す。 (領域は使い回し、辺集合が前と同じなら次数の条件だけを計算し直す。)
+    void build(const NearTriangulation &subgraph, const set<int> &except_vertices = set<int>());
+
+    int vertexSize(void) const;
+    int numEdges(void) const;
+    const EdgeStep &step(int edgeid) const;
+    const Degree &condition(int v) const;
+    const vector<int> &requiredVertices(void) const;
+};
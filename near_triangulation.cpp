@@ -1,57 +1,79 @@
+#include <algorithm>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
 #include <fmt/ranges.h>
 #include "near_triangulation.hpp"
+#include "log.hpp"
 
 using std::ifstream;
 
-Degree::Degree(int lower_deg, int upper_deg) : 
-    lower_deg_(lower_deg), 
-    upper_deg_(upper_deg) {};
+// 次数 deg を表す bit の位置
+static int degreeBit(int deg) {
+    assert(deg >= MIN_DEGREE);
+    return std::min(deg - MIN_DEGREE, NUM_DEGREE_BITS - 1);
+}
+
+// lower_deg 以上 upper_deg 以下の次数の集合
+Degree::Degree(int lower_deg, int upper_deg) {
+    int lower_bit = degreeBit(lower_deg), upper_bit = degreeBit(upper_deg);
+    assert(lower_bit <= upper_bit);
+    mask_ = (uint16_t)(((1u << (upper_bit + 1)) - 1) & ~((1u << lower_bit) - 1));
+}
 
 Degree::Degree(int deg) :
-    lower_deg_(deg),
-    upper_deg_(deg) {};
+    mask_((uint16_t)(1u << degreeBit(deg))) {};
 
-// "5", "5+", "8-" などの次数を表す文字列から Degree クラスを返す。
-Degree Degree::fromString(const string &str) {
-    std::size_t i;
-    int deg = std::stoi(str, &i);
-    if (i == str.size()) {
-        return Degree(deg);
-    } 
-    if (i == str.size() - 1) {
-        if (str[i] == '+') return Degree(deg, MAX_DEGREE);
-        if (str[i] == '-') return Degree(MIN_DEGREE, deg);
-    }
+[[noreturn]] static void failToParseDegree(const string &str) {
     spdlog::critical("Failed to parse {} as degree", str);
     throw std::runtime_error("Failed to parse " + str + " as degree");
 }
 
-int Degree::lower(void) const {
-    return lower_deg_;
-}
-
-int Degree::upper(void) const {
-    return upper_deg_;
+// [MIN_DEGREE, MAX_DEGREE] の次数を表す整数を str から読み、読んだ文字数を i に入れる。
+static int parseDegree(const string &str, const string &whole, std::size_t &i) {
+    int deg = 0;
+    try {
+        deg = std::stoi(str, &i);
+    } catch (const std::logic_error &) {
+        failToParseDegree(whole);
+    }
+    if (deg < MIN_DEGREE || deg > MAX_DEGREE) failToParseDegree(whole);
+    return deg;
 }
 
-string Degree::toString(void) const {
-    if (fixed()) return std::to_string(lower_deg_);
-    if (upper_deg_ == MAX_DEGREE) return std::to_string(lower_deg_) + "+";
-    if (lower_deg_ == MIN_DEGREE) return std::to_string(upper_deg_) + "-";
-    assert(false);
+// "5", "5+", "8-", "6..7" などの次数を表す文字列から Degree クラスを返す。
+Degree Degree::fromString(const string &str) {
+    std::size_t i;
+    int deg = parseDegree(str, str, i);
+    string rest = str.substr(i);
+    if (rest.empty()) return Degree(deg);
+    if (rest == "+") return Degree(deg, MAX_DEGREE);
+    if (rest == "-") return Degree(MIN_DEGREE, deg);
+    if (rest.compare(0, 2, "..") == 0) {
+        std::size_t j;
+        int upper_deg = parseDegree(rest.substr(2), str, j);
+        if (j == rest.size() - 2 && deg <= upper_deg) return Degree(deg, upper_deg);
+    }
+    failToParseDegree(str);
 }
 
-bool Degree::include(const Degree &degree) const {
-    return lower_deg_ <= degree.lower_deg_ && degree.upper_deg_ <= upper_deg_;
+int Degree::lower(void) const {
+    assert(!unset());
+    return MIN_DEGREE + __builtin_ctz(mask_);
 }
 
-bool Degree::disjoint(const Degree &degree0, const Degree &degree1) {
-    return degree0.upper_deg_ < degree1.lower_deg_ || degree1.upper_deg_ < degree0.lower_deg_;
+// 20+ を含むときは MAX_DEGREE を返す。
+int Degree::upper(void) const {
+    assert(!unset());
+    int upper_bit = 31 - __builtin_clz(mask_);
+    return upper_bit == NUM_DEGREE_BITS - 1 ? MAX_DEGREE : MIN_DEGREE + upper_bit;
 }
 
-bool Degree::fixed(void) const {
-    return lower_deg_ == upper_deg_;
+string Degree::toString(void) const {
+    if (fixed()) return std::to_string(lower());
+    if (upper() == MAX_DEGREE) return std::to_string(lower()) + "+";
+    if (lower() == MIN_DEGREE) return std::to_string(upper()) + "-";
+    // Configuration::readConfFile が作る [d-1, d] のように、 d, d+, d- のどれでもない範囲は "6..7" と書く。
+    return std::to_string(lower()) + ".." + std::to_string(upper());
 }
 
 
@@ -60,73 +82,318 @@ bool Degree::fixed(void) const {
 // 5+ -> 5, 6, 7, 8+
 // 7+ -> 7, 8+ 
 // 6- は 5, 6 のように分ける。
-vector<Degree> divideDegree(const Degree &degree, int max_degree) {
-    vector<Degree> degrees;
-    int deg = degree.lower();
-    assert(deg <= max_degree);
-    while (deg < degree.upper() && deg < max_degree) {
-        degrees.push_back(Degree(deg));
-        deg++;
-    }
-    degrees.push_back(Degree(deg, degree.upper()));
+// max_degree 未満の次数の bit を 1 つずつ取り出し、残りの bit をまとめて最後の次数とする。
+DividedDegrees divideDegree(const Degree &degree, int max_degree) {
+    DividedDegrees degrees;
+    assert(degree.lower() <= max_degree);
+    uint32_t mask = degree.mask();
+    uint32_t below_max = (1u << degreeBit(max_degree)) - 1;
+    // 最後の次数は 1 つ以上の bit を持つようにする。 (6- を max_degree = 8 で分けるときは 6 が最後の次数になる。)
+    while ((mask & below_max) && (mask & (mask - 1))) {
+        uint32_t bit = mask & -mask;
+        degrees.push_back(Degree::fromMask((uint16_t)bit));
+        mask ^= bit;
+    }
+    degrees.push_back(Degree::fromMask((uint16_t)mask));
     return degrees;
 }
 
-NearTriangulation::NearTriangulation(int vertex_size, const vector<set<int>> &VtoV, const vector<optional<Degree>> &degrees) : 
+int degreeClass(const Degree &degree) {
+    if (degree.unset()) return 0;
+    if (degree.fixed()) return __builtin_ctz(degree.mask()) + 1;
+    return DEGREE_CLASS_OTHER;
+}
+
+uint32_t acceptedDegreeClasses(const Degree &condition, bool detect_possible) {
+    uint32_t all_classes = (1u << NUM_DEGREE_CLASSES) - 1;
+    if (condition.unset()) return all_classes;
+    // 次数が定まっていない頂点は detect_possible のときだけ適合する。
+    // 次数が定まっている頂点は condition の bit を持つときに適合する (分類 1, 2, ..., 15 は bit 0, 1, ..., 14 に対応する)。
+    uint32_t fixed_mask = condition.mask() & ((1u << (DEGREE_CLASS_OTHER - 1)) - 1);
+    return (detect_possible ? 1u : 0u) | (1u << DEGREE_CLASS_OTHER) | (fixed_mask << 1);
+}
+
+NearTriangulation::NearTriangulation(int vertex_size, const vector<set<int>> &VtoV, const vector<Degree> &degrees) : 
     vertex_size_(vertex_size),
     degrees_(degrees) {
 
+    vector<pair<int, int>> edges;
     for (int v = 0;v < vertex_size_; v++) {
         for (int u : VtoV[v]) {
-            edges_.emplace_back(v, u);
+            edges.emplace_back(v, u);
         }
     }
 
-    for (const auto &edge : edges_) {
-        auto [v, u] = edge;
+    vector<DiagonalVertices> diagonal_vertices(edges.size());
+    for (int edgeid = 0;edgeid < (int)edges.size(); edgeid++) {
+        auto [v, u] = edges[edgeid];
         for (int w : VtoV[v]) {
             if (VtoV[u].count(w)) {
-                diagonal_vertices_[edge].push_back(w);
+                assert(diagonal_vertices[edgeid].size() < 2);
+                diagonal_vertices[edgeid].push_back(w);
             }
         }
-        spdlog::trace("diagonal vertices ({}, {}) : {}", v, u, fmt::join(diagonal_vertices_[edge], ", "));
-        assert(diagonal_vertices_[edge].size() <= 2);
+        LOG_TRACE("diagonal vertices ({}, {}) : {}", v, u, fmt::join(diagonal_vertices[edgeid], ", "));
+    }
+    topology_ = std::make_shared<const NearTriangulationTopology>(vertex_size_, std::move(edges), std::move(diagonal_vertices));
+    buildDegreeClassIndex();
+}
+
+// 計算済みの辺集合と diagonal_vertices から NearTriangulation を構築する。(snapshot から読み込むときに使う。)
+NearTriangulation::NearTriangulation(int vertex_size, const vector<pair<int, int>> &edges, const vector<DiagonalVertices> &diagonal_vertices, const vector<Degree> &degrees) :
+    vertex_size_(vertex_size),
+    degrees_(degrees),
+    topology_(std::make_shared<const NearTriangulationTopology>(vertex_size, edges, diagonal_vertices)) {
+    buildDegreeClassIndex();
+}
+
+// edges から edge_ids_, reverse_edge_ids_, first_edge_ids_ を計算する。
+NearTriangulationTopology::NearTriangulationTopology(int vertex_size, vector<pair<int, int>> edges, vector<DiagonalVertices> diagonal_vertices) :
+    vertex_size_(vertex_size),
+    edges_(std::move(edges)),
+    diagonal_vertices_(std::move(diagonal_vertices)) {
+    assert(edges_.size() == diagonal_vertices_.size());
+    edge_ids_.assign(vertex_size_ * vertex_size_, -1);
+    for (int edgeid = 0;edgeid < (int)edges_.size(); edgeid++) {
+        auto [v, u] = edges_[edgeid];
+        edge_ids_[v * vertex_size_ + u] = edgeid;
+    }
+    reverse_edge_ids_.resize(edges_.size());
+    for (int edgeid = 0;edgeid < (int)edges_.size(); edgeid++) {
+        auto [v, u] = edges_[edgeid];
+        reverse_edge_ids_[edgeid] = edge_ids_[u * vertex_size_ + v];
+        assert(reverse_edge_ids_[edgeid] != -1);
     }
+    first_edge_ids_.assign(vertex_size_ + 1, 0);
+    for (const auto &[v, u] : edges_) first_edge_ids_[v + 1]++;
+    for (int v = 0;v < vertex_size_; v++) first_edge_ids_[v + 1] += first_edge_ids_[v];
+}
 
+// degrees_ から class_vertices_ を計算する。
+void NearTriangulation::buildDegreeClassIndex(void) {
+    num_words_ = (vertex_size_ + 63) / 64;
+    class_vertices_.assign(NUM_DEGREE_CLASSES * num_words_, 0);
+    for (int v = 0;v < vertex_size_; v++) {
+        class_vertices_[degreeClass(degrees_[v]) * num_words_ + v / 64] |= 1ULL << (v % 64);
+    }
+    return;
 }
 
 int NearTriangulation::vertexSize(void) const {
     return vertex_size_;
 }
 
-const vector<optional<Degree>> &NearTriangulation::degrees(void) const {
+const vector<Degree> &NearTriangulation::degrees(void) const {
     return degrees_;
 }
 
+const std::shared_ptr<const NearTriangulationTopology> &NearTriangulation::topology(void) const {
+    return topology_;
+}
+
 const vector<pair<int, int>> &NearTriangulation::edges(void) const {
-    return edges_;
+    return topology_->edges_;
 }
 
-const map<pair<int, int>, vector<int>> &NearTriangulation::diagonalVertices(void) const {
-    return diagonal_vertices_;
+const DiagonalVertices &NearTriangulation::diagonalVertices(int edgeid) const {
+    return topology_->diagonal_vertices_[edgeid];
 }
 
+// 辺 (u, v) の辺番号を返す。辺がなければ -1 を返す。
+int NearTriangulation::edgeId(int u, int v) const {
+    return topology_->edge_ids_[u * vertex_size_ + v];
+}
 
-void NearTriangulation::setDegree(int v, const optional<Degree> &degree) {
+int NearTriangulation::reverseEdgeId(int edgeid) const {
+    return topology_->reverse_edge_ids_[edgeid];
+}
+
+// 辺 edgeid の始点, 終点の次数の分類がそれぞれ classes[0], classes[1] に含まれているかどうか。
+bool NearTriangulation::edgeInDegreeClasses(int edgeid, const std::array<uint32_t, 2> &classes) const {
+    auto [u, v] = topology_->edges_[edgeid];
+    return (classes[0] >> degreeClass(degrees_[u]) & 1) && (classes[1] >> degreeClass(degrees_[v]) & 1);
+}
+
+// 始点, 終点の次数の分類がそれぞれ classes[0], classes[1] に含まれている辺の辺番号を edgeids に入れる。
+// 始点の分類ごとの頂点集合から始点を選ぶので、条件に合わない始点の辺は見ない。
+void NearTriangulation::edgesInDegreeClasses(const std::array<uint32_t, 2> &classes, vector<int> &edgeids) const {
+    const auto &edges = topology_->edges_;
+    const auto &first_edge_ids = topology_->first_edge_ids_;
+    edgeids.clear();
+    for (int w = 0;w < num_words_; w++) {
+        uint64_t vertices = 0;
+        for (int c = 0;c < NUM_DEGREE_CLASSES; c++) {
+            if (classes[0] >> c & 1) vertices |= class_vertices_[c * num_words_ + w];
+        }
+        while (vertices) {
+            int u = w * 64 + __builtin_ctzll(vertices);
+            vertices &= vertices - 1;
+            for (int edgeid = first_edge_ids[u];edgeid < first_edge_ids[u + 1]; edgeid++) {
+                if (classes[1] >> degreeClass(degrees_[edges[edgeid].second]) & 1) edgeids.push_back(edgeid);
+            }
+        }
+    }
+    return;
+}
+
+
+void NearTriangulation::setDegree(int v, const Degree &degree) {
+    class_vertices_[degreeClass(degrees_[v]) * num_words_ + v / 64] &= ~(1ULL << (v % 64));
     degrees_[v] = degree;
+    class_vertices_[degreeClass(degrees_[v]) * num_words_ + v / 64] |= 1ULL << (v % 64);
     return;
 }
 
+// before から次数が変わった頂点を返す。 (before とは次数だけが異なるグラフであるとする。)
+vector<int> NearTriangulation::changedVertices(const NearTriangulation &before) const {
+    assert(vertex_size_ == before.vertex_size_);
+    vector<int> changed_vertices;
+    for (int v = 0;v < vertex_size_; v++) {
+        if (degrees_[v] != before.degrees_[v]) changed_vertices.push_back(v);
+    }
+    return changed_vertices;
+}
+
+// sources のいずれかの頂点からの距離を返す。 max_distance より遠い頂点は max_distance + 1 とする。
+vector<int> NearTriangulation::distancesFrom(const vector<int> &sources, int max_distance) const {
+    const auto &edges = topology_->edges_;
+    const auto &first_edge_ids = topology_->first_edge_ids_;
+    vector<int> dist(vertex_size_, max_distance + 1);
+    vector<int> queue;
+    queue.reserve(vertex_size_);
+    for (int v : sources) {
+        if (dist[v] == 0) continue;
+        dist[v] = 0;
+        queue.push_back(v);
+    }
+    for (int qi = 0;qi < (int)queue.size(); qi++) {
+        int v = queue[qi];
+        if (dist[v] == max_distance) continue;
+        for (int edgeid = first_edge_ids[v];edgeid < first_edge_ids[v + 1]; edgeid++) {
+            int u = edges[edgeid].second;
+            if (dist[u] <= dist[v] + 1) continue;
+            dist[u] = dist[v] + 1;
+            queue.push_back(u);
+        }
+    }
+    return dist;
+}
+
+// root_edgeids のいずれかの辺を根として頂点に番号を付け直したときの、次数付きのグラフの標準形を返す。
+// 根の辺 (u, v) の u, v に 0, 1 を付け、三角形をたどって (diagonal vertex を) 見つけた順に番号を付ける。
+// 根の辺の diagonal vertex が 2 個のときは、鏡映に対応してどちらから番号を付けるかで 2 通り考える。
+// 標準形は (頂点数) (新しい番号順の次数の mask) * N (新しい番号での辺の昇順) * E を
+// 全ての根と鏡映について計算したもののうち辞書順最小のものとする。次数が定まっていない頂点の mask は 0 である。
+// 根と鏡映を保って次数が一致する同型写像があれば標準形は一致する。
+// 三角形をたどって到達できない頂点がある場合は空の vector を返す。
+vector<int> NearTriangulation::canonicalCode(const vector<int> &root_edgeids) const {
+    const auto &edges = topology_->edges_;
+    const auto &diagonal_vertices = topology_->diagonal_vertices_;
+    vector<int> best;
+    vector<int> labels(vertex_size_, -1);
+    vector<int> order;
+    order.reserve(vertex_size_);
+    vector<char> visited_edges(edges.size(), false);
+    vector<int> code;
+    vector<pair<int, int>> labeled_edges(edges.size());
+
+    auto set_label = [&](int v) -> void {
+        labels[v] = (int)order.size();
+        order.push_back(v);
+        return;
+    };
+
+    // 辺 edgeid の diagonal vertex に番号を付けて、三角形の残りの 2 辺をたどる。
+    // 番号が付いている diagonal vertex を番号順にたどってから、番号の付いていないものをたどる。
+    auto visit_edge = [&](auto &&visit_edge, int edgeid, bool reflect) -> void {
+        if (edgeid == -1 || visited_edges[edgeid]) return;
+        visited_edges[edgeid] = true;
+        auto [u, v] = edges[edgeid];
+        std::array<int, 2> diagonals = {-1, -1};
+        int num_diagonals = diagonal_vertices[edgeid].size();
+        for (int i = 0;i < num_diagonals; i++) diagonals[i] = diagonal_vertices[edgeid][i];
+        if (num_diagonals == 2) {
+            auto key = [&](int d) { return labels[d] == -1 ? vertex_size_ : labels[d]; };
+            if (key(diagonals[0]) > key(diagonals[1]) || (key(diagonals[0]) == key(diagonals[1]) && reflect)) {
+                std::swap(diagonals[0], diagonals[1]);
+            }
+        }
+        for (int i = 0;i < num_diagonals; i++) {
+            int d = diagonals[i];
+            if (labels[d] == -1) set_label(d);
+            visit_edge(visit_edge, edgeId(u, d), false);
+            visit_edge(visit_edge, edgeId(v, d), false);
+        }
+        return;
+    };
+
+    for (int root_edgeid : root_edgeids) {
+        int num_reflections = diagonal_vertices[root_edgeid].size() == 2 ? 2 : 1;
+        for (int reflect = 0;reflect < num_reflections; reflect++) {
+            std::fill(labels.begin(), labels.end(), -1);
+            std::fill(visited_edges.begin(), visited_edges.end(), false);
+            order.clear();
+            set_label(edges[root_edgeid].first);
+            set_label(edges[root_edgeid].second);
+            visit_edge(visit_edge, root_edgeid, reflect);
+            if ((int)order.size() < vertex_size_) return {};
+
+            code.clear();
+            code.push_back(vertex_size_);
+            for (int v : order) {
+                code.push_back(degrees_[v].mask());
+            }
+            for (int edgeid = 0;edgeid < (int)edges.size(); edgeid++) {
+                labeled_edges[edgeid] = std::make_pair(labels[edges[edgeid].first], labels[edges[edgeid].second]);
+            }
+            std::sort(labeled_edges.begin(), labeled_edges.end());
+            for (const auto &[u, v] : labeled_edges) {
+                code.push_back(u);
+                code.push_back(v);
+            }
+            if (best.empty() || code < best) best = code;
+        }
+    }
+    return best;
+}
+
+size_t CanonicalCodeHash::operator()(const vector<int> &code) const {
+    size_t hash = code.size();
+    for (int x : code) {
+        hash ^= std::hash<int>()(x) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+}
+
+// hash に頂点数、頂点の次数 (の mask)、辺 (辺番号の順) を加えたハッシュを返す。
+// 頂点や辺の番号を付け替えたものは区別する。
+uint64_t NearTriangulation::contentHash(uint64_t hash) const {
+    hash = hashInt(hash, vertex_size_);
+    for (const auto &degree : degrees_) hash = hashInt(hash, degree.mask());
+    for (const auto &[u, v] : topology_->edges_) {
+        hash = hashInt(hash, u);
+        hash = hashInt(hash, v);
+    }
+    return hash;
+}
+
+uint64_t hashInt(uint64_t hash, int64_t value) {
+    for (int i = 0;i < 8; i++) {
+        hash ^= (uint64_t)value >> (8 * i) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
 
 string NearTriangulation::debug(void) const {
     string buf = "";
     vector<set<int>> VtoV(vertex_size_);
-    for (const auto &e : edges_) {
+    for (const auto &e : topology_->edges_) {
         VtoV[e.first].insert(e.second);
         VtoV[e.second].insert(e.first);
     }
     for (int v = 0;v < vertex_size_; v++) {
-        buf += fmt::format("{} {} {}\n", v, degrees_[v] ? degrees_[v].value().toString() : "?", fmt::join(VtoV[v], ", "));
+        buf += fmt::format("{} {} {}\n", v, degrees_[v].unset() ? "?" : degrees_[v].toString(), fmt::join(VtoV[v], ", "));
     }
     return buf;
 }
@@ -6,6 +6,9 @@
 #include <fstream>
 #include <set>
 #include <optional>
+#include <array>
+#include <cstdint>
+#include <memory>
 
 using std::vector;
 using std::pair;
@@ -18,47 +21,151 @@ using std::optional;
 // 次数は高々12くらいまでしか考えないので inf として1000を設定
 const int MAX_DEGREE = 1000;
 const int MIN_DEGREE = 5;
+// Degree の bit の数
+// bit i (0 <= i < 15) は次数 5 + i を、 bit 15 は次数 20 以上を表す。
+const int NUM_DEGREE_BITS = 16;
 
+// 次数のとりうる値の集合 (5, 6, ..., 19, 20+ の 16 通りの bit mask)
+// 空集合はまだ次数が定まっていない状態を表す。 (Degree() で作る。)
+// 集合は常に区間なので、包含や共通部分の判定は bit 演算で区間の判定と一致する。
+// 20 以上の次数は区別しない。
 class Degree {
 private:
-    int lower_deg_, upper_deg_;
+    uint16_t mask_;
 
 public:
+    Degree(void) : mask_(0) {};
     Degree(int lower_deg, int upper_deg);
     Degree(int deg);
     static Degree fromString(const string &str);
+    static Degree fromMask(uint16_t mask) { Degree degree; degree.mask_ = mask; return degree; }
 
     int lower(void) const;
     int upper(void) const;
+    uint16_t mask(void) const { return mask_; }
 
     string toString(void) const;
-    bool include(const Degree &degree) const;
-    static bool disjoint(const Degree &degree0, const Degree &degree1);
-    bool fixed(void) const;
+    // 次数が定まっていないかどうか
+    bool unset(void) const { return mask_ == 0; }
+    bool include(const Degree &degree) const { return (mask_ & degree.mask_) == degree.mask_; }
+    static bool disjoint(const Degree &degree0, const Degree &degree1) { return (degree0.mask_ & degree1.mask_) == 0; }
+    // 次数が 1 つに定まっているかどうか (20+ は定まっていないとする。)
+    bool fixed(void) const { return mask_ != 0 && (mask_ & (mask_ - 1)) == 0 && mask_ != (1u << (NUM_DEGREE_BITS - 1)); }
+    bool operator==(const Degree &degree) const { return mask_ == degree.mask_; }
+    bool operator!=(const Degree &degree) const { return mask_ != degree.mask_; }
 };
 
-vector<Degree> divideDegree(const Degree &degree, int max_degree);
+// divideDegree の結果 (高々 NUM_DEGREE_BITS 個の次数) を格納する。
+class DividedDegrees {
+private:
+    std::array<Degree, NUM_DEGREE_BITS> degrees_;
+    int size_;
+
+public:
+    DividedDegrees(void) : size_(0) {};
+    void push_back(const Degree &degree) { degrees_[size_++] = degree; }
+    int size(void) const { return size_; }
+    const Degree &operator[](int i) const { return degrees_[i]; }
+    const Degree *begin(void) const { return degrees_.data(); }
+    const Degree *end(void) const { return degrees_.data() + size_; }
+};
+
+DividedDegrees divideDegree(const Degree &degree, int max_degree);
+
+// 辺の端点の次数で照合する辺を絞り込むときに使う次数の分類
+// 0: 次数が定まっていない
+// 1, 2, ..., 15: 次数が 5, 6, ..., 19 に定まっている
+// 16: それ以外 (5+ のように範囲で与えられている次数など)
+const int NUM_DEGREE_CLASSES = 17;
+const int DEGREE_CLASS_OTHER = NUM_DEGREE_CLASSES - 1;
+int degreeClass(const Degree &degree);
+// 次数の条件が condition である頂点と照合したときに、次数が適合しうる頂点の次数の分類の集合 (bit mask) を返す。
+// BaseWheel::containSubgraphWithCorrespondingEdge の match_degree と同じ規則で、分類だけでは判定できないものは含める。
+uint32_t acceptedDegreeClasses(const Degree &condition, bool detect_possible);
+
+// 辺の diagonal vertex (高々 2 個) を格納する。
+class DiagonalVertices {
+private:
+    std::array<int, 2> vertices_;
+    int size_;
+
+public:
+    DiagonalVertices(void) : vertices_({-1, -1}), size_(0) {};
+    void push_back(int v) { vertices_[size_++] = v; }
+    int size(void) const { return size_; }
+    int operator[](int i) const { return vertices_[i]; }
+    const int *begin(void) const { return vertices_.data(); }
+    const int *end(void) const { return vertices_.data() + size_; }
+};
+
+// NearTriangulation のうち次数以外の部分 (辺集合と、辺集合から計算する索引)
+// 構築した後は変更しないので、次数だけが異なる NearTriangulation の間で共有する。
+class NearTriangulationTopology {
+private:
+    friend class NearTriangulation;
+    int vertex_size_;
+    // 辺集合 (有向辺として両方向を持つ。 始点の昇順、同じ始点なら終点の昇順に並んでいる。)
+    vector<pair<int, int>> edges_;
+    // reverse_edge_ids_[e] := 辺 e を逆向きにした辺の辺番号
+    vector<int> reverse_edge_ids_;
+    // diagonal_vertices_[e] := 辺番号 e の辺を含む三角形の頂点であって、 e の端点でない頂点
+    vector<DiagonalVertices> diagonal_vertices_;
+    // edge_ids_[u * vertex_size_ + v] := 辺 (u, v) の辺番号 (辺がなければ -1)
+    // グラフは小さいので頂点対ごとに表を持つ。
+    vector<int> edge_ids_;
+    // 始点が v の辺の辺番号は first_edge_ids_[v], ..., first_edge_ids_[v + 1] - 1
+    vector<int> first_edge_ids_;
+
+public:
+    NearTriangulationTopology(int vertex_size, vector<pair<int, int>> edges, vector<DiagonalVertices> diagonal_vertices);
+};
 
 class NearTriangulation {
 private:
     int vertex_size_;
     // 頂点の次数
-    // std::nullopt はまだ次数が定まっていない状態を表す。
-    vector<optional<Degree>> degrees_;
-    // 辺集合
-    vector<pair<int, int>> edges_;
-    // diagonal_vertices_[e] := 辺 e を含む三角形の頂点であって、 e の端点でない頂点
-    map<pair<int, int>, vector<int>> diagonal_vertices_;
+    // Degree() (空集合) はまだ次数が定まっていない状態を表す。
+    vector<Degree> degrees_;
+    // 辺集合などの次数によらない部分
+    // コピーしたものとは共有し、 setDegree では degrees_ と class_vertices_ だけを書き換える。
+    std::shared_ptr<const NearTriangulationTopology> topology_;
+    // 次数の分類 c の頂点の集合 (bitset)
+    // class_vertices_[c * num_words_ + (v / 64)] の (v % 64) bit 目が v に対応する。 setDegree で更新する。
+    int num_words_;
+    vector<uint64_t> class_vertices_;
+
+    void buildDegreeClassIndex(void);
 
 public:
-    NearTriangulation(int vertex_size, const vector<set<int>> &VtoV, const vector<optional<Degree>> &degrees);
+    NearTriangulation(int vertex_size, const vector<set<int>> &VtoV, const vector<Degree> &degrees);
+    NearTriangulation(int vertex_size, const vector<pair<int, int>> &edges, const vector<DiagonalVertices> &diagonal_vertices, const vector<Degree> &degrees);
 
     int vertexSize(void) const;
-    const vector<optional<Degree>> &degrees(void) const;
+    const vector<Degree> &degrees(void) const;
+    const std::shared_ptr<const NearTriangulationTopology> &topology(void) const;
     const vector<pair<int, int>> &edges(void) const;
-    const map<pair<int, int>, vector<int>> &diagonalVertices(void) const;
+    const DiagonalVertices &diagonalVertices(int edgeid) const;
+    int edgeId(int u, int v) const;
+    int reverseEdgeId(int edgeid) const;
+    bool edgeInDegreeClasses(int edgeid, const std::array<uint32_t, 2> &classes) const;
+    void edgesInDegreeClasses(const std::array<uint32_t, 2> &classes, vector<int> &edgeids) const;
 
-    void setDegree(int v, const optional<Degree> &degree);
+    void setDegree(int v, const Degree &degree);
+    vector<int> changedVertices(const NearTriangulation &before) const;
+    vector<int> distancesFrom(const vector<int> &sources, int max_distance) const;
+    vector<int> canonicalCode(const vector<int> &root_edgeids) const;
+    uint64_t contentHash(uint64_t hash) const;
     string debug(void) const;
 };
 
+// rule や conf の内容のハッシュ (FNV-1a) の初期値と、 hash に value を加えたハッシュ
+// 実行ごとに変わらないので checkpoint の fingerprint に使う。
+const uint64_t CONTENT_HASH_SEED = 14695981039346656037ULL;
+uint64_t hashInt(uint64_t hash, int64_t value);
+
+// canonicalCode を unordered_map などのキーにするときのハッシュ関数
+class CanonicalCodeHash {
+public:
+    size_t operator()(const vector<int> &code) const;
+};
+
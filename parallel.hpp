@@ -0,0 +1,191 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+
+using std::vector;
+
+// タスク 0, 1, ..., num_tasks-1 を num_threads 個のスレッドで分担して f(task) を実行する。
+// タスクは番号の小さい順に空いているスレッドに割り当てる。
+// num_threads <= 1 のときは呼び出したスレッドで順に実行する。
+template <class F>
+void parallelFor(int num_tasks, int num_threads, F &&f) {
+    num_threads = std::min(num_threads, num_tasks);
+    if (num_threads <= 1) {
+        for (int task = 0;task < num_tasks; task++) f(task);
+        return;
+    }
+    std::atomic<int> next_task(0);
+    auto worker = [&]() -> void {
+        while (true) {
+            int task = next_task.fetch_add(1);
+            if (task >= num_tasks) return;
+            f(task);
+        }
+    };
+    vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (int i = 0;i < num_threads; i++) threads.emplace_back(worker);
+    for (auto &thread : threads) thread.join();
+    return;
+}
+
+// tasks を初期タスクとして、 num_threads 個のスレッドで work stealing により f(task, worker, spawn) を実行する。
+// + worker はタスクを実行しているスレッドの番号 (0, 1, ..., num_threads-1) で、スレッドごとの結果を持つときに使う。
+// + spawn(new_task) で新しいタスクを自分のスレッドの deque に追加する。
+// 各スレッドは自分の deque の末尾からタスクを取り (深さ優先)、空のときは他のスレッドの deque の先頭から盗む。
+// 盗めるタスクがないスレッドは、タスクが追加されるか全てのタスクが終わるまで condition variable で待つ。
+// 全てのタスク (途中で追加したものを含む) が終わったら戻る。
+// f (または checkpoint) が例外を投げたときは、他のスレッドも実行中のタスクを終えたら止め、全てのスレッドを join してから最初の例外を投げ直す。
+//
+// checkpoint_interval ごとに全てのスレッドが実行中のタスクを終えるまで待って止め、
+// まだ実行していないタスクを渡して checkpoint(pending_tasks) を呼ぶ。 (このとき f が書き込む結果も読んでよい。)
+// 例外で止めるときは、失敗したタスクが含まれない途中経過を残さないように checkpoint を呼ばない。
+template <class Task, class F, class C>
+void workStealing(vector<Task> tasks, int num_threads, F &&f, std::chrono::steady_clock::duration checkpoint_interval, C &&checkpoint) {
+    num_threads = std::max(num_threads, 1);
+    class TaskDeque {
+    public:
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    vector<TaskDeque> deques(num_threads);
+    for (int i = 0;i < (int)tasks.size(); i++) deques[i % num_threads].tasks.push_back(std::move(tasks[i]));
+    // 実行中または deque に入っているタスクの数
+    std::atomic<long long> num_pending((long long)tasks.size());
+
+    // checkpoint はスレッド 0 が呼ぶ。他のスレッドは pause_requested を見たら止まって num_paused を増やす。
+    std::mutex pause_mutex;
+    std::condition_variable pause_cv;
+    std::atomic<bool> pause_requested(false);
+    int num_paused = 0, num_exited = 0;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+
+    // 例外を投げたスレッドは stopped を立てて、最初の例外を error に入れる。 (pause_mutex で守る。)
+    std::atomic<bool> stopped(false);
+    std::exception_ptr error;
+
+    // 盗めるタスクがないスレッドは idle_cv で待つ。 spawn は待っているスレッドがあるときだけ起こす。
+    // (起こし損ねてもスレッド 0 が checkpoint の時刻を確かめられるように、一定時間ごとに起きる。)
+    std::mutex idle_mutex;
+    std::condition_variable idle_cv;
+    std::atomic<int> num_idle(0);
+    const auto IDLE_WAIT = std::chrono::milliseconds(10);
+    auto wake_idle = [&](bool all) -> void {
+        { std::lock_guard<std::mutex> lock(idle_mutex); }
+        if (all) idle_cv.notify_all();
+        else idle_cv.notify_one();
+    };
+    auto has_task = [&]() -> bool {
+        for (auto &deque : deques) {
+            std::lock_guard<std::mutex> lock(deque.mutex);
+            if (!deque.tasks.empty()) return true;
+        }
+        return false;
+    };
+
+    auto worker = [&](int w) -> void {
+        auto spawn = [&](Task &&task) -> void {
+            num_pending.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(deques[w].mutex);
+                deques[w].tasks.push_back(std::move(task));
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (num_idle.load() > 0) wake_idle(false);
+        };
+        try {
+            while (num_pending.load() > 0 && !stopped.load()) {
+                if (w != 0 && pause_requested.load()) {
+                    std::unique_lock<std::mutex> lock(pause_mutex);
+                    num_paused++;
+                    pause_cv.notify_all();
+                    pause_cv.wait(lock, [&]() { return !pause_requested.load() || stopped.load(); });
+                    num_paused--;
+                    continue;
+                }
+                if (w == 0 && std::chrono::steady_clock::now() - last_checkpoint >= checkpoint_interval) {
+                    pause_requested.store(true);
+                    wake_idle(true);
+                    {
+                        std::unique_lock<std::mutex> lock(pause_mutex);
+                        pause_cv.wait(lock, [&]() { return num_paused + num_exited == num_threads - 1; });
+                    }
+                    if (!stopped.load()) {
+                        vector<Task> pending_tasks;
+                        for (auto &deque : deques) pending_tasks.insert(pending_tasks.end(), deque.tasks.begin(), deque.tasks.end());
+                        checkpoint(pending_tasks);
+                    }
+                    last_checkpoint = std::chrono::steady_clock::now();
+                    {
+                        std::lock_guard<std::mutex> lock(pause_mutex);
+                        pause_requested.store(false);
+                    }
+                    pause_cv.notify_all();
+                    continue;
+                }
+                std::optional<Task> task;
+                {
+                    std::lock_guard<std::mutex> lock(deques[w].mutex);
+                    if (!deques[w].tasks.empty()) {
+                        task.emplace(std::move(deques[w].tasks.back()));
+                        deques[w].tasks.pop_back();
+                    }
+                }
+                for (int k = 1;k < num_threads && !task.has_value(); k++) {
+                    auto &victim = deques[(w + k) % num_threads];
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (!victim.tasks.empty()) {
+                        task.emplace(std::move(victim.tasks.front()));
+                        victim.tasks.pop_front();
+                    }
+                }
+                if (!task.has_value()) {
+                    std::unique_lock<std::mutex> lock(idle_mutex);
+                    num_idle.fetch_add(1);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    idle_cv.wait_for(lock, IDLE_WAIT, [&]() {
+                        return num_pending.load() == 0 || stopped.load() || (w != 0 && pause_requested.load()) || has_task();
+                    });
+                    num_idle.fetch_sub(1);
+                    continue;
+                }
+                f(std::move(task.value()), w, spawn);
+                if (num_pending.fetch_sub(1) == 1) wake_idle(true);
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(pause_mutex);
+                if (!error) error = std::current_exception();
+                stopped.store(true);
+            }
+            pause_cv.notify_all();
+            wake_idle(true);
+        }
+        {
+            std::lock_guard<std::mutex> lock(pause_mutex);
+            num_exited++;
+        }
+        pause_cv.notify_all();
+    };
+    vector<std::thread> threads;
+    threads.reserve(num_threads);
+    for (int w = 0;w < num_threads; w++) threads.emplace_back(worker, w);
+    for (auto &thread : threads) thread.join();
+    if (error) std::rethrow_exception(error);
+    return;
+}
+
+// checkpoint を取らない workStealing
+template <class Task, class F>
+void workStealing(vector<Task> tasks, int num_threads, F &&f) {
+    workStealing(std::move(tasks), num_threads, std::forward<F>(f), std::chrono::steady_clock::duration::max(), [](const vector<Task> &) {});
+    return;
+}
@@ -0,0 +1,139 @@
+#!/bin/bash
+
+#
+# The script is used to check that a change of the program keeps the results and does not slow down the search.
+# It evaluates the wheels listed in ./perf/wheels.txt (a few wheels per degree of the hub, including heavy ones)
+# one by one with ./<build directory>/a.out, and enumerates the cases that degree 6 sends charge to degree 7+ with
+# ./<build directory>/send.
+# Then it compares
+# + the number of cartwheels to check and the number of overcharged cartwheels (the number of cases for send)
+#   with the golden values in ./perf/golden.txt (they must be equal),
+# + the elapsed time of the evaluation (the whole run for send) and the peak RSS of the process
+#   with the baseline in ./perf/baseline.txt (they must not exceed the baseline by more than
+#   PERF_TIME_TOLERANCE percent + PERF_TIME_SLACK_MS ms and PERF_RSS_TOLERANCE percent, 10, 50 and 10 by default).
+# With "update", the golden values and the baseline are written from this run instead.
+# The golden values depend on the rules and the configurations, and the baseline depends on the machine,
+# so both files record the numbers of rule files and configuration files, and the comparison is rejected if they differ.
+# The peak RSS is reported by the process itself ("max_rss_kb" of the result for a.out, "max rss" of the log for send).
+#
+# Usage)
+# bash perf_regress.sh <The build directory> <The directory that contains rule files> <The directory that contains configuration files> [update]
+#
+# Example)
+# bash perf_regress.sh build projective_configurations/rule projective_configurations/reducible/conf update
+# bash perf_regress.sh build projective_configurations/rule projective_configurations/reducible/conf
+#
+# The same is run by "cmake --build build --target perf-regress" (or perf-regress-update)
+# with -DPERF_RULE_DIR=<rule directory> -DPERF_CONF_DIR=<configuration directory>.
+#
+
+set -euo pipefail
+cd $(dirname $0)
+
+if [ $# -ne 3 ] && { [ $# -ne 4 ] || [ "$4" != "update" ]; }; then
+    echo -e "\e[31merror:\e[m Please follow the usage 'bash perf_regress.sh <The build directory> <The directory that contains rule files> <The directory that contains configuration files> [update]'"
+    exit 1
+fi
+
+build=$1
+rule=$2
+conf=$3
+update=${4:-}
+golden="./perf/golden.txt"
+baseline="./perf/baseline.txt"
+time_tolerance=${PERF_TIME_TOLERANCE:-10}
+time_slack_ms=${PERF_TIME_SLACK_MS:-50}
+rss_tolerance=${PERF_RSS_TOLERANCE:-10}
+corpus="corpus $(ls "$rule" | grep -c '\.rule$') $(ls "$conf" | grep -c '\.conf$')"
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# run the command (the output is written to the log file of the first argument) and set wall_ms to the elapsed time (ms)
+run_measured() {
+    local log=$1
+    shift
+    local start=$(date +%s%N)
+    if ! "$@" > "$log" 2>&1; then
+        tail -n 20 "$log"
+        echo -e "\e[31merror:\e[m '$*' failed"
+        exit 1
+    fi
+    wall_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+}
+
+# lines of "<name> <the number of candidates> <the number of overcharged>" and "<name> <ms> <peak RSS (kB)>"
+: > "$tmp/golden.txt"
+: > "$tmp/baseline.txt"
+
+for wheel in $(grep -v '^#' ./perf/wheels.txt); do
+    run_measured "$tmp/$wheel.log" "$build/a.out" -w "./proj_wheel/$wheel" -r "$rule" -c "$conf" -s ./proj_send -m 9 -R "$tmp/results.jsonl"
+    result=$(grep "\"id\":\"$wheel\"" "$tmp/results.jsonl" | tail -n 1)
+    candidates=$(echo "$result" | sed -E 's/.*"candidates":([0-9]+).*/\1/')
+    overcharged=$(echo "$result" | sed -E 's/.*"overcharged":([0-9]+).*/\1/')
+    total_ms=$(echo "$result" | sed -E 's/.*"total":([0-9]+).*/\1/')
+    max_rss_kb=$(echo "$result" | sed -E 's/.*"max_rss_kb":([0-9]+).*/\1/')
+    echo "$wheel $candidates $overcharged" >> "$tmp/golden.txt"
+    echo "$wheel $total_ms $max_rss_kb" >> "$tmp/baseline.txt"
+done
+
+run_measured "$tmp/send.log" "$build/send" -f 6 -t 7+ -r "$rule" -c "$conf" -m 9
+cases=$(grep -oE 'There are [0-9]+ case' "$tmp/send.log" | grep -oE '[0-9]+')
+max_rss_kb=$(grep -oE 'max rss : [0-9]+ kB' "$tmp/send.log" | grep -oE '[0-9]+')
+echo "send_6_7+ $cases -" >> "$tmp/golden.txt"
+echo "send_6_7+ $wall_ms $max_rss_kb" >> "$tmp/baseline.txt"
+
+if [ "$update" = "update" ]; then
+    mkdir -p ./perf
+    (echo "$corpus"; cat "$tmp/golden.txt") > "$golden"
+    (echo "$corpus"; cat "$tmp/baseline.txt") > "$baseline"
+    echo "wrote $golden and $baseline"
+    exit 0
+fi
+
+for file in "$golden" "$baseline"; do
+    if [ ! -f "$file" ]; then
+        echo -e "\e[31merror:\e[m $file does not exist. Make it by 'bash perf_regress.sh $build $rule $conf update'"
+        exit 1
+    fi
+    if [ "$(head -n 1 "$file")" != "$corpus" ]; then
+        echo -e "\e[31merror:\e[m $file was made with other rules or configurations ($(head -n 1 "$file"), but $corpus now)"
+        exit 1
+    fi
+done
+
+failed=0
+printf "%-16s %10s %10s %10s %10s %12s %12s\n" name candidates overcharged ms base_ms rss_kb base_rss_kb
+while read -r name candidates overcharged; do
+    read -r golden_candidates golden_overcharged <<< "$(grep "^$name " "$golden" | cut -d ' ' -f 2-)"
+    read -r ms rss_kb <<< "$(grep "^$name " "$tmp/baseline.txt" | cut -d ' ' -f 2-)"
+    read -r base_ms base_rss_kb <<< "$(grep "^$name " "$baseline" | cut -d ' ' -f 2-)"
+    printf "%-16s %10s %10s %10s %10s %12s %12s\n" "$name" "$candidates" "$overcharged" "$ms" "${base_ms:--}" "$rss_kb" "${base_rss_kb:--}"
+    if [ -z "${golden_candidates:-}" ] || [ -z "${base_ms:-}" ]; then
+        echo -e "\e[31mfailed:\e[m $name is not in $golden or $baseline"
+        failed=$(($failed+1))
+        continue
+    fi
+    if [ "$candidates" != "$golden_candidates" ] || [ "$overcharged" != "$golden_overcharged" ]; then
+        echo -e "\e[31mfailed:\e[m $name has $overcharged/$candidates overcharged cartwheels ($golden_overcharged/$golden_candidates expected)"
+        failed=$(($failed+1))
+    fi
+    if [ $ms -gt $(( base_ms * (100 + time_tolerance) / 100 + time_slack_ms )) ]; then
+        echo -e "\e[31mfailed:\e[m $name took $ms ms ($base_ms ms in the baseline)"
+        failed=$(($failed+1))
+    fi
+    if [ $rss_kb -gt $(( base_rss_kb * (100 + rss_tolerance) / 100 )) ]; then
+        echo -e "\e[31mfailed:\e[m $name used $rss_kb kB ($base_rss_kb kB in the baseline)"
+        failed=$(($failed+1))
+    fi
+done < "$tmp/golden.txt"
+
+total_ms=$(awk '{s += $2} END {print s}' "$tmp/baseline.txt")
+base_total_ms=$(tail -n +2 "$baseline" | awk '{s += $2} END {print s}')
+echo "total : $total_ms ms ($base_total_ms ms in the baseline)"
+if [ $failed -eq 0 ]; then
+    echo "All passed!"
+else
+    echo "$failed checks failed"
+    exit 1
+fi
@@ -0,0 +1,363 @@
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include "result.hpp"
+
+static string escapeJson(const string &str) {
+    string res;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+            res += c;
+        } else if ((unsigned char)c < 0x20) {
+            res += fmt::format("\\u{:04x}", (int)c);
+        } else {
+            res += c;
+        }
+    }
+    return res;
+}
+
+// WheelResult::toJson で書いた 1 行を読む。
+// 読むのは WheelResult の形の JSON (値が文字列、整数、文字列の配列、整数を値とするオブジェクトのもの) だけ。
+class JsonLineReader {
+private:
+    const string &line_;
+    size_t pos_;
+
+    // 読めない行の扱い (読み飛ばすか、評価の失敗とするか) は呼び出し側で決めてログに出す。
+    [[noreturn]] void fail(const string &message) {
+        throw std::runtime_error(fmt::format("Failed to parse result ({} at {})", message, pos_));
+    }
+
+public:
+    JsonLineReader(const string &line) : line_(line), pos_(0) {}
+
+    void skipSpaces(void) {
+        while (pos_ < line_.size() && isspace((unsigned char)line_[pos_])) pos_++;
+    }
+
+    char peek(void) {
+        skipSpaces();
+        if (pos_ >= line_.size()) fail("unexpected end");
+        return line_[pos_];
+    }
+
+    void expect(char c) {
+        if (peek() != c) fail(fmt::format("expected '{}'", c));
+        pos_++;
+    }
+
+    // 次の文字が c なら読み飛ばして true を返す。
+    bool consume(char c) {
+        if (peek() != c) return false;
+        pos_++;
+        return true;
+    }
+
+    string readString(void) {
+        expect('"');
+        string res;
+        while (true) {
+            if (pos_ >= line_.size()) fail("unterminated string");
+            char c = line_[pos_++];
+            if (c == '"') break;
+            if (c != '\\') {
+                res += c;
+                continue;
+            }
+            if (pos_ >= line_.size()) fail("unterminated string");
+            char e = line_[pos_++];
+            if (e == 'u') {
+                if (pos_ + 4 > line_.size()) fail("invalid escape");
+                res += (char)std::stoi(line_.substr(pos_, 4), nullptr, 16);
+                pos_ += 4;
+            } else if (e == 'n') {
+                res += '\n';
+            } else if (e == 't') {
+                res += '\t';
+            } else {
+                res += e;
+            }
+        }
+        return res;
+    }
+
+    int64_t readInt(void) {
+        skipSpaces();
+        size_t len = 0;
+        int64_t value;
+        try {
+            value = std::stoll(line_.substr(pos_), &len);
+        } catch (const std::exception &) {
+            fail("expected integer");
+        }
+        pos_ += len;
+        return value;
+    }
+
+    bool readBool(void) {
+        if (line_.compare(pos_, 4, "true") == 0) {
+            pos_ += 4;
+            return true;
+        }
+        if (line_.compare(pos_, 5, "false") == 0) {
+            pos_ += 5;
+            return false;
+        }
+        fail("expected bool");
+    }
+
+    // { "key": value, ... } の各 key について on_key(key) を呼ぶ。 on_key は値を読む。
+    template<typename F>
+    void readObject(F &&on_key) {
+        expect('{');
+        if (consume('}')) return;
+        do {
+            string key = readString();
+            expect(':');
+            on_key(key);
+        } while (consume(','));
+        expect('}');
+    }
+
+    // 知らない key の値を読み飛ばす。
+    void skipValue(void) {
+        char c = peek();
+        if (c == '"') {
+            readString();
+        } else if (c == '[') {
+            expect('[');
+            if (consume(']')) return;
+            do skipValue(); while (consume(','));
+            expect(']');
+        } else if (c == '{') {
+            readObject([&](const string &) { skipValue(); });
+        } else if (c == 't' || c == 'f') {
+            readBool();
+        } else if (line_.compare(pos_, 4, "null") == 0) {
+            pos_ += 4;
+        } else {
+            readInt();
+        }
+    }
+};
+
+// (key, 整数) の列を {"key":value,...} にする。
+static string intObjectToJson(const vector<pair<string, int64_t>> &values) {
+    string res = "{";
+    for (int i = 0;i < (int)values.size(); i++) {
+        res += fmt::format("{}\"{}\":{}", i > 0 ? "," : "", escapeJson(values[i].first), values[i].second);
+    }
+    res += "}";
+    return res;
+}
+
+bool WheelResult::succeeded(void) const {
+    return !failed && num_overcharged == 0;
+}
+
+string WheelResult::toJson(void) const {
+    string res = fmt::format("{{\"id\":\"{}\",\"wheel\":\"{}\",\"status\":\"{}\"", escapeJson(id), escapeJson(wheel), failed ? "failed" : "ok");
+    if (failed) res += fmt::format(",\"error\":\"{}\"", escapeJson(error));
+    res += fmt::format(",\"candidates\":{},\"overcharged\":{},\"payloads\":[", num_candidates, num_overcharged);
+    for (int i = 0;i < (int)payloads.size(); i++) {
+        res += fmt::format("{}\"{}\"", i > 0 ? "," : "", escapeJson(payloads[i]));
+    }
+    res += "],\"elapsed_ms\":" + intObjectToJson(elapsed_ms);
+    if (!counters.empty()) res += ",\"counters\":" + intObjectToJson(counters);
+    if (!timers_ms.empty()) res += ",\"timers_ms\":" + intObjectToJson(timers_ms);
+    if (max_rss_kb > 0) res += fmt::format(",\"max_rss_kb\":{}", max_rss_kb);
+    res += "}";
+    return res;
+}
+
+string WheelEstimate::toJson(void) const {
+    return fmt::format("{{\"id\":\"{}\",\"wheel\":\"{}\",\"hub_degree\":{},\"unfixed_neighbors\":{},\"send_cases\":{},"
+        "\"probes\":{},\"nodes\":{:.1f},\"leaves\":{:.1f},\"predicted_ms\":{:.1f},\"elapsed_ms\":{:.1f}}}",
+        escapeJson(id), escapeJson(wheel), hub_degree, unfixed_neighbors, send_cases, probes, nodes, leaves, predicted_ms, elapsed_ms);
+}
+
+WheelResult WheelResult::fromJson(const string &line) {
+    WheelResult result;
+    JsonLineReader reader(line);
+    reader.readObject([&](const string &key) {
+        if (key == "id") {
+            result.id = reader.readString();
+        } else if (key == "wheel") {
+            result.wheel = reader.readString();
+        } else if (key == "status") {
+            result.failed = reader.readString() != "ok";
+        } else if (key == "error") {
+            result.error = reader.readString();
+        } else if (key == "candidates") {
+            result.num_candidates = reader.readInt();
+        } else if (key == "overcharged") {
+            result.num_overcharged = reader.readInt();
+        } else if (key == "max_rss_kb") {
+            result.max_rss_kb = reader.readInt();
+        } else if (key == "payloads") {
+            reader.expect('[');
+            if (reader.consume(']')) return;
+            do result.payloads.push_back(reader.readString()); while (reader.consume(','));
+            reader.expect(']');
+        } else if (key == "elapsed_ms" || key == "counters" || key == "timers_ms") {
+            auto &values = key == "elapsed_ms" ? result.elapsed_ms : key == "counters" ? result.counters : result.timers_ms;
+            reader.readObject([&](const string &name) {
+                values.push_back({name, reader.readInt()});
+            });
+        } else {
+            reader.skipValue();
+        }
+    });
+    return result;
+}
+
+// 書き出している途中でプロセスが止まって最後の行が改行で終わっていないときは、改行してから追記する。
+// (続けて書くと次の結果まで読めない行になってしまう。)
+ResultWriter::ResultWriter(const string &filename) {
+    bool ends_with_newline = true;
+    {
+        std::ifstream ifs(filename, std::ios::binary);
+        if (ifs && ifs.seekg(-1, std::ios::end)) ends_with_newline = ifs.get() == '\n';
+    }
+    ofs_.open(filename, std::ios::app);
+    if (!ofs_) {
+        spdlog::critical("Failed to open {}", filename);
+        throw std::runtime_error("Failed to open " + filename);
+    }
+    if (!ends_with_newline) ofs_ << std::endl;
+}
+
+// 1 行ずつ書き出してすぐに flush するので、途中で止まっても書き終えた wheel の結果は残る。
+void ResultWriter::write(const WheelResult &result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ofs_ << result.toJson() << std::endl;
+    return;
+}
+
+void ResultWriter::write(const WheelEstimate &estimate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ofs_ << estimate.toJson() << std::endl;
+    return;
+}
+
+// result_filename の評価結果を 1 行ずつ読んで f に渡す。
+// 読めない行 (書き出している途中でプロセスが止まったときの最後の行など) は警告を出して読み飛ばすので、
+// その wheel は結果がないものとして扱われる。
+void readResults(const string &result_filename, const std::function<void(WheelResult &&)> &f) {
+    std::ifstream ifs(result_filename);
+    if (!ifs) {
+        spdlog::critical("Failed to open {}", result_filename);
+        throw std::runtime_error("Failed to open " + result_filename);
+    }
+    string line;
+    int line_number = 0;
+    while (std::getline(ifs, line)) {
+        line_number++;
+        if (line.empty()) continue;
+        WheelResult result;
+        try {
+            result = WheelResult::fromJson(line);
+        } catch (const std::exception &e) {
+            spdlog::warn("Skipped line {} of {} : {}", line_number, result_filename, e.what());
+            continue;
+        }
+        f(std::move(result));
+    }
+    return;
+}
+
+// result_filenames の評価結果を 1 度ずつ読んでまとめる。同じ wheel の結果が複数あるときは後のものを使う。
+// hub_degree が正のときは <hub_degree>_<begin>.wheel, ..., <hub_degree>_<end>.wheel を集計の対象とし、結果がないものも数える。
+// remaining_filename が指定されているときは、 overcharged な cartwheel が残っているか評価に失敗したか結果のない wheel の名前を 1 行に 1 つ書き出す。
+void aggregateResults(const vector<string> &result_filenames, int hub_degree, int begin, int end, const string &remaining_filename) {
+    // 集計に使わない payloads は捨てておく。
+    std::map<string, WheelResult> results;
+    int num_records = 0;
+    for (const auto &filename : result_filenames) {
+        readResults(filename, [&](WheelResult &&result) {
+            result.payloads.clear();
+            results[result.id] = std::move(result);
+            num_records++;
+        });
+    }
+
+    vector<string> ids;
+    if (hub_degree > 0) {
+        for (int i = begin;i <= end; i++) ids.push_back(fmt::format("{}_{}.wheel", hub_degree, i));
+    } else {
+        for (const auto &[id, result] : results) ids.push_back(id);
+    }
+
+    int num_succeeded = 0, num_overcharged_wheels = 0, num_failed = 0, num_missing = 0;
+    int64_t num_candidates = 0, num_overcharged = 0, total_ms = 0, max_ms = 0;
+    string slowest_id;
+    // 探索の統計の wheel 全体での和 (名前が初めて現れた順に並べる。)
+    vector<pair<string, int64_t>> counters, timers_ms;
+    auto accumulate = [](vector<pair<string, int64_t>> &sums, const vector<pair<string, int64_t>> &values) {
+        for (const auto &[name, value] : values) {
+            auto it = std::find_if(sums.begin(), sums.end(), [&name](const auto &sum) { return sum.first == name; });
+            if (it == sums.end()) sums.push_back({name, value});
+            else it->second += value;
+        }
+    };
+    vector<string> remaining;
+    for (const auto &id : ids) {
+        auto it = results.find(id);
+        if (it == results.end()) {
+            num_missing++;
+            remaining.push_back(id);
+            continue;
+        }
+        const auto &result = it->second;
+        num_candidates += result.num_candidates;
+        num_overcharged += result.num_overcharged;
+        accumulate(counters, result.counters);
+        accumulate(timers_ms, result.timers_ms);
+        for (const auto &[phase, ms] : result.elapsed_ms) {
+            if (phase != "total") continue;
+            total_ms += ms;
+            if (ms > max_ms) {
+                max_ms = ms;
+                slowest_id = id;
+            }
+        }
+        if (result.succeeded()) {
+            num_succeeded++;
+            continue;
+        }
+        if (result.failed) {
+            num_failed++;
+            spdlog::info("{} failed : {}", id, result.error);
+        } else {
+            num_overcharged_wheels++;
+            spdlog::info("{} has {} overcharged cartwheels", id, result.num_overcharged);
+        }
+        remaining.push_back(id);
+    }
+
+    spdlog::info("read {} records of {} wheels", num_records, results.size());
+    spdlog::info("wheels : {}, succeeded : {}, overcharged : {}, failed : {}, missing : {}", ids.size(), num_succeeded, num_overcharged_wheels, num_failed, num_missing);
+    spdlog::info("cartwheels : {}, overcharged : {}", num_candidates, num_overcharged);
+    spdlog::info("elapsed : total {} ms, max {} ms ({})", total_ms, max_ms, slowest_id);
+    for (const auto &[name, count] : counters) spdlog::info("counter {} : {}", name, count);
+    for (const auto &[name, ms] : timers_ms) spdlog::info("timer {} : {} ms", name, ms);
+    if (remaining.empty()) {
+        spdlog::info("All finished!");
+    } else {
+        spdlog::info("{} wheels remained", remaining.size());
+    }
+    if (remaining_filename != "") {
+        std::ofstream ofs(remaining_filename);
+        if (!ofs) {
+            spdlog::critical("Failed to open {}", remaining_filename);
+            throw std::runtime_error("Failed to open " + remaining_filename);
+        }
+        for (const auto &id : remaining) ofs << id << std::endl;
+    }
+    return;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+#include <functional>
+
+using std::string;
+using std::vector;
+using std::pair;
+
+// 1 つの wheel の評価結果
+// 評価結果のファイルには 1 行に 1 つの wheel の結果を JSON で書く (JSON lines)。
+//
+// {"id":"7_0.wheel","wheel":"7 5 5 5 5 5 5 5","status":"ok","candidates":50,"overcharged":1,
+//  "payloads":["N E deg0 ..."],"elapsed_ms":{"second_neighbor":12,...,"total":48},
+//  "counters":{"anchor_tried":1234,...},"timers_ms":{"decide_degree_by_rules":20,...},"max_rss_kb":12345}
+//
+// status は "ok" か "failed" で、 "failed" のときは "error" に理由を書く。
+// payloads は overcharged な cartwheel を CartWheel::toString(is_related) で文字列にしたもの。
+// counters, timers_ms は探索の統計 (SearchStats) で、統計を数えないでビルドしたときや評価に失敗したときは書かない。
+// max_rss_kb は評価を終えたときのプロセスの RSS の最大値で、評価に失敗したときは書かない。
+class WheelResult {
+public:
+    string id;
+    string wheel;
+    bool failed = false;
+    string error;
+    int num_candidates = 0;
+    int num_overcharged = 0;
+    vector<string> payloads;
+    // (探索の段階の名前, かかった時間 (ms)) を段階の順に並べたもの
+    vector<pair<string, int64_t>> elapsed_ms;
+    // 探索の統計 (SearchStats::counters, SearchStats::timersMs)
+    vector<pair<string, int64_t>> counters;
+    vector<pair<string, int64_t>> timers_ms;
+    int64_t max_rss_kb = 0;
+
+    bool succeeded(void) const;
+    string toJson(void) const;
+    static WheelResult fromJson(const string &line);
+};
+
+// 1 つの wheel の評価にかかる手間の見積もり (estimateWheel)
+// 見積もりのファイルには 1 行に 1 つの wheel の見積もりを JSON で書く。
+//
+// {"id":"7_0.wheel","wheel":"7 5 5 5 5 5 5 5","hub_degree":7,"unfixed_neighbors":0,"send_cases":84,
+//  "probes":2,"nodes":123.5,"leaves":2.0,"predicted_ms":35.2,"elapsed_ms":1.8}
+//
+// unfixed_neighbors は次数が 1 つに定まっていない近傍の数、 send_cases は hub と近傍の間の辺に適用しうる send case の数の和。
+// nodes, leaves は探索木の節点と葉 (overcharged か調べる cartwheel) の数の見積もりで、
+// predicted_ms は probes 回探索木をたどったときの節点 1 つあたりの時間から見積もった評価の時間、 elapsed_ms は見積もりにかかった時間。
+class WheelEstimate {
+public:
+    string id;
+    string wheel;
+    int hub_degree = 0;
+    int unfixed_neighbors = 0;
+    int send_cases = 0;
+    int probes = 0;
+    double nodes = 0;
+    double leaves = 0;
+    double predicted_ms = 0;
+    double elapsed_ms = 0;
+
+    string toJson(void) const;
+};
+
+// 評価結果をファイルに追記する。複数のスレッドから呼んでよい。
+class ResultWriter {
+private:
+    std::ofstream ofs_;
+    std::mutex mutex_;
+
+public:
+    ResultWriter(const string &filename);
+    void write(const WheelResult &result);
+    void write(const WheelEstimate &estimate);
+};
+
+void readResults(const string &result_filename, const std::function<void(WheelResult &&)> &f);
+void aggregateResults(const vector<string> &result_filenames, int hub_degree, int begin, int end, const string &remaining_filename);
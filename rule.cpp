@@ -6,6 +6,7 @@
 #include <spdlog/spdlog.h>
 #include <boost/algorithm/string.hpp>
 #include "rule.hpp"
+#include "log.hpp"
 
 using std::getline;
 namespace fs = std::filesystem;
@@ -13,10 +14,27 @@ namespace fs = std::filesystem;
 Rule::Rule(int from, int to, int amount, const NearTriangulation &rule) :
     rule_(rule),
     amount_(amount) {
-    auto send_edge = std::make_pair(from, to);
-    const auto &edges = rule.edges();
-    send_edgeid_ = std::find(edges.begin(), edges.end(), send_edge) - edges.begin();
-    assert(send_edgeid_ != (int)edges.size());
+    send_edgeid_ = rule.edgeId(from, to);
+    assert(send_edgeid_ != -1);
+    computeSendDegreeClasses();
+    match_plan_ = MatchPlan(rule_);
+}
+
+Rule::Rule(int send_edgeid, int amount, const NearTriangulation &rule) :
+    rule_(rule),
+    send_edgeid_(send_edgeid),
+    amount_(amount) {
+    assert(0 <= send_edgeid_ && send_edgeid_ < (int)rule.edges().size());
+    computeSendDegreeClasses();
+    match_plan_ = MatchPlan(rule_);
+}
+
+// rule は detect_possible = true で照合するので、次数が定まっていない頂点とも適合する。
+void Rule::computeSendDegreeClasses(void) {
+    auto [from, to] = rule_.edges()[send_edgeid_];
+    send_degree_classes_[0] = acceptedDegreeClasses(rule_.degrees()[from], true);
+    send_degree_classes_[1] = acceptedDegreeClasses(rule_.degrees()[to], true);
+    return;
 }
 
 Rule Rule::readRuleFile(const string &filename) {
@@ -32,7 +50,7 @@ Rule Rule::readRuleFile(const string &filename) {
     --from, --to;
 
     vector<set<int>> VtoV(vertex_size);
-    vector<optional<Degree>> degrees(vertex_size, std::nullopt);
+    vector<Degree> degrees(vertex_size, Degree());
 
     for (int vi = 0;vi < vertex_size; vi++) {
         int v;
@@ -72,13 +90,54 @@ int Rule::amount(void) const {
     return amount_;
 }
 
+const std::array<uint32_t, 2> &Rule::sendDegreeClasses(void) const {
+    return send_degree_classes_;
+}
+
+const MatchPlan &Rule::matchPlan(void) const {
+    return match_plan_;
+}
+
+// rules から索引を作る。 rules は索引の中にコピーして持つ。
+RuleIndex::RuleIndex(const vector<Rule> &rules) : rules_(rules), rule_idxes_(NUM_DEGREE_CLASSES * NUM_DEGREE_CLASSES), fingerprint_(CONTENT_HASH_SEED) {
+    for (const auto &rule : rules_) {
+        fingerprint_ = hashInt(fingerprint_, rule.sendEdgeId());
+        fingerprint_ = hashInt(fingerprint_, rule.amount());
+        fingerprint_ = rule.nearTriangulation().contentHash(fingerprint_);
+    }
+    for (int c_from = 0;c_from < NUM_DEGREE_CLASSES; c_from++) {
+        for (int c_to = 0;c_to < NUM_DEGREE_CLASSES; c_to++) {
+            auto &rule_idxes = rule_idxes_[c_from * NUM_DEGREE_CLASSES + c_to];
+            for (int rule_idx = 0;rule_idx < (int)rules_.size(); rule_idx++) {
+                const auto &classes = rules_[rule_idx].sendDegreeClasses();
+                if ((classes[0] >> c_from & 1) && (classes[1] >> c_to & 1)) rule_idxes.push_back(rule_idx);
+            }
+        }
+    }
+}
+
+const vector<Rule> &RuleIndex::rules(void) const {
+    return rules_;
+}
+
+uint64_t RuleIndex::fingerprint(void) const {
+    return fingerprint_;
+}
+
+// graph の辺 edgeid に沿って送るときに、端点の次数から適用しうる rule の番号を昇順に返す。
+// ここに含まれない rule を BaseWheel::amountChargeToSend などで照合しても charge は送られない。
+const vector<int> &RuleIndex::applicableRules(const NearTriangulation &graph, int edgeid) const {
+    auto [u, v] = graph.edges()[edgeid];
+    return rule_idxes_[degreeClass(graph.degrees()[u]) * NUM_DEGREE_CLASSES + degreeClass(graph.degrees()[v])];
+}
+
 // ディレクトリに含まれる　rule ファイルの rule を返す。
 vector<Rule> getRules(const std::string &dirname) {
     vector<Rule> rules;
     spdlog::info("reading rules from {} ...", dirname);
     for (const fs::directory_entry &file : fs::directory_iterator(dirname)) {
         if (file.is_regular_file() && file.path().extension().string<char>() == ".rule") {
-            spdlog::trace("reading {}", file.path().string<char>());
+            LOG_TRACE("reading {}", file.path().string<char>());
             rules.push_back(Rule::readRuleFile(file.path().string<char>()));
         } 
     }
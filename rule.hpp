@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include "near_triangulation.hpp"
+#include "match_plan.hpp"
 
 using std::string;
 
@@ -8,14 +9,41 @@ class Rule {
 private:
     NearTriangulation rule_;
     int send_edgeid_, amount_;
+    // send する辺の始点, 終点と照合しうる頂点の次数の分類 (acceptedDegreeClasses)
+    std::array<uint32_t, 2> send_degree_classes_;
+    // rule を照合する手順
+    MatchPlan match_plan_;
+
+    void computeSendDegreeClasses(void);
 
 public:
     Rule(int from, int to, int amount, const NearTriangulation &rule);
+    Rule(int send_edgeid, int amount, const NearTriangulation &rule);
     static Rule readRuleFile(const string &filename);
 
     const NearTriangulation &nearTriangulation(void) const;
     int sendEdgeId(void) const;
     int amount(void) const;
+    const std::array<uint32_t, 2> &sendDegreeClasses(void) const;
+    const MatchPlan &matchPlan(void) const;
+};
+
+// rule を send する辺の端点の次数の分類で引けるようにした索引
+class RuleIndex {
+private:
+    vector<Rule> rules_;
+    // rule_idxes_[c_from * NUM_DEGREE_CLASSES + c_to] := send する辺の始点, 終点の次数の分類が c_from, c_to である辺に適用しうる rule の番号 (昇順)
+    vector<vector<int>> rule_idxes_;
+    // rules_ の内容 (順番を含む) のハッシュ (checkpoint の fingerprint に使う。)
+    uint64_t fingerprint_;
+
+public:
+    RuleIndex(void) : rule_idxes_(NUM_DEGREE_CLASSES * NUM_DEGREE_CLASSES), fingerprint_(CONTENT_HASH_SEED) {};
+    RuleIndex(const vector<Rule> &rules);
+
+    const vector<Rule> &rules(void) const;
+    uint64_t fingerprint(void) const;
+    const vector<int> &applicableRules(const NearTriangulation &graph, int edgeid) const;
 };
 
 vector<Rule> getRules(const std::string &dirname);
@@ -0,0 +1,207 @@
+#include <set>
+#include <map>
+#include <tuple>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <spdlog/spdlog.h>
+#include "scheduler.hpp"
+#include "log.hpp"
+
+namespace fs = std::filesystem;
+
+bool ScheduleOptions::enabled(void) const {
+    return manifest_filename != "";
+}
+
+// 子プロセスで実行中の job
+// 子プロセスは評価結果を JSON の 1 行にして pipe に書き出してから終了する。
+class RunningJob {
+public:
+    int idx;
+    pid_t pid;
+    int fd;
+    string output;
+    std::chrono::steady_clock::time_point start;
+    bool timed_out;
+};
+
+// fork した子プロセスで run(idx) を実行し、評価結果を fd に書き出して終了する。
+// 親から引き継いだ atexit の処理 (ログの書き出しのスレッドの終了など) は行わずに _exit で終了する。
+[[noreturn]] static void runJobInChild(int idx, int fd, const std::function<WheelResult(int)> &run, const ScheduleOptions &options) {
+    setupLoggerInChild();
+    if (options.memory_limit_mb > 0) {
+        struct rlimit limit;
+        limit.rlim_cur = limit.rlim_max = (rlim_t)options.memory_limit_mb << 20;
+        setrlimit(RLIMIT_AS, &limit);
+    }
+    int status = 0;
+    try {
+        string line = run(idx).toJson() + "\n";
+        size_t pos = 0;
+        while (pos < line.size()) {
+            ssize_t n = write(fd, line.data() + pos, line.size() - pos);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                status = 1;
+                break;
+            }
+            pos += n;
+        }
+    } catch (...) {
+        status = 1;
+    }
+    close(fd);
+    _exit(status);
+}
+
+static RunningJob startJob(int idx, const std::function<WheelResult(int)> &run, const ScheduleOptions &options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        spdlog::critical("Failed to create a pipe : {}", std::strerror(errno));
+        throw std::runtime_error("Failed to create a pipe");
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        spdlog::critical("Failed to fork : {}", std::strerror(errno));
+        throw std::runtime_error("Failed to fork");
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        runJobInChild(idx, fds[1], run, options);
+    }
+    close(fds[1]);
+    return RunningJob{idx, pid, fds[0], "", std::chrono::steady_clock::now(), false};
+}
+
+// 出力を読み終えた job の子プロセスを回収し、評価結果を返す。
+// 子プロセスが評価結果を書き出さずに終了したとき (制限時間を超えた、メモリが足りずに落ちた、など) は失敗とする。
+static WheelResult finishJob(RunningJob &job, const ScheduleOptions &options) {
+    close(job.fd);
+    int status = 0;
+    while (waitpid(job.pid, &status, 0) < 0 && errno == EINTR);
+    int64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - job.start).count();
+
+    WheelResult result;
+    if (!job.timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0 && !job.output.empty() && job.output.back() == '\n') {
+        try {
+            return WheelResult::fromJson(job.output.substr(0, job.output.size() - 1));
+        } catch (const std::exception &e) {
+            result.error = fmt::format("broken result ({})", e.what());
+        }
+    } else if (job.timed_out) {
+        result.error = fmt::format("timeout ({} s)", options.timeout_seconds);
+    } else if (WIFSIGNALED(status)) {
+        result.error = fmt::format("killed by signal {} ({})", WTERMSIG(status), strsignal(WTERMSIG(status)));
+    } else {
+        result.error = fmt::format("exited with status {} without result", WEXITSTATUS(status));
+    }
+    result.failed = true;
+    result.elapsed_ms.push_back({"total", elapsed_ms});
+    return result;
+}
+
+// manifest_filename (なければ空とみなす) から job の状態を読む。
+ManifestState readManifest(const string &manifest_filename) {
+    ManifestState manifest;
+    if (!fs::exists(manifest_filename)) return manifest;
+    readResults(manifest_filename, [&](WheelResult &&result) {
+        if (!result.failed) {
+            manifest.finished.insert(result.id);
+            return;
+        }
+        for (const auto &[phase, ms] : result.elapsed_ms) {
+            if (phase == "total") manifest.failed_elapsed_ms[result.id] = ms;
+        }
+    });
+    return manifest;
+}
+
+// names[idx] という名前の job (run(idx) で評価する) を、 num_workers 個の子プロセスで並列に評価する。
+// job は 1 つずつ fork した子プロセスで評価するので、読み込み済みの corpus などは子プロセスと共有され、
+// 1 つの job が制限時間を超えたり落ちたりしても他の job には影響しない。
+// 評価結果は親プロセスだけが options.manifest_filename に追記する。
+// manifest_state (options.manifest_filename を readManifest で読んだもの) で評価を終えている job は実行しない。
+//
+// 時間のかかる job を先に始めると全体の終わる時間がそろうので、
+// 前回失敗した job (制限時間を超えたものなど) をかかった時間の長い順に、その後に残りを expected_costs の大きい順に評価する。
+void scheduleJobs(const vector<string> &names, const vector<double> &expected_costs, const std::function<WheelResult(int)> &run,
+    int num_workers, const ScheduleOptions &options, const ManifestState &manifest_state) {
+    const auto &finished = manifest_state.finished;
+    const auto &failed_elapsed_ms = manifest_state.failed_elapsed_ms;
+    vector<int> order;
+    for (int idx = 0;idx < (int)names.size(); idx++) {
+        if (!finished.count(names[idx])) order.push_back(idx);
+    }
+    auto priority = [&](int idx) {
+        auto it = failed_elapsed_ms.find(names[idx]);
+        return std::make_tuple(it != failed_elapsed_ms.end(), it != failed_elapsed_ms.end() ? it->second : 0, expected_costs[idx]);
+    };
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return priority(a) > priority(b);
+    });
+    spdlog::info("scheduling {} jobs with {} workers ({} finished jobs in {} are skipped)", order.size(), num_workers, names.size() - order.size(), options.manifest_filename);
+
+    ResultWriter manifest(options.manifest_filename);
+    vector<RunningJob> running;
+    int next = 0, num_done = 0, num_failed = 0;
+    while (next < (int)order.size() || !running.empty()) {
+        while (next < (int)order.size() && (int)running.size() < num_workers) {
+            running.push_back(startJob(order[next++], run, options));
+        }
+        // いずれかの子プロセスの出力か、最も早く来る制限時間を待つ。
+        auto now = std::chrono::steady_clock::now();
+        int wait_ms = -1;
+        vector<pollfd> fds;
+        for (const auto &job : running) {
+            fds.push_back({job.fd, POLLIN, 0});
+            if (options.timeout_seconds <= 0 || job.timed_out) continue;
+            auto deadline = job.start + std::chrono::seconds(options.timeout_seconds);
+            int ms = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+            if (wait_ms < 0 || ms < wait_ms) wait_ms = ms;
+        }
+        if (poll(fds.data(), fds.size(), wait_ms) < 0 && errno != EINTR) {
+            spdlog::critical("Failed to poll : {}", std::strerror(errno));
+            throw std::runtime_error("Failed to poll");
+        }
+        now = std::chrono::steady_clock::now();
+        for (int i = (int)running.size() - 1;i >= 0; i--) {
+            auto &job = running[i];
+            bool closed = false;
+            if (fds[i].revents != 0) {
+                char buffer[4096];
+                ssize_t n = read(job.fd, buffer, sizeof(buffer));
+                if (n > 0) job.output.append(buffer, n);
+                closed = n == 0 || (n < 0 && errno != EINTR);
+            }
+            if (!closed && !job.timed_out && options.timeout_seconds > 0 && now - job.start >= std::chrono::seconds(options.timeout_seconds)) {
+                // 子プロセスが終了すると pipe が閉じるので、その後で回収する。
+                kill(job.pid, SIGKILL);
+                job.timed_out = true;
+            }
+            if (!closed) continue;
+
+            auto result = finishJob(job, options);
+            result.id = names[job.idx];
+            manifest.write(result);
+            num_done++;
+            if (result.failed) {
+                num_failed++;
+                spdlog::warn("failed {} [{}/{}] : {}", result.id, num_done, order.size(), result.error);
+            } else {
+                spdlog::info("finished {} [{}/{}]", result.id, num_done, order.size());
+            }
+            running.erase(running.begin() + i);
+        }
+    }
+    spdlog::info("finished {} jobs ({} failed)", num_done, num_failed);
+    return;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <cstdint>
+#include <functional>
+#include "result.hpp"
+
+using std::string;
+using std::vector;
+
+// wheel の評価 (job) をまとめて実行するときの設定
+// manifest_filename には job の評価結果を 1 行に 1 つ追記する (ResultWriter と同じ形式)。
+// 評価を終えた (status が "ok" の) 結果があるものは実行しないので、中断しても同じ設定で実行し直せば残りの job だけを実行する。
+// timeout_seconds, memory_limit_mb が正のときは、1 つの job にかかる時間と使うメモリ (アドレス空間の大きさ) をそれぞれ制限する。
+// num_probes は job を並べるときに、評価にかかる時間を見積もるために探索木をたどる回数。
+class ScheduleOptions {
+public:
+    string manifest_filename;
+    int timeout_seconds = 0;
+    int memory_limit_mb = 0;
+    int num_probes = 0;
+
+    bool enabled(void) const;
+};
+
+// manifest に記録された job の状態
+// finished は評価を終えた job の名前、 failed_elapsed_ms は失敗した job の (最後の) 記録の評価にかかった時間
+class ManifestState {
+public:
+    std::set<string> finished;
+    std::map<string, int64_t> failed_elapsed_ms;
+};
+
+ManifestState readManifest(const string &manifest_filename);
+void scheduleJobs(const vector<string> &names, const vector<double> &expected_costs, const std::function<WheelResult(int)> &run,
+    int num_workers, const ScheduleOptions &options, const ManifestState &manifest_state);
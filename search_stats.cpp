@@ -0,0 +1,63 @@
+#include <sys/resource.h>
+#include <fmt/format.h>
+#include "search_stats.hpp"
+
+static const char *COUNTER_NAMES[(int)Counter::NUM] = {
+    "anchor_tried", "anchor_skipped",
+    "match_calls", "match_yes", "match_possible", "match_no",
+    "prune_other_case", "prune_charge_bound", "prune_conf",
+    "conf_checks",
+    "canonical_codes", "isomorphism_tests", "duplicates",
+};
+
+static const char *TIMER_NAMES[(int)Timer::NUM] = {
+    "decide_degree_by_rules", "unique", "prune", "contain_confs", "extend_third_neighbor", "make_unique", "is_overcharged",
+};
+
+SearchStats &SearchStats::operator+=(const SearchStats &other) {
+    for (int i = 0;i < (int)counts.size(); i++) counts[i] += other.counts[i];
+    for (int i = 0;i < (int)nanoseconds.size(); i++) nanoseconds[i] += other.nanoseconds[i];
+    return *this;
+}
+
+SearchStats SearchStats::operator-(const SearchStats &other) const {
+    SearchStats res = *this;
+    for (int i = 0;i < (int)counts.size(); i++) res.counts[i] -= other.counts[i];
+    for (int i = 0;i < (int)nanoseconds.size(); i++) res.nanoseconds[i] -= other.nanoseconds[i];
+    return res;
+}
+
+vector<pair<string, int64_t>> SearchStats::counters(void) const {
+    vector<pair<string, int64_t>> res;
+    for (int i = 0;i < (int)counts.size(); i++) res.push_back({COUNTER_NAMES[i], counts[i]});
+    return res;
+}
+
+vector<pair<string, int64_t>> SearchStats::timersMs(void) const {
+    vector<pair<string, int64_t>> res;
+    for (int i = 0;i < (int)nanoseconds.size(); i++) res.push_back({TIMER_NAMES[i], nanoseconds[i] / 1000000});
+    return res;
+}
+
+// "match_calls 123, ..., decide_degree_by_rules 45 ms, ..." の形で返す。
+string SearchStats::toString(void) const {
+    string res;
+    for (const auto &[name, count] : counters()) {
+        res += fmt::format("{}{} {}", res.empty() ? "" : ", ", name, count);
+    }
+    for (const auto &[name, ms] : timersMs()) {
+        res += fmt::format(", {} {} ms", name, ms);
+    }
+    return res;
+}
+
+SearchStats &searchStats(void) {
+    thread_local SearchStats stats;
+    return stats;
+}
+
+int64_t maxRssKb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using std::string;
+using std::vector;
+using std::pair;
+
+// 探索中の統計は STATS_COUNT, STATS_TIMER で数える。
+// DISCHARGE_ENABLE_STATS を 0 にしてビルドすると統計を数える処理はコンパイル時に取り除かれる。
+#ifndef DISCHARGE_ENABLE_STATS
+#define DISCHARGE_ENABLE_STATS 1
+#endif
+
+// 探索中に数える回数
+enum class Counter : int {
+    // 辺を対応させて rule や conf と照合した回数と、端点の次数の分類で照合を省いた回数
+    AnchorTried,
+    AnchorSkipped,
+    // containSubgraphWithCorrespondingEdge を呼んだ回数と、その結果 (対応のさせ方ごと) の内訳
+    // どの対応のさせ方でも次数が適合せずに結果が空のときは No に 1 つ数える。
+    MatchCalls,
+    MatchYes,
+    MatchPossible,
+    MatchNo,
+    // decideDegreeBySendCases で候補を探索しなかった理由の内訳
+    // (指定した charge より多く送っていて他のケースで探索する、 charge が閾値を超えない、 conf を含む)
+    PruneOtherCase,
+    PruneChargeBound,
+    PruneConf,
+    // conf を含むか調べた回数
+    ConfChecks,
+    // 同型なものを取り除くときに、標準形を求めた回数、 isIsomorphic で比べた回数、同型なので取り除いた数
+    CanonicalCodes,
+    IsomorphismTests,
+    Duplicates,
+    NUM
+};
+
+// 時間を測る探索の段階
+// containOneofConfs は prune の中でも呼ぶので、入れ子になった段階の時間は両方に数える。
+enum class Timer : int {
+    DecideDegreeByRules,
+    Unique,
+    Prune,
+    ContainConfs,
+    ExtendThirdNeighbor,
+    MakeUnique,
+    IsOvercharged,
+    NUM
+};
+
+// 探索の統計 (スレッドごとに searchStats() に数えて、最後にまとめる。)
+class SearchStats {
+public:
+    std::array<int64_t, (int)Counter::NUM> counts{};
+    std::array<int64_t, (int)Timer::NUM> nanoseconds{};
+
+    SearchStats &operator+=(const SearchStats &other);
+    SearchStats operator-(const SearchStats &other) const;
+    // (名前, 回数) を Counter の順に並べたもの
+    vector<pair<string, int64_t>> counters(void) const;
+    // (名前, 時間 (ms)) を Timer の順に並べたもの
+    vector<pair<string, int64_t>> timersMs(void) const;
+    string toString(void) const;
+};
+
+// 今のスレッドの統計
+SearchStats &searchStats(void);
+
+// これまでのプロセスの RSS の最大値 (kB)
+int64_t maxRssKb(void);
+
+// 作ってから破棄するまでの時間を今のスレッドの統計に足す。
+class ScopedTimer {
+private:
+    Timer timer_;
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    ScopedTimer(Timer timer) : timer_(timer), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        searchStats().nanoseconds[(int)timer_] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+};
+
+#if DISCHARGE_ENABLE_STATS
+#define STATS_COUNT(counter, n) (searchStats().counts[(int)(counter)] += (n))
+#define STATS_TIMER(timer) ScopedTimer stats_timer(timer)
+#else
+#define STATS_COUNT(counter, n) do {} while (0)
+#define STATS_TIMER(timer) do {} while (0)
+#endif
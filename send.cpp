@@ -3,6 +3,7 @@
 #include <cassert>
 #include <utility>
 #include <set>
+#include <unordered_map>
 #include <filesystem>
 #include <boost/program_options.hpp>
 #include <spdlog/spdlog.h>
@@ -11,25 +12,39 @@
 #include "rule.hpp"
 #include "near_triangulation.hpp"
 #include "cartwheel.hpp"
+#include "corpus.hpp"
+#include "log.hpp"
 
 namespace fs = std::filesystem;
 using std::string;
 using std::set;
 
+// graph1 の辺 edgeid1 と graph2 の辺 edgeid2 を対応させたときに同型かどうか。
+bool isIsomorphicWithCorrespondingEdge(const NearTriangulation &graph1, const NearTriangulation &graph2, int edgeid1, int edgeid2) {
+    thread_local MatchPlan plan1, plan2;
+    plan1.build(graph1);
+    plan2.build(graph2);
+    return BaseWheel::numOfSubgraphWithCorrespondingEdge(graph1, plan2, edgeid1, edgeid2) > 0
+        && BaseWheel::numOfSubgraphWithCorrespondingEdge(graph2, plan1, edgeid2, edgeid1) > 0;
+}
+
 template <class WheelLike>
 vector<WheelLike> makeUnique(const vector<WheelLike> &wheels, int edgeid) {
     vector<WheelLike> unique_wheels;
+    // edgeid の辺を根とした標準形が一致するものだけ同型か確かめる。
+    std::unordered_map<vector<int>, vector<int>, CanonicalCodeHash> unique_idxes_by_code;
     for (auto &wheel : wheels) {
         // edgeid の辺を対応させたときに unique_wheels の中に wheel と同型なものが含まれていたら wheel は unique_wheel に追加しない。
+        auto &unique_idxes = unique_idxes_by_code[wheel.nearTriangulation().canonicalCode({edgeid})];
         bool add_wheel = true;
-        for (auto &unique_wheel : unique_wheels) {
-            if (BaseWheel::numOfSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), unique_wheel.nearTriangulation(), edgeid, edgeid) > 0 &&
-                BaseWheel::numOfSubgraphWithCorrespondingEdge(unique_wheel.nearTriangulation(), wheel.nearTriangulation(), edgeid, edgeid) > 0) {
+        for (int j : unique_idxes) {
+            if (isIsomorphicWithCorrespondingEdge(wheel.nearTriangulation(), unique_wheels[j].nearTriangulation(), edgeid, edgeid)) {
                 add_wheel = false;
                 break;
             }
         }
         if (add_wheel) {
+            unique_idxes.push_back(unique_wheels.size());
             unique_wheels.push_back(wheel);
         }
     }
@@ -43,22 +58,21 @@ vector<WheelLike> makeUnique(const vector<WheelLike> &wheels, int edgeid) {
 // + 与えられた rules で send_vertex と receive_vertex の間で charge を送り合う次数の状況を列挙する。
 // + ただし、 confs に含まれている configuration が現れている場合は除く。
 vector<CartWheel> decideDegree(const CartWheel &cartwheel, const vector<Degree> &degrees, 
-    const vector<Configuration> &confs, const vector<Rule> &rules, int send_vertex, int receive_vertex, int max_degree, bool bidirectional) {
+    const ConfIndex &confs, const RuleIndex &rules, int send_vertex, int receive_vertex, int max_degree, bool bidirectional,
+    const Checkpointer &checkpointer, const string &checkpoint_name) {
     vector<CartWheel> res;
     set<string> res_strs;
 
-    const auto &edges = cartwheel.nearTriangulation().edges();
     vector<int> edgeids;
 
     // send_vertex から receive_vertex への辺を加える。
-    int edgeid = std::find(edges.begin(), edges.end(), std::make_pair(send_vertex, receive_vertex)) - edges.begin();
-    assert(edgeid != (int)edges.size());
+    int edgeid = cartwheel.nearTriangulation().edgeId(send_vertex, receive_vertex);
+    assert(edgeid != -1);
     edgeids.push_back(edgeid);
 
     // receive_vertex から send_vertex への辺を加える。
     if (bidirectional) {
-        int revedgeid = std::find(edges.begin(), edges.end(), std::make_pair(receive_vertex, send_vertex)) - edges.begin();
-        assert(revedgeid != (int)edges.size());
+        int revedgeid = cartwheel.nearTriangulation().reverseEdgeId(edgeid);
         edgeids.push_back(revedgeid);
     }
 
@@ -66,9 +80,15 @@ vector<CartWheel> decideDegree(const CartWheel &cartwheel, const vector<Degree>
     auto decide_degree_by_rules = [&](const CartWheel& wheel) -> vector<CartWheel> {
         const auto &wheel_degrees = wheel.nearTriangulation().degrees();
         vector<CartWheel> next_wheels;
-        for (const auto &rule : rules) {
+        ContainResults result_list;
+        for (const auto &rule : rules.rules()) {
             for (int edgeid : edgeids) {
-                auto result_list = BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.nearTriangulation(), edgeid, rule.sendEdgeId(), {}, true);
+                if (!wheel.nearTriangulation().edgeInDegreeClasses(edgeid, rule.sendDegreeClasses())) {
+                    STATS_COUNT(Counter::AnchorSkipped, 1);
+                    continue;
+                }
+                STATS_COUNT(Counter::AnchorTried, 1);
+                BaseWheel::containSubgraphWithCorrespondingEdge(wheel.nearTriangulation(), rule.matchPlan(), edgeid, rule.sendEdgeId(), true, result_list);
                 const auto &rule_degrees = rule.nearTriangulation().degrees();
                 for (const auto &result : result_list) {
                     if (result.contain != Contain::Possible) continue;
@@ -78,9 +98,9 @@ vector<CartWheel> decideDegree(const CartWheel &cartwheel, const vector<Degree>
                     bool decide_degree = false;
                     vector<CartWheel> wheels = {wheel};
                     for (int v = 0;v < wheel.nearTriangulation().vertexSize(); v++) {
-                        if (result.occupied[v] != -1 && !wheel_degrees[v].has_value()) {
+                        if (result.occupied[v] != -1 && wheel_degrees[v].unset()) {
                             decide_degree = true;
-                            vector<Degree> degrees = divideDegree(rule_degrees[result.occupied[v]].value(), max_degree);
+                            DividedDegrees degrees = divideDegree(rule_degrees[result.occupied[v]], max_degree);
 
                             for (CartWheel &w : wheels) {
                                 w.setDegree(v, degrees[0]);
@@ -103,35 +123,81 @@ vector<CartWheel> decideDegree(const CartWheel &cartwheel, const vector<Degree>
         return next_wheels;
     };
 
-    auto decide_degree = [&](auto &&decide_degree, const CartWheel &wheel) -> void {
-        string wheel_str = wheel.toString();
-        if (res_strs.count(wheel_str)) return;
-        res.push_back(wheel);
-        res_strs.insert(wheel_str);
-
-        // rule に従って次数を決める。
+    // rule に従って wheel から次数を決めた子を返す。
+    auto expand = [&](const CartWheel &wheel) -> vector<CartWheel> {
         vector<CartWheel> next_wheels = decide_degree_by_rules(wheel);
-        spdlog::trace("candidate next_wheel.size : {}", next_wheels.size());
+        LOG_TRACE("candidate next_wheel.size : {}", next_wheels.size());
 
         // unique にする。
         makeUnique(next_wheels, edgeids[0]);
-        spdlog::trace("unique_wheel.size : {}", next_wheels.size());
+        LOG_TRACE("unique_wheel.size : {}", next_wheels.size());
 
         // configuration を含んでいる cartwheel を除く。
+        // wheel は conf を含まないので、次数を決めた頂点の周りだけを調べる。
         vector<CartWheel> temp;
         std::copy_if(next_wheels.begin(), next_wheels.end(), std::back_inserter(temp), [&](const CartWheel &w) {
-            return !BaseWheel::containOneofConfs(w, confs);
+            return !BaseWheel::containOneofConfsAround(w, w.nearTriangulation().changedVertices(wheel.nearTriangulation()), confs);
         });
         std::swap(temp, next_wheels);
         
-        spdlog::trace("next_wheel.size : {}", next_wheels.size());
-        for (const auto& next_wheel : next_wheels) {
-            decide_degree(decide_degree, next_wheel);
-        }
-        return;
+        LOG_TRACE("next_wheel.size : {}", next_wheels.size());
+        return next_wheels;
+    };
+
+    // checkpointer に途中経過を保存するときは、 cartwheel を次数だけで表す。 (探索中の cartwheel は cartwheel と次数だけが違う。)
+    string fingerprint = fmt::format("decideDegree {} send {} receive {} max_degree {} bidirectional {} rules {} {:016x} confs {} {:016x}",
+        cartwheel.toString(), send_vertex, receive_vertex, max_degree, bidirectional, rules.rules().size(), rules.fingerprint(), confs.numConfs(), confs.fingerprint());
+    auto from_degrees = [&](const vector<Degree> &degrees) -> CartWheel {
+        CartWheel wheel = cartwheel;
+        for (int v = 0;v < (int)degrees.size(); v++) wheel.setDegree(v, degrees[v]);
+        return wheel;
+    };
+    auto make_checkpoint = [&](const vector<CartWheel> &wheels) -> vector<CheckpointTask> {
+        vector<CheckpointTask> tasks;
+        for (const auto &wheel : wheels) tasks.push_back(CheckpointTask{wheel.nearTriangulation().degrees(), 0, {}, {}});
+        return tasks;
     };
-    decide_degree(decide_degree, cartwheel);
 
+    // 深さ優先に探索する。 stack の末尾の cartwheel から探索するので、子は逆順に積む。
+    // 一度探索した cartwheel (res に含まれるもの) は探索しない。
+    vector<CartWheel> stack;
+    auto checkpoint = checkpointer.load(checkpoint_name, fingerprint);
+    if (checkpoint.has_value()) {
+        for (const auto &task : checkpoint.value().results) {
+            res.push_back(from_degrees(task.degrees));
+            res_strs.insert(res.back().toString());
+        }
+        for (const auto &task : checkpoint.value().frontier) stack.push_back(from_degrees(task.degrees));
+        if (checkpoint.value().done) return res;
+    } else if (BaseWheel::containOneofConfs(cartwheel, confs)) {
+        // cartwheel が conf を含むときは、次数を決めても conf を含んだままなので cartwheel 以外の候補はない。
+        res.push_back(cartwheel);
+        checkpointer.finish(checkpoint_name, fingerprint, make_checkpoint(res));
+        return res;
+    } else {
+        stack.push_back(cartwheel);
+    }
+    auto interval = checkpointer.enabled() ? std::chrono::steady_clock::duration(checkpointer.interval()) : std::chrono::steady_clock::duration::max();
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    while (!stack.empty()) {
+        if (std::chrono::steady_clock::now() - last_checkpoint >= interval) {
+            SearchCheckpoint checkpoint;
+            checkpoint.results = make_checkpoint(res);
+            checkpoint.frontier = make_checkpoint(stack);
+            checkpointer.save(checkpoint_name, fingerprint, checkpoint);
+            last_checkpoint = std::chrono::steady_clock::now();
+        }
+        CartWheel wheel = std::move(stack.back());
+        stack.pop_back();
+        string wheel_str = wheel.toString();
+        if (res_strs.count(wheel_str)) continue;
+        res.push_back(wheel);
+        res_strs.insert(wheel_str);
+
+        auto next_wheels = expand(wheel);
+        for (int i = (int)next_wheels.size() - 1;i >= 0; i--) stack.push_back(std::move(next_wheels[i]));
+    }
+    checkpointer.finish(checkpoint_name, fingerprint, make_checkpoint(res));
     return res;
 }
 
@@ -141,23 +207,19 @@ vector<CartWheel> decideDegree(const CartWheel &cartwheel, const vector<Degree>
 //    + bidirectional = false なら 0。
 // 3. 適用される rule に関連しているかどうかを表す頂点ごとの bool 値。
 // をまとめて計算する。
-std::tuple<int, int, vector<bool>> getRelatedVertices(CartWheel &cw, int send_vertex, int receive_vertex, const vector<Rule> &rules, bool bidirectional) {
+std::tuple<int, int, vector<bool>> getRelatedVertices(CartWheel &cw, int send_vertex, int receive_vertex, const RuleIndex &rules, bool bidirectional) {
     int send_charge = 0;
     int receive_charge = 0;
     vector<bool> is_related(cw.nearTriangulation().vertexSize(), false);
-    for (const Rule &rule : rules) {
-        auto [send_l, send_u, send_related] = BaseWheel::amountChargeToSend(cw, send_vertex, receive_vertex, rule);
+    const auto &graph = cw.nearTriangulation();
+    for (int rule_idx : rules.applicableRules(graph, graph.edgeId(send_vertex, receive_vertex))) {
+        auto [send_l, send_u] = BaseWheel::amountChargeToSend(cw, send_vertex, receive_vertex, rules.rules()[rule_idx], &is_related);
         send_charge += send_l;
-        for (auto v = 0u;v < is_related.size(); v++) {
-            is_related[v] = is_related[v] || send_related[v];
-        }
-        
-        if (bidirectional) {
-            auto [receive_l, receive_u, receive_related] = BaseWheel::amountChargeToSend(cw, receive_vertex, send_vertex, rule);
+    }
+    if (bidirectional) {
+        for (int rule_idx : rules.applicableRules(graph, graph.edgeId(receive_vertex, send_vertex))) {
+            auto [receive_l, receive_u] = BaseWheel::amountChargeToSend(cw, receive_vertex, send_vertex, rules.rules()[rule_idx], &is_related);
             receive_charge += receive_l;
-            for (auto v = 0u;v < is_related.size(); v++) {
-                is_related[v] = is_related[v] || receive_related[v];
-            }
         }
     }
 
@@ -167,12 +229,12 @@ std::tuple<int, int, vector<bool>> getRelatedVertices(CartWheel &cw, int send_ve
 
 // is_related = true であるような cartwheel の頂点からなる nearTriangulation の (vertexSize, VtoV, degrees) を計算する。
 // つまり、ルールに関係ない頂点を取り除いた nearTriangulation を計算する。
-std::tuple<int, vector<set<int>>, vector<optional<Degree>>> generateNearTriangulation(const CartWheel &cartwheel, int send_vertex, int receive_vertex, const vector<bool> &is_related) {
+std::tuple<int, vector<set<int>>, vector<Degree>> generateNearTriangulation(const CartWheel &cartwheel, int send_vertex, int receive_vertex, const vector<bool> &is_related) {
     const auto &original_degrees = cartwheel.nearTriangulation().degrees();
 
     vector<int> new_vid(cartwheel.nearTriangulation().vertexSize(), -1);
     int vertex_size = 0;
-    vector<optional<Degree>> degrees;
+    vector<Degree> degrees;
     for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
         if (is_related[v]) {
             new_vid[v] = vertex_size++;
@@ -218,12 +280,12 @@ void output(const NearTriangulation &cw_neartriangulation, int send_vertex, int
                     VtoV[e.first].insert(e.second);
                     VtoV[e.second].insert(e.first);
                 }
-                vector<optional<Degree>> degrees = cw_neartriangulation.degrees();
+                vector<Degree> degrees = cw_neartriangulation.degrees();
 
                 string res = fmt::format("from {} to {} amount {}\n", send_degree.toString(), receive_degree.toString(), send_charge);
                 res += fmt::format("{} {} {} {}\n", vertex_size, send_vertex+1, receive_vertex+1, send_charge);
                 for (int v = 0;v < vertex_size; v++) {
-                    res += fmt::format("{} {} ", v+1, degrees[v].value().toString());
+                    res += fmt::format("{} {} ", v+1, degrees[v].toString());
                     for (int u : VtoV[v]) {
                         res += fmt::format("{} ", u+1);
                     }
@@ -244,9 +306,9 @@ void output(const NearTriangulation &cw_neartriangulation, int send_vertex, int
 }
 
 void enumerate(const Degree &send_degree, const Degree &receive_degree, 
-    const string &confs_dirname, const string &rules_dirname, int max_degree, bool bidirectional, const string &outdir) {
-    auto confs = getConfs(confs_dirname);
-    auto rules = getRules(rules_dirname);
+    const Corpus &corpus, int max_degree, bool bidirectional, const string &outdir, const Checkpointer &checkpointer) {
+    const auto &confs = corpus.conf_index;
+    const auto &rules = corpus.rule_index;
 
     vector<Degree> possible_degrees;
     for (int deg = 5;deg < max_degree; deg++) possible_degrees.push_back(Degree(deg));
@@ -261,21 +323,16 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
     
     // wheel を unique にする。
     spdlog::info("calculating unique wheel...");
-    auto edge = std::make_pair(send_vertex, receive_vertex);
-    int edgeid = -1;
-    {
-        const auto &wheel_edges = wheel.nearTriangulation().edges();
-        edgeid = std::find(wheel_edges.begin(), wheel_edges.end(), edge) - wheel_edges.begin();
-        assert(edgeid != (int)wheel_edges.size());
-    }
+    int edgeid = wheel.nearTriangulation().edgeId(send_vertex, receive_vertex);
+    assert(edgeid != -1);
     spdlog::info("take only unique wheel");
     auto unique_wheels = makeUnique(wheels, edgeid);
 
     // 第 2 近傍までの次数を決める。
     spdlog::info("deciding degree...");
     vector<CartWheel> cartwheels;
-    for (const Wheel &w : unique_wheels) {
-        auto cartwheels_from_w = decideDegree(CartWheel::fromWheel(w), possible_degrees, confs, rules, send_vertex, receive_vertex, max_degree, bidirectional);
+    for (int i = 0;i < (int)unique_wheels.size(); i++) {
+        auto cartwheels_from_w = decideDegree(CartWheel::fromWheel(unique_wheels[i]), possible_degrees, confs, rules, send_vertex, receive_vertex, max_degree, bidirectional, checkpointer, fmt::format("second_{}", i));
         cartwheels.insert(cartwheels.end(), cartwheels_from_w.begin(), cartwheels_from_w.end());
     }
 
@@ -285,7 +342,7 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
         const auto &degrees = cartwheel.nearTriangulation().degrees();
         // second-neighbor で次数の定まっていない頂点は次数を max_degree+ にする。
         for (int v = 0;v < cartwheel.nearTriangulation().vertexSize(); v++) {
-            if (!degrees[v].has_value()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
+            if (degrees[v].unset()) cartwheel.setDegree(v, Degree(max_degree, MAX_DEGREE));
         }
         cartwheel.extendThirdNeighbor();
         return cartwheel;
@@ -294,13 +351,15 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
 
     // 第 3 近傍の次数を決める。
     vector<CartWheel> thirdneighbor_cartwheels;
-    for (const auto& cartwheel : cartwheels) {
-        auto cartwheels = decideDegree(cartwheel, possible_degrees, confs, rules, send_vertex, receive_vertex, max_degree, bidirectional);
-        thirdneighbor_cartwheels.insert(thirdneighbor_cartwheels.end(), cartwheels.begin(), cartwheels.end());
+    for (int i = 0;i < (int)cartwheels.size(); i++) {
+        auto cartwheels_from_cw = decideDegree(cartwheels[i], possible_degrees, confs, rules, send_vertex, receive_vertex, max_degree, bidirectional, checkpointer, fmt::format("third_{}", i));
+        thirdneighbor_cartwheels.insert(thirdneighbor_cartwheels.end(), cartwheels_from_cw.begin(), cartwheels_from_cw.end());
     }
 
     vector<NearTriangulation> unique_cartwheels;
     vector<int> edgeids;
+    // send する辺を根とした標準形ごとに unique_cartwheels の添字を持つ。
+    std::unordered_map<vector<int>, vector<int>, CanonicalCodeHash> unique_idxes_by_code;
     int count = 0;
     for (CartWheel &cw : thirdneighbor_cartwheels) {
         // ルールの適用に関係がある頂点を特定し、
@@ -312,13 +371,12 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
         NearTriangulation cw_neartriangulation = NearTriangulation(vertex_size, VtoV, degrees);
 
         // unique 判定
-        const auto &cw_edges = cw_neartriangulation.edges();
-        int cw_edgeid = std::find(cw_edges.begin(), cw_edges.end(), std::make_pair(send_vertex, receive_vertex)) - cw_edges.begin();
-        assert(cw_edgeid != (int)cw_edges.size());
+        int cw_edgeid = cw_neartriangulation.edgeId(send_vertex, receive_vertex);
+        assert(cw_edgeid != -1);
+        auto &unique_idxes = unique_idxes_by_code[cw_neartriangulation.canonicalCode({cw_edgeid})];
         bool unique = true;
-        for (auto i = 0u;i < unique_cartwheels.size(); i++) {
-            if (BaseWheel::numOfSubgraphWithCorrespondingEdge(unique_cartwheels[i], cw_neartriangulation, edgeids[i], cw_edgeid) > 0 
-             && BaseWheel::numOfSubgraphWithCorrespondingEdge(cw_neartriangulation, unique_cartwheels[i], cw_edgeid, edgeids[i]) > 0) {
+        for (int i : unique_idxes) {
+            if (isIsomorphicWithCorrespondingEdge(unique_cartwheels[i], cw_neartriangulation, edgeids[i], cw_edgeid)) {
                 unique = false;
                 break;
             }
@@ -326,6 +384,7 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
         if (!unique) {
             continue;
         }
+        unique_idxes.push_back(unique_cartwheels.size());
         unique_cartwheels.push_back(cw_neartriangulation);
         edgeids.push_back(cw_edgeid);
         assert(edgeid == cw_edgeid);
@@ -334,6 +393,8 @@ void enumerate(const Degree &send_degree, const Degree &receive_degree,
         output(cw_neartriangulation, send_vertex, receive_vertex, send_degree, receive_degree, send_charge, receive_charge, bidirectional, count, outdir);
     }
     spdlog::info("There are {} case that degree {} sends charge to degree {}", count, send_degree.toString(), receive_degree.toString());
+    spdlog::info("max rss : {} kB", maxRssKb());
+    LOG_DEBUG("search stats : {}", searchStats().toString());
 
     return;
 }
@@ -347,10 +408,14 @@ int main(const int ac, const char* const* const av) {
         ("to,t", value<string>(), "degree of vertex that receives charge")
         ("conf,c", value<string>(), "The directory which includes configuration files")
         ("rule,r", value<string>(), "The directory which includes rule files")
+        ("snapshot,S", value<string>(), "The snapshot file made by a.out --compile_snapshot (used instead of --rule and --conf)")
         ("max_degree,m", value<int>(), "Maximum degree to check (if you choose degree from {5, 6, 7, 8+}), set max_degree 8")
         ("bidirectional,b", "Detect cases that we apply both \"to -> from\", \"from -> to\" rules")
         ("outdir,o", value<string>()->default_value(""), "The directory which outputs rule file that represents vertex sends charge. if you do not specify thie parameter, output is nothing")
         ("help,H", "Display options")
+        ("checkpoint", value<string>()->default_value(""), "The directory that the progress of the search is saved in (removed when the search finishes)")
+        ("checkpoint_interval", value<int>()->default_value(600), "The interval (seconds) to save the progress of the search")
+        ("resume", "Resume the search from the progress saved in --checkpoint")
         ("verbosity,v", value<int>()->default_value(0), "1 for debug, 2 for trace");
 
     variables_map vm;
@@ -361,15 +426,7 @@ int main(const int ac, const char* const* const av) {
         description.print(std::cout);
         return 0;
     }
-    if (vm.count("verbosity")) {
-        auto v = vm["verbosity"].as<int>();
-        if (v == 1) {
-            spdlog::set_level(spdlog::level::debug);
-        }
-        if (v == 2) {
-            spdlog::set_level(spdlog::level::trace);
-        }
-    }
+    setupLogger(vm["verbosity"].as<int>());
     if (vm.count("from") && vm.count("to")) {
         Degree send_degree = Degree::fromString(vm["from"].as<string>());
         Degree receive_degree = Degree::fromString(vm["to"].as<string>());
@@ -377,11 +434,11 @@ int main(const int ac, const char* const* const av) {
             spdlog::warn("degree of vertex that sends charge must be fixed value");
             exit(1);
         }
-        if (!vm.count("rule")) {
+        if (!vm.count("snapshot") && !vm.count("rule")) {
             spdlog::warn("Specify directory which includes rule files");
             exit(1);
         }
-        if (!vm.count("conf")) {
+        if (!vm.count("snapshot") && !vm.count("conf")) {
             spdlog::warn("Specify directory which includes configuration files");
             exit(1);
         }
@@ -389,8 +446,6 @@ int main(const int ac, const char* const* const av) {
             spdlog::warn("Specify max_degree");
             exit(1);
         }
-        string confdir = vm["conf"].as<string>();
-        string ruledir = vm["rule"].as<string>();
         int max_degree = vm["max_degree"].as<int>();
         bool bidirectional = vm.count("bidirectional");
         string outdir = vm["outdir"].as<string>();
@@ -398,7 +453,18 @@ int main(const int ac, const char* const* const av) {
             spdlog::warn("The directory {} does not exist", outdir);
             exit(1);
         }
-        enumerate(send_degree, receive_degree, confdir, ruledir, max_degree, bidirectional, outdir);
+        Corpus corpus = vm.count("snapshot")
+            ? Corpus::fromSnapshot(vm["snapshot"].as<string>())
+            : Corpus::fromDirectories(vm["rule"].as<string>(), "", vm["conf"].as<string>());
+        Checkpointer checkpointer(vm["checkpoint"].as<string>(), vm["checkpoint_interval"].as<int>(), vm.count("resume"));
+        if (vm.count("resume") && !checkpointer.enabled()) {
+            spdlog::warn("Specify the directory of the checkpoint to resume");
+            exit(1);
+        }
+        // send の次数と receive の次数ごとに分けて保存する。
+        auto enumerate_checkpointer = checkpointer.sub(fmt::format("from{}to{}{}", send_degree.toString(), receive_degree.toString(), bidirectional ? "_bidirectional" : ""));
+        enumerate(send_degree, receive_degree, corpus, max_degree, bidirectional, outdir, enumerate_checkpointer);
+        enumerate_checkpointer.clear();
     } else {
         spdlog::warn("Please specify degree of vertex");
     }
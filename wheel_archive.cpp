@@ -0,0 +1,160 @@
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <spdlog/spdlog.h>
+#include "wheel_archive.hpp"
+
+// wheel archive ファイルの先頭に置く識別子
+const char WHEEL_ARCHIVE_MAGIC[8] = {'D', 'I', 'S', 'C', 'H', 'W', 'H', 'L'};
+const int WHEEL_ARCHIVE_HEADER_SIZE = sizeof(WHEEL_ARCHIVE_MAGIC) + 4 * sizeof(int32_t);
+// ヘッダの中で count を置く位置
+const int WHEEL_ARCHIVE_COUNT_OFFSET = WHEEL_ARCHIVE_HEADER_SIZE - sizeof(int32_t);
+const int WHEEL_ARCHIVE_MAX_CODE = 15;
+
+static int recordSize(int hub_degree) {
+    return (hub_degree + 1) / 2;
+}
+
+WheelArchiveWriter::WheelArchiveWriter(const string &filename, int hub_degree, int max_degree)
+    : ofs_(filename, std::ios::binary), filename_(filename), hub_degree_(hub_degree), max_degree_(max_degree), count_(0) {
+    if (!ofs_) {
+        spdlog::critical("Failed to open {}", filename);
+        throw std::runtime_error("Failed to open " + filename);
+    }
+    if (max_degree - 5 > WHEEL_ARCHIVE_MAX_CODE) {
+        spdlog::critical("max_degree {} is too large to write into a wheel archive", max_degree);
+        throw std::runtime_error("max_degree is too large to write into a wheel archive");
+    }
+    ofs_.write(WHEEL_ARCHIVE_MAGIC, sizeof(WHEEL_ARCHIVE_MAGIC));
+    for (int32_t value : {WHEEL_ARCHIVE_VERSION, hub_degree_, max_degree_, count_}) {
+        ofs_.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+}
+
+// neighbor_degrees[i] := neighbor i + 1 の次数
+void WheelArchiveWriter::append(const vector<Degree> &neighbor_degrees) {
+    vector<unsigned char> record(recordSize(hub_degree_), 0);
+    for (int i = 0;i < hub_degree_; i++) {
+        const auto &degree = neighbor_degrees[i];
+        bool fixed = degree.fixed() && degree.lower() < max_degree_;
+        bool over_max = !degree.unset() && degree.lower() == max_degree_ && degree.upper() == MAX_DEGREE;
+        if (!fixed && !over_max) {
+            spdlog::critical("The degree {} cannot be written into a wheel archive (max_degree {})", degree.unset() ? "?" : degree.toString(), max_degree_);
+            throw std::runtime_error("Invalid degree for a wheel archive");
+        }
+        int code = degree.lower() - 5;
+        record[i / 2] |= code << (4 * (i % 2));
+    }
+    ofs_.write(reinterpret_cast<const char *>(record.data()), record.size());
+    count_++;
+    return;
+}
+
+// 追記した wheel とヘッダの count をファイルに書き出す。
+void WheelArchiveWriter::flush(void) {
+    auto end = ofs_.tellp();
+    int32_t count = count_;
+    ofs_.seekp(WHEEL_ARCHIVE_COUNT_OFFSET);
+    ofs_.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    ofs_.seekp(end);
+    ofs_.flush();
+    if (!ofs_) {
+        spdlog::critical("Failed to write {}", filename_);
+        throw std::runtime_error("Failed to write " + filename_);
+    }
+    return;
+}
+
+int WheelArchiveWriter::count(void) const {
+    return count_;
+}
+
+WheelArchive::WheelArchive(const string &filename) : filename_(filename), data_(nullptr), size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        spdlog::critical("Failed to open {}", filename);
+        throw std::runtime_error("Failed to open " + filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        spdlog::critical("Failed to stat {}", filename);
+        throw std::runtime_error("Failed to stat " + filename);
+    }
+    size_ = st.st_size;
+    if (size_ < (size_t)WHEEL_ARCHIVE_HEADER_SIZE) {
+        close(fd);
+        spdlog::critical("{} is truncated", filename);
+        throw std::runtime_error(filename + " is truncated");
+    }
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        spdlog::critical("Failed to mmap {}", filename);
+        throw std::runtime_error("Failed to mmap " + filename);
+    }
+    data_ = static_cast<const unsigned char *>(addr);
+
+    auto read_int = [&](int offset) -> int {
+        int32_t value;
+        std::memcpy(&value, data_ + offset, sizeof(value));
+        return value;
+    };
+    if (std::memcmp(data_, WHEEL_ARCHIVE_MAGIC, sizeof(WHEEL_ARCHIVE_MAGIC)) != 0) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+        spdlog::critical("{} is not a wheel archive", filename);
+        throw std::runtime_error(filename + " is not a wheel archive");
+    }
+    int version = read_int(sizeof(WHEEL_ARCHIVE_MAGIC));
+    if (version != WHEEL_ARCHIVE_VERSION) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+        spdlog::critical("The version of {} is {} (expected {}). Generate the wheels again", filename, version, WHEEL_ARCHIVE_VERSION);
+        throw std::runtime_error("Version mismatch of " + filename);
+    }
+    hub_degree_ = read_int(sizeof(WHEEL_ARCHIVE_MAGIC) + sizeof(int32_t));
+    max_degree_ = read_int(sizeof(WHEEL_ARCHIVE_MAGIC) + 2 * sizeof(int32_t));
+    count_ = read_int(WHEEL_ARCHIVE_COUNT_OFFSET);
+    if (WHEEL_ARCHIVE_HEADER_SIZE + (size_t)count_ * recordSize(hub_degree_) > size_) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+        spdlog::critical("{} is truncated", filename);
+        throw std::runtime_error(filename + " is truncated");
+    }
+}
+
+WheelArchive::~WheelArchive(void) {
+    munmap(const_cast<unsigned char *>(data_), size_);
+}
+
+const string &WheelArchive::fileName(void) const {
+    return filename_;
+}
+
+int WheelArchive::hubDegree(void) const {
+    return hub_degree_;
+}
+
+int WheelArchive::maxDegree(void) const {
+    return max_degree_;
+}
+
+int WheelArchive::size(void) const {
+    return count_;
+}
+
+// index 番目の wheel の neighbor 1, 2, ..., hub_degree の次数を返す。
+vector<Degree> WheelArchive::neighborDegrees(int index) const {
+    if (index < 0 || index >= count_) {
+        spdlog::critical("{} has no wheel whose index is {} (the number of wheels is {})", filename_, index, count_);
+        throw std::runtime_error("Index out of range of " + filename_);
+    }
+    const unsigned char *record = data_ + WHEEL_ARCHIVE_HEADER_SIZE + (size_t)index * recordSize(hub_degree_);
+    vector<Degree> neighbor_degrees(hub_degree_);
+    for (int i = 0;i < hub_degree_; i++) {
+        int deg = 5 + ((record[i / 2] >> (4 * (i % 2))) & 0xf);
+        neighbor_degrees[i] = deg >= max_degree_ ? Degree(max_degree_, MAX_DEGREE) : Degree(deg);
+    }
+    return neighbor_degrees;
+}
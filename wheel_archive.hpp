@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include "near_triangulation.hpp"
+
+using std::string;
+using std::vector;
+
+// wheel archive ファイルの形式のバージョン。形式を変えたら上げる。
+const int WHEEL_ARCHIVE_VERSION = 1;
+
+// hub の次数が同じ wheel をまとめて 1 つのファイルに格納する (拡張子は .wheels)。
+// int32 (リトルエンディアン) のヘッダの後に、 wheel の neighbor の次数を 1 つ 4 bit に詰めた固定長のレコードを並べる。
+//
+// magic (8 byte) version hub_degree max_degree count
+// record * count
+//
+// record := neighbor 1, 2, ..., hub_degree の次数の符号 (1 byte に 2 つずつ、下位 4 bit から詰める。)
+// 次数の符号は deg - 5 で、 max_degree 以上 (max_degree+) は max_degree - 5 とする。
+// index 番目のレコードはファイルの先頭から header の長さ + index * (hub_degree + 1) / 2 byte の位置にある。
+
+// archive に wheel を追記する。 flush するたびにヘッダの count を書き直すので、
+// 書き出している途中でも count までの wheel は読める。
+class WheelArchiveWriter {
+private:
+    std::ofstream ofs_;
+    string filename_;
+    int hub_degree_, max_degree_, count_;
+
+public:
+    WheelArchiveWriter(const string &filename, int hub_degree, int max_degree);
+    void append(const vector<Degree> &neighbor_degrees);
+    void flush(void);
+    int count(void) const;
+};
+
+// archive を mmap して任意の index の wheel を読む。
+// 読むのは開いたときにヘッダの count に書かれていた数までの wheel。
+class WheelArchive {
+private:
+    string filename_;
+    const unsigned char *data_;
+    size_t size_;
+    int hub_degree_, max_degree_, count_;
+
+public:
+    WheelArchive(const string &filename);
+    ~WheelArchive(void);
+    WheelArchive(const WheelArchive &) = delete;
+    WheelArchive &operator=(const WheelArchive &) = delete;
+
+    const string &fileName(void) const;
+    int hubDegree(void) const;
+    int maxDegree(void) const;
+    int size(void) const;
+    vector<Degree> neighborDegrees(int index) const;
+};